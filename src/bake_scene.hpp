@@ -0,0 +1,125 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include "bvh.hpp"
+#include "scene_lights.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+
+// the static scene flattened for the cpu bakers (lightmap_baker and the irradiance probes), no gl in here.
+// fill the per triangle lists, set the lights, then Build
+struct BakeScene
+{
+    static constexpr float RAY_EPSILON = 0.002f;
+
+    TriangleBVH bvh;
+    std::vector<glm::vec3> normals; // 3 per triangle, world space
+    std::vector<glm::vec3> albedos; // 1 per triangle
+
+    DirLight sun;
+    SpotLight spot;
+    PointLight lamp;
+
+    // world space, 3 per triangle in the same order as normals
+    void Build(const std::vector<glm::vec3>& positions)
+    {
+        bvh.Build(positions);
+    }
+
+    // diffuse light arriving at a point, the same terms calcDirLight/calcPointLight/calcSpotLight use minus ambient and specular
+    glm::vec3 DirectLight(const glm::vec3& position, const glm::vec3& normal) const
+    {
+        glm::vec3 origin = position + normal * RAY_EPSILON;
+        glm::vec3 result(0.0f);
+
+        glm::vec3 sunDirection = glm::normalize(-sun.direction);
+        float sunAmount = glm::dot(normal, sunDirection);
+        if (sunAmount > 0.0f && !bvh.Occluded(origin, sunDirection, FLT_MAX))
+        {
+            result += sun.diffuse * sunAmount;
+        }
+
+        glm::vec3 direction;
+        float distance;
+        float attenuation = Attenuation(position, lamp.position, lamp.constant, lamp.linear, lamp.quadratic, direction, distance);
+        float lampAmount = glm::dot(normal, direction);
+        if (lampAmount > 0.0f && !bvh.Occluded(origin, direction, distance - RAY_EPSILON))
+        {
+            result += lamp.diffuse * lampAmount * attenuation;
+        }
+
+        attenuation = Attenuation(position, spot.position, spot.constant, spot.linear, spot.quadratic, direction, distance);
+        float theta = glm::dot(direction, glm::normalize(-spot.direction));
+        float cutOff = std::cos(glm::radians(spot.cutOff)), outerCutOff = std::cos(glm::radians(spot.outerCutOff));
+        float intensity = glm::smoothstep(0.0f, 1.0f, (theta - outerCutOff) / (cutOff - outerCutOff));
+        float spotAmount = glm::dot(normal, direction);
+        if (spotAmount > 0.0f && intensity > 0.0f && !bvh.Occluded(origin, direction, distance - RAY_EPSILON))
+        {
+            result += spot.diffuse * spotAmount * intensity * attenuation;
+        }
+
+        return result;
+    }
+
+    // interpolated normal at a hit, flipped to face the ray. backface says whether it had to be flipped
+    glm::vec3 HitNormal(const TriangleBVH::Hit& hit, const glm::vec3& direction, bool* backface = nullptr) const
+    {
+        const glm::vec3* corners = &normals[hit.triangle * 3];
+        glm::vec3 normal = glm::normalize(corners[0] * (1.0f - hit.u - hit.v) + corners[1] * hit.u + corners[2] * hit.v);
+        bool flipped = glm::dot(normal, direction) > 0.0f;
+        if (backface)
+        {
+            *backface = flipped;
+        }
+        return flipped ? -normal : normal;
+    }
+
+private:
+    static float Attenuation(const glm::vec3& position, const glm::vec3& lightPosition, float constant, float linear, float quadratic, glm::vec3& direction, float& distance)
+    {
+        glm::vec3 toLight = lightPosition - position;
+        distance = glm::length(toLight);
+        direction = toLight / distance;
+        return 1.0f / (constant + linear * distance + quadratic * distance * distance);
+    }
+};
+
+
+// xorshift, seeded per texel/probe so a bake doesnt depend on which thread did what
+struct BakeRandom
+{
+    uint32_t state;
+
+    explicit BakeRandom(uint32_t seed) : state((seed * 747796405u + 2891336453u) | 1u) {}
+
+    float Next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+inline glm::vec3 CosineSampleHemisphere(const glm::vec3& normal, BakeRandom& random)
+{
+    float r = std::sqrt(random.Next());
+    float phi = 2.0f * 3.14159265f * random.Next();
+    glm::vec3 tangent = glm::normalize(glm::cross(std::abs(normal.x) > 0.5f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), normal));
+    glm::vec3 bitangent = glm::cross(normal, tangent);
+    return glm::normalize(tangent * (r * std::cos(phi)) + bitangent * (r * std::sin(phi)) + normal * std::sqrt(std::max(0.0f, 1.0f - r * r)));
+}
+
+inline glm::vec3 UniformSampleSphere(BakeRandom& random)
+{
+    float z = 1.0f - 2.0f * random.Next();
+    float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    float phi = 2.0f * 3.14159265f * random.Next();
+    return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
@@ -0,0 +1,335 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+
+// bounding volume hierarchy over a triangle soup, for casting rays on the cpu (the offline bakers).
+// built once with binned sah, nodes are stored so an inner node's children are next to each other
+class TriangleBVH
+{
+public:
+    struct Hit
+    {
+        float t = FLT_MAX;
+        unsigned int triangle = 0; // index into the positions Build got, divided by 3
+        float u = 0.0f, v = 0.0f;  // barycentrics of the second and third vertex
+    };
+
+    // 3 positions per triangle
+    void Build(const std::vector<glm::vec3>& positions)
+    {
+        int count = positions.size() / 3;
+        triangles.resize(count);
+        triangleIds.resize(count);
+        centroids.resize(count);
+        for (int i = 0; i < count; i++)
+        {
+            const glm::vec3& a = positions[i * 3];
+            const glm::vec3& b = positions[i * 3 + 1];
+            const glm::vec3& c = positions[i * 3 + 2];
+            triangles[i] = {a, b - a, c - a};
+            triangleIds[i] = i;
+            centroids[i] = (a + b + c) / 3.0f;
+        }
+
+        nodes.clear();
+        nodes.reserve(count * 2);
+        nodes.push_back(Node());
+        nodes[0].first = 0;
+        nodes[0].count = count;
+        UpdateBounds(0);
+        Subdivide(0);
+
+        centroids.clear();
+        centroids.shrink_to_fit();
+    }
+
+    // closest hit along the ray up to maxT, direction doesnt have to be normalized (t is in its units)
+    bool Intersect(const glm::vec3& origin, const glm::vec3& direction, float maxT, Hit& hit) const
+    {
+        if (nodes.empty())
+            return false;
+
+        glm::vec3 inverseDirection = 1.0f / direction;
+        hit.t = maxT;
+        bool found = false;
+
+        unsigned int stack[128];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0)
+        {
+            const Node& node = nodes[stack[--stackSize]];
+            if (node.count > 0)
+            {
+                for (unsigned int i = node.first; i < node.first + node.count; i++)
+                {
+                    float t, u, v;
+                    if (IntersectTriangle(triangles[i], origin, direction, hit.t, t, u, v))
+                    {
+                        hit.t = t;
+                        hit.u = u;
+                        hit.v = v;
+                        hit.triangle = triangleIds[i];
+                        found = true;
+                    }
+                }
+                continue;
+            }
+
+            // nearer child last so it gets popped first
+            unsigned int left = node.first, right = node.first + 1;
+            float leftT = IntersectBox(nodes[left], origin, inverseDirection, hit.t);
+            float rightT = IntersectBox(nodes[right], origin, inverseDirection, hit.t);
+            if (leftT > rightT)
+            {
+                std::swap(leftT, rightT);
+                std::swap(left, right);
+            }
+            if (rightT != FLT_MAX)
+                stack[stackSize++] = right;
+            if (leftT != FLT_MAX)
+                stack[stackSize++] = left;
+        }
+        return found;
+    }
+
+    // any hit, for shadow rays
+    bool Occluded(const glm::vec3& origin, const glm::vec3& direction, float maxT) const
+    {
+        if (nodes.empty())
+            return false;
+
+        glm::vec3 inverseDirection = 1.0f / direction;
+
+        unsigned int stack[128];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0)
+        {
+            const Node& node = nodes[stack[--stackSize]];
+            if (IntersectBox(node, origin, inverseDirection, maxT) == FLT_MAX)
+                continue;
+
+            if (node.count > 0)
+            {
+                for (unsigned int i = node.first; i < node.first + node.count; i++)
+                {
+                    float t, u, v;
+                    if (IntersectTriangle(triangles[i], origin, direction, maxT, t, u, v))
+                        return true;
+                }
+                continue;
+            }
+            stack[stackSize++] = node.first;
+            stack[stackSize++] = node.first + 1;
+        }
+        return false;
+    }
+
+    int GetNodeCount() const
+    {
+        return nodes.size();
+    }
+
+private:
+    static const int BIN_COUNT = 16;
+    static const int MAX_LEAF_SIZE = 4;
+
+    struct Node
+    {
+        glm::vec3 min;
+        unsigned int first; // first triangle for leaves, left child for inner nodes (right is the one after)
+        glm::vec3 max;
+        unsigned int count; // 0 for inner nodes
+    };
+
+    // first vertex and the two edges from it, what moller trumbore wants
+    struct Triangle
+    {
+        glm::vec3 v0, edge1, edge2;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Triangle> triangles;
+    std::vector<unsigned int> triangleIds;
+    std::vector<glm::vec3> centroids; // only while building
+
+    void UpdateBounds(unsigned int nodeIndex)
+    {
+        Node& node = nodes[nodeIndex];
+        node.min = glm::vec3(FLT_MAX);
+        node.max = glm::vec3(-FLT_MAX);
+        for (unsigned int i = node.first; i < node.first + node.count; i++)
+        {
+            const Triangle& triangle = triangles[i];
+            for (const glm::vec3& vertex : {triangle.v0, triangle.v0 + triangle.edge1, triangle.v0 + triangle.edge2})
+            {
+                node.min = glm::min(node.min, vertex);
+                node.max = glm::max(node.max, vertex);
+            }
+        }
+    }
+
+    static float SurfaceArea(const glm::vec3& min, const glm::vec3& max)
+    {
+        glm::vec3 extent = max - min;
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+
+    void Subdivide(unsigned int nodeIndex)
+    {
+        Node node = nodes[nodeIndex];
+        if (node.count <= MAX_LEAF_SIZE)
+            return;
+
+        // centroid bounds, the bins are spread over these
+        glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+        for (unsigned int i = node.first; i < node.first + node.count; i++)
+        {
+            centroidMin = glm::min(centroidMin, centroids[i]);
+            centroidMax = glm::max(centroidMax, centroids[i]);
+        }
+
+        // cheapest split plane over every axis's bins
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        float bestSplit = 0.0f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float extent = centroidMax[axis] - centroidMin[axis];
+            if (extent <= 0.0f)
+                continue;
+
+            struct Bin
+            {
+                glm::vec3 min = glm::vec3(FLT_MAX);
+                glm::vec3 max = glm::vec3(-FLT_MAX);
+                int count = 0;
+            };
+            Bin bins[BIN_COUNT];
+            float scale = BIN_COUNT / extent;
+            for (unsigned int i = node.first; i < node.first + node.count; i++)
+            {
+                int bin = std::min(BIN_COUNT - 1, (int)((centroids[i][axis] - centroidMin[axis]) * scale));
+                const Triangle& triangle = triangles[i];
+                for (const glm::vec3& vertex : {triangle.v0, triangle.v0 + triangle.edge1, triangle.v0 + triangle.edge2})
+                {
+                    bins[bin].min = glm::min(bins[bin].min, vertex);
+                    bins[bin].max = glm::max(bins[bin].max, vertex);
+                }
+                bins[bin].count++;
+            }
+
+            // sweep from both sides so every plane's cost is known in one pass each
+            float leftArea[BIN_COUNT - 1], rightArea[BIN_COUNT - 1];
+            int leftCount[BIN_COUNT - 1], rightCount[BIN_COUNT - 1];
+            glm::vec3 leftMin(FLT_MAX), leftMax(-FLT_MAX), rightMin(FLT_MAX), rightMax(-FLT_MAX);
+            int leftSum = 0, rightSum = 0;
+            for (int i = 0; i < BIN_COUNT - 1; i++)
+            {
+                leftSum += bins[i].count;
+                leftCount[i] = leftSum;
+                leftMin = glm::min(leftMin, bins[i].min);
+                leftMax = glm::max(leftMax, bins[i].max);
+                leftArea[i] = leftSum > 0 ? SurfaceArea(leftMin, leftMax) : 0.0f;
+
+                rightSum += bins[BIN_COUNT - 1 - i].count;
+                rightCount[BIN_COUNT - 2 - i] = rightSum;
+                rightMin = glm::min(rightMin, bins[BIN_COUNT - 1 - i].min);
+                rightMax = glm::max(rightMax, bins[BIN_COUNT - 1 - i].max);
+                rightArea[BIN_COUNT - 2 - i] = rightSum > 0 ? SurfaceArea(rightMin, rightMax) : 0.0f;
+            }
+            for (int i = 0; i < BIN_COUNT - 1; i++)
+            {
+                float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = centroidMin[axis] + (i + 1) / scale;
+                }
+            }
+        }
+
+        // not worth splitting
+        if (bestAxis < 0 || bestCost >= node.count * SurfaceArea(node.min, node.max))
+            return;
+
+        // partition the node's triangles in place
+        int i = node.first;
+        int j = node.first + node.count - 1;
+        while (i <= j)
+        {
+            if (centroids[i][bestAxis] < bestSplit)
+            {
+                i++;
+            }
+            else
+            {
+                std::swap(triangles[i], triangles[j]);
+                std::swap(triangleIds[i], triangleIds[j]);
+                std::swap(centroids[i], centroids[j]);
+                j--;
+            }
+        }
+        unsigned int leftCount = i - node.first;
+        if (leftCount == 0 || leftCount == node.count)
+            return;
+
+        unsigned int left = nodes.size();
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        nodes[left].first = node.first;
+        nodes[left].count = leftCount;
+        nodes[left + 1].first = i;
+        nodes[left + 1].count = node.count - leftCount;
+        nodes[nodeIndex].first = left;
+        nodes[nodeIndex].count = 0;
+
+        UpdateBounds(left);
+        UpdateBounds(left + 1);
+        Subdivide(left);
+        Subdivide(left + 1);
+    }
+
+    // distance to the box or FLT_MAX on a miss
+    static float IntersectBox(const Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxT)
+    {
+        glm::vec3 t0 = (node.min - origin) * inverseDirection;
+        glm::vec3 t1 = (node.max - origin) * inverseDirection;
+        glm::vec3 tNear = glm::min(t0, t1);
+        glm::vec3 tFar = glm::max(t0, t1);
+        float enter = std::max({tNear.x, tNear.y, tNear.z, 0.0f});
+        float exit = std::min({tFar.x, tFar.y, tFar.z, maxT});
+        return enter <= exit ? enter : FLT_MAX;
+    }
+
+    // moller trumbore, both sides count
+    static bool IntersectTriangle(const Triangle& triangle, const glm::vec3& origin, const glm::vec3& direction, float maxT, float& t, float& u, float& v)
+    {
+        glm::vec3 p = glm::cross(direction, triangle.edge2);
+        float determinant = glm::dot(triangle.edge1, p);
+        if (std::abs(determinant) < 1e-12f)
+            return false;
+
+        float inverseDeterminant = 1.0f / determinant;
+        glm::vec3 toOrigin = origin - triangle.v0;
+        u = glm::dot(toOrigin, p) * inverseDeterminant;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+
+        glm::vec3 q = glm::cross(toOrigin, triangle.edge1);
+        v = glm::dot(direction, q) * inverseDeterminant;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+
+        t = glm::dot(triangle.edge2, q) * inverseDeterminant;
+        return t > 0.0f && t < maxT;
+    }
+};
@@ -0,0 +1,72 @@
+#version 460 core
+
+// assigns point lights to clusters, one invocation per cluster, see ClusteredLights::Build.
+// every workgroup moves the lights into view space in batches through shared memory, so each light is
+// transformed once per workgroup instead of once per cluster
+layout (local_size_x = 64) in;
+
+#include "lights.glsl"
+
+uniform int pointLightCount;
+
+shared vec4 batchLights[64]; // view space position, radius
+
+void main()
+{
+    uint cluster = gl_GlobalInvocationID.x;
+    bool active = cluster < CLUSTER_COUNT;
+
+    // view space box around the cluster. the tile's corners are rays from the camera, cut by the slice's depths
+    uint x = cluster % CLUSTER_GRID_X;
+    uint y = (cluster / CLUSTER_GRID_X) % CLUSTER_GRID_Y;
+    uint z = cluster / (CLUSTER_GRID_X * CLUSTER_GRID_Y);
+    float sliceNear = getSliceDepth(float(z));
+    float sliceFar = getSliceDepth(float(z + 1));
+
+    mat4 inverseProjection = inverse(projection);
+    vec3 boxMin = vec3(1e30);
+    vec3 boxMax = vec3(-1e30);
+    for (int corner = 0; corner < 4; corner++)
+    {
+        vec2 tile = vec2(float(x + uint(corner & 1)), float(y + uint(corner >> 1)));
+        vec2 ndc = tile / vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y) * 2.0 - 1.0;
+        vec4 nearPoint = inverseProjection * vec4(ndc, -1.0, 1.0);
+        vec3 ray = nearPoint.xyz / nearPoint.w;
+        ray /= -ray.z; // depth 1
+
+        boxMin = min(boxMin, min(ray * sliceNear, ray * sliceFar));
+        boxMax = max(boxMax, max(ray * sliceNear, ray * sliceFar));
+    }
+
+    uint count = 0;
+    uint firstSlot = cluster * MAX_LIGHTS_PER_CLUSTER;
+    for (int batchStart = 0; batchStart < pointLightCount; batchStart += 64)
+    {
+        int lightIndex = batchStart + int(gl_LocalInvocationID.x);
+        if (lightIndex < pointLightCount)
+        {
+            PointLight light = pointLights[lightIndex];
+            batchLights[gl_LocalInvocationID.x] = vec4((view * vec4(light.position, 1.0)).xyz, light.radius);
+        }
+        barrier();
+
+        int batchSize = min(64, pointLightCount - batchStart);
+        for (int i = 0; i < batchSize && active; i++)
+        {
+            // sphere against box, closest point of the box to the center
+            vec4 light = batchLights[i];
+            vec3 offset = clamp(light.xyz, boxMin, boxMax) - light.xyz;
+            if (dot(offset, offset) <= light.w * light.w && count < MAX_LIGHTS_PER_CLUSTER)
+            {
+                clusterLightIndices[firstSlot + count] = uint(batchStart + i);
+                count++;
+            }
+        }
+        barrier();
+    }
+
+    if (active)
+    {
+        clusterLightCounts[cluster] = count;
+    }
+}
@@ -0,0 +1,156 @@
+#version 460 core
+
+// frustum culls the static indirect draws and compacts the visible ones, see IndirectDrawList::Cull.
+// each pass keeps its own range of the output buffers, the per pass counters become the draw counts of
+// glMultiDrawElementsIndirectCount.
+//
+// with hi-z occlusion culling this runs twice a frame. the first phase outputs whatever was visible last frame,
+// those draws fill the depth buffer the hi-z pyramid is built from, and the second phase tests everything in the
+// frustum against the pyramid. draws that turn out visible but werent drawn in the first phase go into the second
+// phase's outputs, so newly disoccluded meshes show up in the same frame instead of popping in a frame late.
+// RENDER_PASS_COUNT is defined by the program (RenderPass::COUNT)
+layout (local_size_x = 64) in;
+
+#define CULL_FRUSTUM 0
+#define CULL_HIZ_FIRST_PHASE 1
+#define CULL_HIZ_SECOND_PHASE 2
+uniform int cullMode;
+
+#define COMPUTE_SHADER
+#include "transforms.glsl"
+
+struct DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance; // object index
+};
+
+struct CullInput
+{
+    vec4 boundingSphere; // model space center and radius
+    uint pass;
+    uint outputFirst; // first command of the pass in the output
+    uint materialID;
+    uint padding;
+};
+
+layout (std430, binding = 3) readonly buffer CullInputs
+{
+    CullInput cullInputs[];
+};
+layout (std430, binding = 4) readonly buffer InputCommands
+{
+    DrawCommand inputCommands[];
+};
+layout (std430, binding = 5) writeonly buffer OutputCommands
+{
+    DrawCommand outputCommands[];
+};
+layout (std430, binding = 6) writeonly buffer OutputMaterials
+{
+    uint outputMaterials[];
+};
+layout (std430, binding = 7) buffer DrawCounts
+{
+    uint drawCounts[]; // [phase * RENDER_PASS_COUNT + pass]
+};
+layout (std430, binding = 8) buffer DrawVisibility
+{
+    uint drawVisibility[]; // result of the last second phase, 1 if visible
+};
+
+uniform vec4 frustumPlanes[6];
+uniform int drawCount;
+
+// hi-z, second phase only
+uniform mat4 viewProjection;
+uniform sampler2D hiZ;
+uniform ivec2 hiZSize;
+uniform int hiZLevels;
+
+// tests the screen rect of the sphere's bounding box against the pyramid level where it covers at most 2x2 texels
+bool isOccluded(vec3 center, float radius)
+{
+    vec2 rectMin = vec2(1.0), rectMax = vec2(0.0);
+    float nearestDepth = 1.0;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        vec3 offset = vec3((corner & 1) != 0 ? radius : -radius, (corner & 2) != 0 ? radius : -radius, (corner & 4) != 0 ? radius : -radius);
+        vec4 clip = viewProjection * vec4(center + offset, 1.0);
+
+        // crosses the near plane
+        if (clip.w < 1e-4 || clip.z < -clip.w)
+            return false;
+
+        vec3 ndc = clip.xyz / clip.w;
+        rectMin = min(rectMin, ndc.xy * 0.5 + 0.5);
+        rectMax = max(rectMax, ndc.xy * 0.5 + 0.5);
+        nearestDepth = min(nearestDepth, ndc.z * 0.5 + 0.5);
+    }
+    rectMin = clamp(rectMin, 0.0, 1.0);
+    rectMax = clamp(rectMax, 0.0, 1.0);
+
+    vec2 rectSize = (rectMax - rectMin) * vec2(hiZSize);
+    int level = clamp(int(ceil(log2(max(max(rectSize.x, rectSize.y), 1.0)))), 0, hiZLevels - 1);
+
+    // in level 0 pixels first, then shifted down. odd sized levels fold their last row/column into the last texel
+    // (see hiz_compute.glsl), so scaling the rect by the floored level size would land on texels that are too low
+    ivec2 levelSize = max(hiZSize >> level, ivec2(1));
+    ivec2 pixelMin = clamp(ivec2(rectMin * vec2(hiZSize)), ivec2(0), hiZSize - 1);
+    ivec2 pixelMax = clamp(ivec2(rectMax * vec2(hiZSize)), ivec2(0), hiZSize - 1);
+    ivec2 texelMin = min(pixelMin >> level, levelSize - 1);
+    ivec2 texelMax = min(pixelMax >> level, levelSize - 1);
+
+    float farthest = max(max(texelFetch(hiZ, texelMin, level).r, texelFetch(hiZ, ivec2(texelMax.x, texelMin.y), level).r),
+                         max(texelFetch(hiZ, ivec2(texelMin.x, texelMax.y), level).r, texelFetch(hiZ, texelMax, level).r));
+    return nearestDepth > farthest;
+}
+
+void main()
+{
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= uint(drawCount))
+        return;
+
+    CullInput cullInput = cullInputs[index];
+    DrawCommand command = inputCommands[index];
+    mat4 model = objectTransforms[command.baseInstance].model;
+
+    // sphere to world space, scaled by the largest axis scale so non uniform scales stay conservative
+    vec3 center = vec3(model * vec4(cullInput.boundingSphere.xyz, 1.0));
+    float scale = sqrt(max(max(dot(model[0].xyz, model[0].xyz), dot(model[1].xyz, model[1].xyz)), dot(model[2].xyz, model[2].xyz)));
+    float radius = cullInput.boundingSphere.w * scale;
+
+    for (int i = 0; i < 6; i++)
+    {
+        if (dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w < -radius)
+        {
+            if (cullMode != CULL_HIZ_FIRST_PHASE)
+                drawVisibility[index] = 0;
+            return;
+        }
+    }
+
+    uint phase = 0;
+    if (cullMode == CULL_FRUSTUM)
+        drawVisibility[index] = 1; // so turning hi-z on starts from what frustum culling last drew
+    if (cullMode == CULL_HIZ_FIRST_PHASE && drawVisibility[index] == 0)
+        return;
+    if (cullMode == CULL_HIZ_SECOND_PHASE)
+    {
+        bool visible = !isOccluded(center, radius);
+        bool drawnInFirstPhase = drawVisibility[index] != 0;
+        drawVisibility[index] = visible ? 1 : 0;
+        if (!visible || drawnInFirstPhase)
+            return;
+        phase = 1;
+    }
+
+    // the second phase writes after the first phase's commands, they are still needed for this frame's draws
+    uint slot = phase * uint(drawCount) + cullInput.outputFirst + atomicAdd(drawCounts[phase * RENDER_PASS_COUNT + cullInput.pass], 1);
+    outputCommands[slot] = command;
+    outputMaterials[slot] = cullInput.materialID;
+}
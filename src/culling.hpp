@@ -0,0 +1,226 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include "frustum.hpp"
+#include "geometry.hpp"
+
+#include <xmmintrin.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+
+// world space bounds of everything that can be frustum culled, stored as structure of arrays so the plane tests
+// run on 8 objects per instruction with avx or 4 with sse.
+// each object is tested as both its box and its sphere, it is only culled if either is fully outside a plane
+class FrustumCuller
+{
+public:
+    struct BenchmarkResult
+    {
+        int objectCount = 0;
+        int visibleCount = 0;
+        float simdMs = 0.0f;
+        float scalarMs = 0.0f;
+    };
+
+    // returns the index to check IsVisible with
+    unsigned int Add(const Bounds& bounds, const glm::mat4& model)
+    {
+        unsigned int index = count++;
+
+        // arrays are padded to a full simd width so the loops never need a leftover case
+        size_t padded = (count + LANES - 1) / LANES * LANES;
+        for (auto* array : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ, &radius})
+        {
+            array->resize(padded, 0.0f);
+        }
+        visibility.resize(padded, 0);
+
+        Set(index, bounds, model);
+        return index;
+    }
+
+    // call when an object's transform changes
+    void Set(unsigned int index, const Bounds& bounds, const glm::mat4& model)
+    {
+        glm::vec3 center, worldExtents;
+        bounds.GetWorldBox(model, center, worldExtents);
+
+        float scale = std::sqrt(std::max(std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])), glm::dot(glm::vec3(model[1]), glm::vec3(model[1]))), glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))));
+
+        centerX[index] = center.x;
+        centerY[index] = center.y;
+        centerZ[index] = center.z;
+        extentX[index] = worldExtents.x;
+        extentY[index] = worldExtents.y;
+        extentZ[index] = worldExtents.z;
+        radius[index] = bounds.radius * scale;
+    }
+
+    // tests every object, returns how many are visible
+    int Cull(const Frustum& frustum)
+    {
+        int visibleCount = 0;
+
+#ifdef __AVX__
+        for (size_t i = 0; i < count; i += 8)
+        {
+            __m256 outside = _mm256_setzero_ps();
+            __m256 cx = _mm256_loadu_ps(&centerX[i]), cy = _mm256_loadu_ps(&centerY[i]), cz = _mm256_loadu_ps(&centerZ[i]);
+            __m256 ex = _mm256_loadu_ps(&extentX[i]), ey = _mm256_loadu_ps(&extentY[i]), ez = _mm256_loadu_ps(&extentZ[i]);
+            __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&radius[i]));
+
+            for (auto& plane : frustum.planes)
+            {
+                __m256 nx = _mm256_set1_ps(plane.x), ny = _mm256_set1_ps(plane.y), nz = _mm256_set1_ps(plane.z);
+                __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)), _mm256_add_ps(_mm256_mul_ps(nz, cz), _mm256_set1_ps(plane.w)));
+                // projected half size of the box onto the plane normal
+                __m256 boxRadius = _mm256_add_ps(_mm256_add_ps(
+                    _mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.x)), ex),
+                    _mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.y)), ey)),
+                    _mm256_mul_ps(_mm256_set1_ps(std::fabs(plane.z)), ez));
+
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, _mm256_sub_ps(_mm256_setzero_ps(), boxRadius), _CMP_LT_OQ));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, negRadius, _CMP_LT_OQ));
+            }
+
+            int mask = ~_mm256_movemask_ps(outside);
+            for (int lane = 0; lane < 8; lane++)
+            {
+                visibility[i + lane] = (mask >> lane) & 1;
+            }
+        }
+#else
+        for (size_t i = 0; i < count; i += 4)
+        {
+            __m128 outside = _mm_setzero_ps();
+            __m128 cx = _mm_loadu_ps(&centerX[i]), cy = _mm_loadu_ps(&centerY[i]), cz = _mm_loadu_ps(&centerZ[i]);
+            __m128 ex = _mm_loadu_ps(&extentX[i]), ey = _mm_loadu_ps(&extentY[i]), ez = _mm_loadu_ps(&extentZ[i]);
+            __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[i]));
+
+            for (auto& plane : frustum.planes)
+            {
+                __m128 nx = _mm_set1_ps(plane.x), ny = _mm_set1_ps(plane.y), nz = _mm_set1_ps(plane.z);
+                __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w)));
+                // projected half size of the box onto the plane normal
+                __m128 boxRadius = _mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(_mm_set1_ps(std::fabs(plane.x)), ex),
+                    _mm_mul_ps(_mm_set1_ps(std::fabs(plane.y)), ey)),
+                    _mm_mul_ps(_mm_set1_ps(std::fabs(plane.z)), ez));
+
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_sub_ps(_mm_setzero_ps(), boxRadius)));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negRadius));
+            }
+
+            int mask = ~_mm_movemask_ps(outside);
+            for (int lane = 0; lane < 4; lane++)
+            {
+                visibility[i + lane] = (mask >> lane) & 1;
+            }
+        }
+#endif
+
+        for (size_t i = 0; i < count; i++)
+        {
+            visibleCount += visibility[i];
+        }
+        return visibleCount;
+    }
+
+    // same tests one object at a time, only used to compare against in the benchmark
+    int CullScalar(const Frustum& frustum)
+    {
+        int visibleCount = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            bool outside = false;
+            for (auto& plane : frustum.planes)
+            {
+                float distance = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w;
+                float boxRadius = std::fabs(plane.x) * extentX[i] + std::fabs(plane.y) * extentY[i] + std::fabs(plane.z) * extentZ[i];
+                if (distance < -boxRadius || distance < -radius[i])
+                {
+                    outside = true;
+                    break;
+                }
+            }
+            visibility[i] = !outside;
+            visibleCount += !outside;
+        }
+        return visibleCount;
+    }
+
+    // result of the last Cull
+    bool IsVisible(unsigned int index) const
+    {
+        return visibility[index];
+    }
+
+    size_t GetCount() const
+    {
+        return count;
+    }
+
+    // culls objectCount random boxes scattered around the origin with both versions and prints the averages
+    static BenchmarkResult RunBenchmark(const Frustum& frustum, int objectCount = 100000, int iterations = 20)
+    {
+        FrustumCuller culler;
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+        std::uniform_real_distribution<float> size(0.1f, 2.0f);
+        for (int i = 0; i < objectCount; i++)
+        {
+            Bounds bounds;
+            bounds.min = glm::vec3(position(random), position(random), position(random));
+            bounds.max = bounds.min + glm::vec3(size(random), size(random), size(random));
+            bounds.radius = glm::length(bounds.max - bounds.min) * 0.5f;
+            culler.Add(bounds, glm::mat4(1.0f));
+        }
+
+        BenchmarkResult result;
+        result.objectCount = objectCount;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            result.visibleCount = culler.Cull(frustum);
+        }
+        result.simdMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            culler.CullScalar(frustum);
+        }
+        result.scalarMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+        std::cout << "(Culling): " << objectCount << " objects, " << LANES << " wide: " << result.simdMs << " ms, scalar: " << result.scalarMs
+            << " ms, " << result.visibleCount << " visible" << std::endl;
+        return result;
+    }
+
+private:
+#ifdef __AVX__
+    static const int LANES = 8;
+#else
+    static const int LANES = 4;
+#endif
+
+    size_t count = 0;
+
+    // world space box center/half extents and sphere radius, the sphere shares the box's center
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+    std::vector<float> radius;
+
+    std::vector<uint8_t> visibility;
+};
@@ -0,0 +1,45 @@
+#version 460 core
+
+// lights the g-buffer written by the DEFERRED variant of fragment.glsl, one fullscreen pass for every light type.
+// depth is written back out so the blended pass and the light cubes still depth test against the scene
+out vec4 FragColor;
+
+#include "shading.glsl"
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gSpecular;
+uniform sampler2D gEmission;
+uniform sampler2D gDepth;
+
+uniform mat4 inverseViewProjection;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, texel, 0).r;
+    if (depth == 1.0)
+    {
+        discard; // nothing was drawn here, keep the clear color
+    }
+    gl_FragDepth = depth;
+
+    // world position back from the depth
+    vec2 uv = (gl_FragCoord.xy - viewport.xy) / viewport.zw;
+    vec4 world = inverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec3 fragPos = world.xyz / world.w;
+
+    vec4 specular = texelFetch(gSpecular, texel, 0);
+
+    Surface surface;
+    surface.diffuse = texelFetch(gAlbedo, texel, 0).rgb;
+    surface.specular = specular.rgb;
+    surface.emission = texelFetch(gEmission, texel, 0).rgb;
+    surface.shininess = specular.a * 256.0;
+    surface.alpha = 1.0;
+    surface.ambient = 1.0;
+
+    vec3 norm = normalize(texelFetch(gNormal, texel, 0).xyz);
+
+    FragColor = vec4(shadeSurface(surface, norm, fragPos, gl_FragCoord.xy), 1.0);
+}
@@ -0,0 +1,6 @@
+#version 460 core
+
+// depth only, nothing to write
+void main()
+{
+}
\ No newline at end of file
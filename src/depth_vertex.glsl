@@ -0,0 +1,17 @@
+#version 460 core
+
+// position only version of vertex.glsl for the depth pre-pass.
+// gl_Position is invariant and computed exactly like vertex.glsl so the lit pass can depth test with GL_EQUAL
+layout (location = 0) in vec3 inPos;
+
+invariant gl_Position;
+
+#include "transforms.glsl"
+#include "frame.glsl"
+
+void main()
+{
+    ObjectTransform object = getObjectTransform();
+
+    gl_Position = projection * view * object.model * vec4(inPos, 1.0);
+}
\ No newline at end of file
@@ -1,6 +1,22 @@
 #version 460 core
 
+// ALPHA_TEST is defined for the cutout/blended variant (see AlphaMode in textures.hpp).
+// without it nothing discards, so early depth testing can be forced for opaque meshes.
+// DEFERRED writes the surface into the g-buffer instead of lighting it (see GBuffer in gbuffer.hpp)
+// LIGHTMAP takes the light from lightmap_baker's bake instead of looping over the lights, forward only
+// BAKED takes it from the mesh's imported vertex colors the same way, forward only
+#ifndef ALPHA_TEST
+layout(early_fragment_tests) in;
+#endif
+
+#ifdef DEFERRED
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec4 gNormal;
+layout (location = 2) out vec4 gSpecular; // shininess / 256 in alpha
+layout (location = 3) out vec3 gEmission;
+#else
 out vec4 FragColor;
+#endif
 
 in vec3 fragPos;
 in vec3 normal;
@@ -13,215 +29,106 @@ uniform ivec2 subTexRes[100]; // size should be same as tex array
 
 in vec2 texCoord;
 
-struct Material
-{
-    int diffuseLayerCount;
-    int diffuseStartLayer;
-    int specularLayerCount;
-    int specularStartLayer;
-    int emissionLayerCount;
-    int emissionStartLayer;
-
-    float emissionStrength;
-    float shininess;
-};
-uniform Material material;
+#ifdef LIGHTMAP
+in vec3 lightmapCoord;
+layout(binding = 10) uniform sampler2DArray lightmap; // Lightmaps::TEXTURE_UNIT
+#endif
 
+#ifdef BAKED
+in vec3 vertexColor;
+#endif
 
-struct DirLight
-{
-    vec3 direction;
-  
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-uniform DirLight dirLight;
-
-struct PointLight 
-{    
-    vec3 position;
-    
-    float constant;
-    float linear;
-    float quadratic;  
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-#define NUM_POINT_LIGHTS 1  
-uniform PointLight pointLights[NUM_POINT_LIGHTS];
-
-struct SpotLight
-{
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
+#include "materials.glsl"
 
-    float constant;
-    float linear;
-    float quadratic;
+#ifdef MULTI_DRAW
+flat in uint materialIndex;
+#endif
 
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-uniform SpotLight spotLight;
+Material getMaterial()
+{
+#ifdef MULTI_DRAW
+    return materials[materialIndex];
+#else
+    return material;
+#endif
+}
 
-uniform vec3 viewPos;
 
+#include "shading.glsl"
 
-vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
 vec4 sampleTexArraySubtex(int layer)
 {
     vec2 scale = vec2(subTexRes[layer]) / vec2(4096, 4096); // denominator is the max res of the texture array
     vec2 adjustedTexCoord = texCoord * scale;
     vec4 textureColor = texture(texArray, vec3(adjustedTexCoord, float(layer)));
+#ifdef ALPHA_TEST
     if(textureColor.a < 0.5)
     {
         discard;
     }
+#endif
     return textureColor;
 }
 
-vec3 calcAmbient(vec3 lightAmbient);
-vec3 calcDiffuse(vec3 lightDiffuse, float diffuseAmount);
-vec3 calcSpecular(vec3 lightSpecular, float specularAmount);
-
-
-void main()
+Surface sampleSurface()
 {
-    vec3 norm = normalize(normal);
-    vec3 viewDir = normalize(viewPos - fragPos);
+    Material mat = getMaterial();
 
-    // directional lights
-    vec3 result = calcDirLight(dirLight, norm, viewDir);
+    Surface surface;
+    surface.diffuse = vec3(0.0);
+    surface.specular = vec3(0.0);
+    surface.emission = vec3(0.0);
+    surface.shininess = mat.shininess;
+    surface.alpha = 1.0;
+    surface.ambient = 1.0;
 
-    // point lights
-    for (int i = 0; i < NUM_POINT_LIGHTS; i++)
+    for (int i = 0; i < mat.diffuseLayerCount; i++)
     {
-        result += calcPointLight(pointLights[i], norm, fragPos, viewDir);
+        vec4 diffuseColor = sampleTexArraySubtex(mat.diffuseStartLayer + i);
+        surface.diffuse += diffuseColor.rgb;
+        if (i == 0)
+        {
+            surface.alpha = diffuseColor.a;
+        }
     }
-
-    result += calcSpotLight(spotLight, norm, fragPos, viewDir);
-
-    // emission
-    vec3 emission = vec3(0.0);
-    for (int i = 0; i < material.emissionLayerCount; i++)
+    for (int i = 0; i < mat.specularLayerCount; i++)
     {
-        // emission += material.emissionStrength * vec3(texture(texArray, vec3(texCoord, float(material.emissionStartLayer + i))));
-        emission += material.emissionStrength * sampleTexArraySubtex(material.emissionStartLayer + i).rgb;
+        surface.specular += sampleTexArraySubtex(mat.specularStartLayer + i).rgb;
     }
-    result += emission;
-
-    FragColor = vec4(result, 1.0);
-}
-
-
-vec3 calcAmbient(vec3 lightAmbient)
-{
-    vec3 ambient = vec3(0.0);
-    for (int i = 0; i < material.diffuseLayerCount; i++)
+    for (int i = 0; i < mat.emissionLayerCount; i++)
     {
-        // ambient += lightAmbient * vec3(texture(texArray, vec3(texCoord, float(material.diffuseStartLayer + i))));
-        ambient += lightAmbient * sampleTexArraySubtex(material.diffuseStartLayer + i).rgb;
+        surface.emission += mat.emissionStrength * sampleTexArraySubtex(mat.emissionStartLayer + i).rgb;
     }
 
-    return ambient;
+    return surface;
 }
-vec3 calcDiffuse(vec3 lightDiffuse, float diffuseAmount)
-{
-    vec3 diffuse = vec3(0.0);
-    for (int i = 0; i < material.diffuseLayerCount; i++)
-    {
-        // diffuse += lightDiffuse * diffuseAmount * vec3(texture(texArray, vec3(texCoord, float(material.diffuseStartLayer + i))));
-        diffuse += lightDiffuse * diffuseAmount * sampleTexArraySubtex(material.diffuseStartLayer + i).rgb;
-    }
 
-    return diffuse;
-}
-vec3 calcSpecular(vec3 lightSpecular, float specularAmount)
+
+void main()
 {
-    vec3 specular = vec3(0.0);
-    for (int i = 0; i < material.specularLayerCount; i++)
-    {
-        // specular += lightSpecular * specularAmount * vec3(texture(texArray, vec3(texCoord, float(material.specularStartLayer + i))));
-        specular += lightSpecular * specularAmount * sampleTexArraySubtex(material.specularStartLayer + i).rgb;
-    }
+    vec3 norm = normalize(normal);
 
-    return specular;
-}
+    Surface surface = sampleSurface();
 
+#ifdef DEFERRED
+    gAlbedo = vec4(surface.diffuse, 1.0);
+    gNormal = vec4(norm, 0.0);
+    gSpecular = vec4(surface.specular, surface.shininess / 256.0);
+    gEmission = surface.emission;
+#elif defined(LIGHTMAP)
+    // the bake has direct and bounced diffuse light, specular isnt baked
+    vec3 result = surface.diffuse * texture(lightmap, lightmapCoord).rgb + surface.emission;
 
-vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir)
-{
-    vec3 lightDir = normalize(-light.direction);
-    // diffuse
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    // combine diffuse specular and ambient
-    vec3 result = calcAmbient(light.ambient) + calcDiffuse(light.diffuse, diff) + calcSpecular(light.specular, spec);
-    return result;
-}
+    FragColor = vec4(result, surface.alpha);
+#elif defined(BAKED)
+    // the colors already have all the light, no light loops, shadows or probes
+    vec3 result = surface.diffuse * vertexColor + surface.emission;
 
-vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-    // diffuse
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
-    // combine diffuse specular and ambient
-    vec3 ambient = calcAmbient(light.ambient);
-    vec3 diffuse = calcDiffuse(light.diffuse, diff);
-    vec3 specular = calcSpecular(light.specular, spec);
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-
-    return (ambient + diffuse + specular);
-}
+    FragColor = vec4(result, surface.alpha);
+#else
+    vec3 result = shadeSurface(surface, norm, fragPos, gl_FragCoord.xy);
 
-vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
-{
-    vec3 lightDir = normalize(light.position - fragPos);
-
-
-    // angle between where the spotlight is pointing and the fragment
-    float theta = dot(lightDir, normalize(-light.direction));
-    // values for smooth cutoff at the edges
-    float epsilon = light.cutOff - light.outerCutOff;
-    float intensity = smoothstep(0.0, 1.0, (theta - light.outerCutOff) / epsilon);
-
-    // diffuse
-    float diff = max(dot(normal, lightDir), 0.0);
-    // specular
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-
-    vec3 ambient = calcAmbient(light.ambient);
-    vec3 diffuse = calcDiffuse(light.diffuse, diff);
-    vec3 specular = calcSpecular(light.specular, spec);
-    diffuse *= intensity;
-    specular *= intensity;
-
-    // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
-    ambient *= attenuation;
-    diffuse *= attenuation;
-    specular *= attenuation;
-
-    return (ambient + diffuse + specular);  
+    FragColor = vec4(result, surface.alpha); // alpha only matters for the blended bucket
+#endif
 }
\ No newline at end of file
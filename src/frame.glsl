@@ -0,0 +1,12 @@
+#pragma once
+
+// camera data shared by every shader, written once per frame into the DynamicRingBuffer (see FrameData in main.cpp)
+layout (std140, binding = 0) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    float nearPlane;
+    vec4 viewport; // x, y, width, height in pixels
+    float farPlane;
+};
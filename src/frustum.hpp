@@ -0,0 +1,44 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+
+// the 6 planes (left, right, bottom, top, near, far) of a view projection matrix as (normal, distance),
+// normals point inwards and are normalized so distances to them are in world units.
+// a point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    // gribb/hartmann, each plane is a sum or difference of the 4th row and one of the other rows
+    explicit Frustum(const glm::mat4& viewProjection)
+    {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+        {
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        }
+
+        planes[0] = rows[3] + rows[0];
+        planes[1] = rows[3] - rows[0];
+        planes[2] = rows[3] + rows[1];
+        planes[3] = rows[3] - rows[1];
+        planes[4] = rows[3] + rows[2];
+        planes[5] = rows[3] - rows[2];
+
+        for (auto& plane : planes)
+        {
+            plane /= glm::length(glm::vec3(plane));
+        }
+    }
+
+    bool IntersectsSphere(const glm::vec3& center, float radius) const
+    {
+        for (auto& plane : planes)
+        {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        }
+        return true;
+    }
+};
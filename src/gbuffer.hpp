@@ -0,0 +1,106 @@
+#pragma once
+
+#include "../lib/glad.h"
+
+#include "shader.hpp"
+#include "gl_state.hpp"
+
+#include <iostream>
+
+
+// render targets of the deferred path. the DEFERRED variant of fragment.glsl writes the surface of every
+// opaque/cutout fragment in here and deferred_lighting.glsl lights it in one fullscreen pass.
+// it covers the default framebuffer up to the end of the viewport, so gl_FragCoord addresses both the same way
+class GBuffer
+{
+public:
+    static const GLuint FIRST_TEXTURE_UNIT = 3; // tex array, hi-z and the hi-z depth copy use the ones before
+
+    // binds the g-buffer for drawing (and reading, hi-z copies its depth from here) and clears it
+    void Begin()
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        Resize(viewport[0] + viewport[2], viewport[1] + viewport[3]);
+
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    void End()
+    {
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // binds every target for sampling and points the lighting shader's samplers at them
+    void BindTextures(Shader& lightingShader)
+    {
+        const char* names[] = {"gAlbedo", "gNormal", "gSpecular", "gEmission", "gDepth"};
+        GLuint textures[] = {albedo, normal, specular, emission, depth};
+        for (int i = 0; i < 5; i++)
+        {
+            GLState::Get().BindTexture(FIRST_TEXTURE_UNIT + i, GL_TEXTURE_2D, textures[i]);
+            lightingShader.setInt(names[i], FIRST_TEXTURE_UNIT + i);
+        }
+    }
+
+    // ssao reads the depth straight from here
+    GLuint GetDepthTexture() const
+    {
+        return depth;
+    }
+
+private:
+    GLuint framebuffer = 0;
+    GLuint albedo = 0, normal = 0, specular = 0, emission = 0, depth = 0;
+    int width = 0, height = 0;
+
+    void Resize(int _width, int _height)
+    {
+        if (_width == width && _height == height)
+            return;
+
+        width = _width;
+        height = _height;
+
+        // immutable storage cant be resized, so everything is recreated
+        if (framebuffer != 0)
+        {
+            GLuint textures[] = {albedo, normal, specular, emission, depth};
+            glDeleteTextures(5, textures);
+            glDeleteFramebuffers(1, &framebuffer);
+            GLState::Get().Invalidate();
+        }
+
+        glGenFramebuffers(1, &framebuffer);
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+        albedo = CreateTarget(GL_RGBA8, GL_COLOR_ATTACHMENT0);
+        normal = CreateTarget(GL_RGBA16F, GL_COLOR_ATTACHMENT1);
+        specular = CreateTarget(GL_RGBA8, GL_COLOR_ATTACHMENT2);
+        emission = CreateTarget(GL_R11F_G11F_B10F, GL_COLOR_ATTACHMENT3);
+        depth = CreateTarget(GL_DEPTH_COMPONENT32F, GL_DEPTH_ATTACHMENT);
+
+        GLenum drawBuffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3};
+        glDrawBuffers(4, drawBuffers);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "(GBuffer): Error: framebuffer is not complete" << std::endl;
+        }
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    GLuint CreateTarget(GLenum format, GLenum attachment)
+    {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+        return texture;
+    }
+};
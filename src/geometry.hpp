@@ -0,0 +1,165 @@
+#pragma once
+
+#include "../lib/glad.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/type_precision.hpp"
+
+#include "gl_state.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <vector>
+
+
+struct Vertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texCoords;
+    glm::vec3 lightmapCoord = glm::vec3(0.0f); // uv in xy, lightmap page in z, only set for baked meshes
+    glm::u8vec4 color = glm::u8vec4(255); // imported vertex color (baked lighting), white for everything else
+};
+
+// model space bounding box and a bounding sphere around the box's center, computed once at import
+struct Bounds
+{
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    glm::vec3 GetCenter() const
+    {
+        return (min + max) * 0.5f;
+    }
+
+    // the world box that contains the transformed box, each extent is the abs of the matrix times the local extents
+    void GetWorldBox(const glm::mat4& model, glm::vec3& center, glm::vec3& extents) const
+    {
+        center = glm::vec3(model * glm::vec4(GetCenter(), 1.0f));
+        glm::vec3 localExtents = (max - min) * 0.5f;
+        extents = glm::abs(glm::vec3(model[0])) * localExtents.x + glm::abs(glm::vec3(model[1])) * localExtents.y + glm::abs(glm::vec3(model[2])) * localExtents.z;
+    }
+
+    static Bounds FromVertices(const std::vector<Vertex>& vertices)
+    {
+        Bounds bounds;
+        if (vertices.empty())
+            return bounds;
+
+        bounds.min = glm::vec3(FLT_MAX);
+        bounds.max = glm::vec3(-FLT_MAX);
+        for (auto& vertex : vertices)
+        {
+            bounds.min = glm::min(bounds.min, vertex.position);
+            bounds.max = glm::max(bounds.max, vertex.position);
+        }
+
+        // tighter than half the box diagonal for most meshes
+        glm::vec3 center = bounds.GetCenter();
+        for (auto& vertex : vertices)
+        {
+            bounds.radius = std::max(bounds.radius, glm::length(vertex.position - center));
+        }
+        return bounds;
+    }
+};
+
+// where a mesh lives inside the GeometryBuffer, in elements not bytes
+struct GeometryRange
+{
+    unsigned int firstIndex = 0;
+    unsigned int indexCount = 0;
+    int baseVertex = 0;
+};
+
+
+// singleton
+// every static mesh is appended to one vertex and one index buffer behind a single vao,
+// so any number of meshes can be drawn without rebinding and multi draw indirect can reach all of them
+class GeometryBuffer
+{
+public:
+    static GeometryBuffer& Get()
+    {
+        static GeometryBuffer instance;
+        return instance;
+    }
+
+    // indices stay relative to the mesh, draws add baseVertex
+    GeometryRange Add(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices)
+    {
+        GeometryRange range;
+        range.firstIndex = indices.size();
+        range.indexCount = _indices.size();
+        range.baseVertex = vertices.size();
+
+        vertices.insert(vertices.end(), _vertices.begin(), _vertices.end());
+        indices.insert(indices.end(), _indices.begin(), _indices.end());
+        dirty = true;
+
+        return range;
+    }
+
+    // (re)uploads everything that has been added, call once loading is done
+    void Upload()
+    {
+        if (VAO == 0)
+        {
+            glGenVertexArrays(1, &VAO);
+            glGenBuffers(1, &VBO);
+            glGenBuffers(1, &EBO);
+
+            GLState::Get().BindVertexArray(VAO);
+            GLState::Get().BindBuffer(GL_ARRAY_BUFFER, VBO);
+            GLState::Get().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+            // vertex position attribute
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+            // vertex normal attribute
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+            // vertex texure coord attributre
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
+            // lightmap coord attribute
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, lightmapCoord));
+            // vertex color attribute, normalized bytes so it only costs 4 bytes a vertex
+            glEnableVertexAttribArray(4);
+            glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+
+            GLState::Get().BindVertexArray(0);
+        }
+
+        if (!dirty)
+            return;
+
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // the element buffer binding is vao state
+        GLState::Get().BindVertexArray(VAO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        GLState::Get().BindVertexArray(0);
+
+        dirty = false;
+    }
+
+    GLuint GetVAO() const
+    {
+        return VAO;
+    }
+
+private:
+    // private constructor so other instances cant be made
+    GeometryBuffer() : VAO(0), VBO(0), EBO(0), dirty(false) {}
+
+    unsigned int VAO, VBO, EBO;
+    bool dirty;
+
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+};
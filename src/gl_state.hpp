@@ -0,0 +1,320 @@
+#pragma once
+
+#include "../lib/glad.h"
+
+
+// singleton
+// shadow copy of the gl state the engine changes, so binding something that is already bound never reaches the driver.
+// everything that binds programs, vaos, buffers, framebuffers or textures or touches depth/cull/blend/polygon state has to go
+// through here or the copy goes stale. targets it doesnt know about are passed straight through.
+// imgui's opengl backend restores whatever it changes, so it doesnt need to
+class GLState
+{
+public:
+    static GLState& Get()
+    {
+        static GLState instance;
+        return instance;
+    }
+
+    struct Stats
+    {
+        int issued = 0;
+        int skipped = 0;
+    };
+
+    // call once at the start of every frame, the counts of the frame before are kept for GetStats
+    void BeginFrame()
+    {
+        lastStats = stats;
+        stats = Stats();
+    }
+
+    const Stats& GetStats() const
+    {
+        return lastStats;
+    }
+
+    // forget everything, for when objects get deleted (a new one can reuse the name) or gl is changed behind our back
+    void Invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (auto& buffer : buffers) buffer = UNKNOWN;
+        for (auto& target : indexedBuffers)
+        {
+            for (auto& buffer : target) buffer = UNKNOWN;
+        }
+        for (auto& unit : textures)
+        {
+            for (auto& texture : unit) texture = UNKNOWN;
+        }
+        for (auto& capability : capabilities) capability = UNKNOWN;
+        depthFunc = UNKNOWN;
+        depthMask = UNKNOWN;
+        colorMask = UNKNOWN;
+        blendSrc = UNKNOWN;
+        blendDst = UNKNOWN;
+        cullFace = UNKNOWN;
+        polygonMode = UNKNOWN;
+        drawFramebuffer = UNKNOWN;
+        readFramebuffer = UNKNOWN;
+    }
+
+    void UseProgram(GLuint id)
+    {
+        if (Changed(program, id))
+            glUseProgram(id);
+    }
+
+    void BindVertexArray(GLuint id)
+    {
+        if (Changed(vertexArray, id))
+            glBindVertexArray(id);
+    }
+
+    // GL_ELEMENT_ARRAY_BUFFER is vao state, so it is never cached
+    void BindBuffer(GLenum target, GLuint id)
+    {
+        int index = BufferTargetIndex(target);
+        if (index < 0)
+        {
+            stats.issued++;
+            glBindBuffer(target, id);
+            return;
+        }
+        if (Changed(buffers[index], id))
+            glBindBuffer(target, id);
+    }
+
+    // also binds the generic target like gl does
+    void BindBufferBase(GLenum target, GLuint bindingIndex, GLuint id)
+    {
+        int index = IndexedTargetIndex(target);
+        if (index < 0 || bindingIndex >= MAX_INDEXED_BINDINGS)
+        {
+            stats.issued++;
+            glBindBufferBase(target, bindingIndex, id);
+            int generic = BufferTargetIndex(target);
+            if (generic >= 0)
+                buffers[generic] = id;
+            return;
+        }
+        if (Changed(indexedBuffers[index][bindingIndex], id))
+        {
+            glBindBufferBase(target, bindingIndex, id);
+            buffers[BufferTargetIndex(target)] = id;
+        }
+    }
+
+    // ranges of the same buffer are too many to track, always issued
+    void BindBufferRange(GLenum target, GLuint bindingIndex, GLuint id, GLintptr offset, GLsizeiptr size)
+    {
+        stats.issued++;
+        glBindBufferRange(target, bindingIndex, id, offset, size);
+
+        int index = IndexedTargetIndex(target);
+        if (index >= 0 && bindingIndex < MAX_INDEXED_BINDINGS)
+            indexedBuffers[index][bindingIndex] = UNKNOWN; // a later BindBufferBase of the same buffer has to go through
+        int generic = BufferTargetIndex(target);
+        if (generic >= 0)
+            buffers[generic] = id;
+    }
+
+    // GL_FRAMEBUFFER binds both the draw and the read framebuffer
+    void BindFramebuffer(GLenum target, GLuint id)
+    {
+        bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+        bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+        if ((!draw || drawFramebuffer == id) && (!read || readFramebuffer == id))
+        {
+            stats.skipped++;
+            return;
+        }
+        if (draw)
+            drawFramebuffer = id;
+        if (read)
+            readFramebuffer = id;
+        stats.issued++;
+        glBindFramebuffer(target, id);
+    }
+
+    // only switches the active unit when the binding actually changes
+    void BindTexture(GLuint unit, GLenum target, GLuint id)
+    {
+        int index = TextureTargetIndex(target);
+        if (index >= 0 && unit < MAX_TEXTURE_UNITS && textures[unit][index] == id)
+        {
+            stats.skipped++;
+            return;
+        }
+
+        ActiveTexture(unit);
+        stats.issued++;
+        glBindTexture(target, id);
+        if (index >= 0 && unit < MAX_TEXTURE_UNITS)
+            textures[unit][index] = id;
+    }
+
+    // for texture calls that work on whatever is bound to the active unit (glTexParameter etc.)
+    void ActiveTexture(GLuint unit)
+    {
+        if (Changed(activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    void SetEnabled(GLenum capability, bool enabled)
+    {
+        int index = CapabilityIndex(capability);
+        if (index >= 0 && !Changed(capabilities[index], enabled))
+            return;
+        if (index < 0)
+            stats.issued++;
+
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+
+    void DepthFunc(GLenum func)
+    {
+        if (Changed(depthFunc, func))
+            glDepthFunc(func);
+    }
+
+    void DepthMask(bool enabled)
+    {
+        if (Changed(depthMask, enabled))
+            glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+    }
+
+    // all four channels at once, nothing here masks single channels
+    void ColorMask(bool enabled)
+    {
+        GLboolean value = enabled ? GL_TRUE : GL_FALSE;
+        if (Changed(colorMask, enabled))
+            glColorMask(value, value, value, value);
+    }
+
+    void BlendFunc(GLenum src, GLenum dst)
+    {
+        if (blendSrc == src && blendDst == dst)
+        {
+            stats.skipped++;
+            return;
+        }
+        blendSrc = src;
+        blendDst = dst;
+        stats.issued++;
+        glBlendFunc(src, dst);
+    }
+
+    void CullFace(GLenum face)
+    {
+        if (Changed(cullFace, face))
+            glCullFace(face);
+    }
+
+    // front and back always share a mode
+    void PolygonMode(GLenum mode)
+    {
+        if (Changed(polygonMode, mode))
+            glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+
+private:
+    // private constructor so other instances cant be made
+    GLState()
+    {
+        Invalidate();
+    }
+
+    static const GLuint UNKNOWN = 0xFFFFFFFF;
+    static const int BUFFER_TARGET_COUNT = 7;
+    static const int INDEXED_TARGET_COUNT = 2;
+    static const GLuint MAX_INDEXED_BINDINGS = 16;
+    static const int TEXTURE_TARGET_COUNT = 4;
+    static const GLuint MAX_TEXTURE_UNITS = 16;
+    static const int CAPABILITY_COUNT = 3;
+
+    GLuint program;
+    GLuint vertexArray;
+    GLuint activeUnit;
+    GLuint buffers[BUFFER_TARGET_COUNT];
+    GLuint indexedBuffers[INDEXED_TARGET_COUNT][MAX_INDEXED_BINDINGS];
+    GLuint textures[MAX_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+    GLuint capabilities[CAPABILITY_COUNT];
+    GLuint depthFunc;
+    GLuint depthMask;
+    GLuint colorMask;
+    GLuint blendSrc, blendDst;
+    GLuint cullFace;
+    GLuint polygonMode;
+    GLuint drawFramebuffer, readFramebuffer;
+
+    Stats stats;
+    Stats lastStats;
+
+    // updates the cached value, returns whether the call has to be made
+    bool Changed(GLuint& cached, GLuint value)
+    {
+        if (cached == value)
+        {
+            stats.skipped++;
+            return false;
+        }
+        cached = value;
+        stats.issued++;
+        return true;
+    }
+
+    static int BufferTargetIndex(GLenum target)
+    {
+        switch (target)
+        {
+            case GL_ARRAY_BUFFER: return 0;
+            case GL_SHADER_STORAGE_BUFFER: return 1;
+            case GL_UNIFORM_BUFFER: return 2;
+            case GL_DRAW_INDIRECT_BUFFER: return 3;
+            case GL_PARAMETER_BUFFER: return 4;
+            case GL_COPY_READ_BUFFER: return 5;
+            case GL_COPY_WRITE_BUFFER: return 6;
+            default: return -1;
+        }
+    }
+
+    static int IndexedTargetIndex(GLenum target)
+    {
+        switch (target)
+        {
+            case GL_SHADER_STORAGE_BUFFER: return 0;
+            case GL_UNIFORM_BUFFER: return 1;
+            default: return -1;
+        }
+    }
+
+    static int TextureTargetIndex(GLenum target)
+    {
+        switch (target)
+        {
+            case GL_TEXTURE_2D: return 0;
+            case GL_TEXTURE_2D_ARRAY: return 1;
+            case GL_TEXTURE_3D: return 2;
+            case GL_TEXTURE_CUBE_MAP: return 3;
+            default: return -1;
+        }
+    }
+
+    static int CapabilityIndex(GLenum capability)
+    {
+        switch (capability)
+        {
+            case GL_DEPTH_TEST: return 0;
+            case GL_CULL_FACE: return 1;
+            case GL_BLEND: return 2;
+            default: return -1;
+        }
+    }
+};
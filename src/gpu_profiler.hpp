@@ -0,0 +1,221 @@
+#pragma once
+
+#include "../lib/glad.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <iostream>
+
+
+// singleton
+// times named sections of the frame on the gpu with GL_TIMESTAMP query pairs (so sections can nest).
+// results are read back a few frames later so querying them never stalls the cpu
+class GpuProfiler
+{
+public:
+    static GpuProfiler& Get()
+    {
+        static GpuProfiler instance;
+        return instance;
+    }
+
+    static const int FRAMES_IN_FLIGHT = 4;
+
+    struct Scope
+    {
+        std::string name;
+        GLuint queries[2 * FRAMES_IN_FLIGHT]; // start/end timestamp per frame
+        bool issued[FRAMES_IN_FLIGHT] = {};
+
+        float ms = 0.0f; // last result
+        float avgMs = 0.0f; // smoothed over time, easier to read in the info panel
+
+        // benchmark capture
+        double captureTotalMs = 0.0;
+        int captureSamples = 0;
+    };
+
+    // GL_SAMPLES_PASSED query, counts fragments that passed the depth test between BeginSamples/EndSamples.
+    // only one can be active at a time
+    struct Counter
+    {
+        std::string name;
+        GLuint queries[FRAMES_IN_FLIGHT];
+        bool issued[FRAMES_IN_FLIGHT] = {};
+
+        GLuint64 samples = 0; // last result
+    };
+
+    // call once at the start of every frame before any Begin/End
+    void BeginFrame()
+    {
+        frameIndex = (frameIndex + 1) % FRAMES_IN_FLIGHT;
+
+        // the slot we are about to reuse was written FRAMES_IN_FLIGHT frames ago, its results should be ready by now
+        for (auto& scope : scopes)
+        {
+            if (!scope.issued[frameIndex])
+                continue;
+
+            GLuint startQuery = scope.queries[2 * frameIndex];
+            GLuint endQuery = scope.queries[2 * frameIndex + 1];
+
+            GLint available = 0;
+            glGetQueryObjectiv(endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+            scope.issued[frameIndex] = false;
+            if (!available)
+                continue; // skip the sample rather than wait for it
+
+            GLuint64 startTime, endTime;
+            glGetQueryObjectui64v(startQuery, GL_QUERY_RESULT, &startTime);
+            glGetQueryObjectui64v(endQuery, GL_QUERY_RESULT, &endTime);
+
+            scope.ms = (endTime - startTime) / 1000000.0f;
+            scope.avgMs = scope.avgMs == 0.0f ? scope.ms : scope.avgMs * 0.95f + scope.ms * 0.05f;
+
+            if (captureFramesLeft > 0)
+            {
+                scope.captureTotalMs += scope.ms;
+                scope.captureSamples++;
+            }
+        }
+
+        for (auto& counter : counters)
+        {
+            if (!counter.issued[frameIndex])
+                continue;
+
+            GLint available = 0;
+            glGetQueryObjectiv(counter.queries[frameIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+            counter.issued[frameIndex] = false;
+            if (available)
+            {
+                glGetQueryObjectui64v(counter.queries[frameIndex], GL_QUERY_RESULT, &counter.samples);
+            }
+        }
+
+        if (captureFramesLeft > 0)
+        {
+            captureFramesLeft--;
+            if (captureFramesLeft == 0)
+            {
+                PrintCapture();
+            }
+        }
+    }
+
+    void Begin(const std::string& name)
+    {
+        Scope& scope = GetScope(name);
+        glQueryCounter(scope.queries[2 * frameIndex], GL_TIMESTAMP);
+    }
+
+    void End(const std::string& name)
+    {
+        Scope& scope = GetScope(name);
+        glQueryCounter(scope.queries[2 * frameIndex + 1], GL_TIMESTAMP);
+        scope.issued[frameIndex] = true;
+    }
+
+    void BeginSamples(const std::string& name)
+    {
+        Counter& counter = GetCounter(name);
+        glBeginQuery(GL_SAMPLES_PASSED, counter.queries[frameIndex]);
+    }
+
+    void EndSamples(const std::string& name)
+    {
+        Counter& counter = GetCounter(name);
+        glEndQuery(GL_SAMPLES_PASSED);
+        counter.issued[frameIndex] = true;
+    }
+
+    GLuint64 GetSamples(const std::string& name) const
+    {
+        auto it = counterIndices.find(name);
+        return it == counterIndices.end() ? 0 : counters[it->second].samples;
+    }
+
+    float GetMs(const std::string& name) const
+    {
+        auto it = scopeIndices.find(name);
+        return it == scopeIndices.end() ? 0.0f : scopes[it->second].avgMs;
+    }
+
+    // scopes in the order they were first used
+    const std::vector<Scope>& GetScopes() const
+    {
+        return scopes;
+    }
+
+    // averages every scope over the next 'frames' frames and prints the results,
+    // gives repeatable numbers for comparing before/after a change
+    void StartCapture(int frames)
+    {
+        for (auto& scope : scopes)
+        {
+            scope.captureTotalMs = 0.0;
+            scope.captureSamples = 0;
+        }
+        captureFramesLeft = frames;
+        captureFrames = frames;
+    }
+
+    bool IsCapturing() const
+    {
+        return captureFramesLeft > 0;
+    }
+
+private:
+    // private constructor so other instances cant be made
+    GpuProfiler() : frameIndex(0), captureFramesLeft(0), captureFrames(0) {}
+
+    std::vector<Scope> scopes;
+    std::unordered_map<std::string, int> scopeIndices;
+    std::vector<Counter> counters;
+    std::unordered_map<std::string, int> counterIndices;
+    int frameIndex;
+
+    int captureFramesLeft;
+    int captureFrames;
+
+    Scope& GetScope(const std::string& name)
+    {
+        auto it = scopeIndices.find(name);
+        if (it != scopeIndices.end())
+            return scopes[it->second];
+
+        Scope scope;
+        scope.name = name;
+        glGenQueries(2 * FRAMES_IN_FLIGHT, scope.queries);
+        scopeIndices[name] = scopes.size();
+        scopes.push_back(scope);
+        return scopes.back();
+    }
+
+    Counter& GetCounter(const std::string& name)
+    {
+        auto it = counterIndices.find(name);
+        if (it != counterIndices.end())
+            return counters[it->second];
+
+        Counter counter;
+        counter.name = name;
+        glGenQueries(FRAMES_IN_FLIGHT, counter.queries);
+        counterIndices[name] = counters.size();
+        counters.push_back(counter);
+        return counters.back();
+    }
+
+    void PrintCapture()
+    {
+        std::cout << "(GPU Profiler): Capture over " << captureFrames << " frames:" << std::endl;
+        for (auto& scope : scopes)
+        {
+            if (scope.captureSamples == 0)
+                continue;
+            std::cout << "    " << scope.name << ": " << scope.captureTotalMs / scope.captureSamples << " ms avg" << std::endl;
+        }
+    }
+};
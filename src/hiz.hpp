@@ -0,0 +1,153 @@
+#pragma once
+
+#include "../lib/glad.h"
+
+#include "shader.hpp"
+#include "gl_state.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+// depth pyramid for gpu occlusion culling. level 0 is a copy of the depth buffer inside the current viewport
+// and every level after it keeps the max (farthest) depth of the 2x2 texels under it, built by hiz_compute.glsl
+class HiZBuffer
+{
+public:
+    static const GLuint TEXTURE_UNIT = 1; // unit the cull shader samples the pyramid from
+
+    // copies the depth of what has been drawn so far and rebuilds every level
+    void Build(Shader& hizShader)
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        Resize(viewport[2], viewport[3]);
+
+        // the default framebuffer's depth cant be sampled, copy it out first
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, depthCopy);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1], width, height);
+
+        hizShader.use();
+        hizShader.setInt("depthTexture", 2);
+        GLState::Get().BindTexture(2, GL_TEXTURE_2D, depthCopy);
+
+        hizShader.setInt("mode", 0);
+        glBindImageTexture(1, pyramid, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        Dispatch(hizShader, width, height);
+
+        hizShader.setInt("mode", 1);
+        for (int level = 1; level < levelCount; level++)
+        {
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            glBindImageTexture(0, pyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            glBindImageTexture(1, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            Dispatch(hizShader, GetLevelWidth(level), GetLevelHeight(level));
+        }
+
+        // the cull shader samples it next
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    // writes a level as linear depth into a texture imgui can show
+    void RenderDebugView(Shader& hizShader, int level, float nearPlane, float farPlane)
+    {
+        if (pyramid == 0)
+            return;
+
+        level = std::clamp(level, 0, levelCount - 1);
+        hizShader.use();
+        hizShader.setInt("mode", 2);
+        hizShader.setFloat("nearPlane", nearPlane);
+        hizShader.setFloat("farPlane", farPlane);
+        glBindImageTexture(0, pyramid, level, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(2, debugTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+        Dispatch(hizShader, DEBUG_WIDTH, DEBUG_HEIGHT);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+
+    // binds the pyramid for sampling and sets the uniforms the cull shader needs
+    void Bind(Shader& cullShader) const
+    {
+        GLState::Get().BindTexture(TEXTURE_UNIT, GL_TEXTURE_2D, pyramid);
+
+        cullShader.setInt("hiZ", TEXTURE_UNIT);
+        cullShader.setIVec2("hiZSize", width, height);
+        cullShader.setInt("hiZLevels", levelCount);
+    }
+
+    int GetLevelCount() const
+    {
+        return levelCount;
+    }
+
+    int GetLevelWidth(int level) const
+    {
+        return std::max(1, width >> level);
+    }
+
+    int GetLevelHeight(int level) const
+    {
+        return std::max(1, height >> level);
+    }
+
+    GLuint GetDebugTextureID() const
+    {
+        return debugTexture;
+    }
+
+    static const int DEBUG_WIDTH = 320;
+    static const int DEBUG_HEIGHT = 180;
+
+private:
+    GLuint depthCopy = 0;
+    GLuint pyramid = 0;
+    GLuint debugTexture = 0;
+    int width = 0, height = 0;
+    int levelCount = 0;
+
+    void Resize(int _width, int _height)
+    {
+        if (_width == width && _height == height)
+            return;
+
+        width = _width;
+        height = _height;
+        levelCount = (int)std::floor(std::log2((float)std::max(width, height))) + 1;
+
+        // immutable storage cant be resized, so the textures are recreated
+        glDeleteTextures(1, &depthCopy);
+        glDeleteTextures(1, &pyramid);
+        GLState::Get().Invalidate();
+
+        glGenTextures(1, &depthCopy);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, depthCopy);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenTextures(1, &pyramid);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, pyramid);
+        glTexStorage2D(GL_TEXTURE_2D, levelCount, GL_R32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        if (debugTexture == 0)
+        {
+            glGenTextures(1, &debugTexture);
+            GLState::Get().BindTexture(0, GL_TEXTURE_2D, debugTexture);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, DEBUG_WIDTH, DEBUG_HEIGHT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, 0);
+    }
+
+    void Dispatch(Shader& hizShader, int dstWidth, int dstHeight)
+    {
+        hizShader.setIVec2("dstSize", dstWidth, dstHeight);
+        glDispatchCompute((dstWidth + 7) / 8, (dstHeight + 7) / 8, 1);
+    }
+};
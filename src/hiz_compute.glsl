@@ -0,0 +1,59 @@
+#version 460 core
+
+// builds the hi-z pyramid one level per dispatch, see HiZBuffer in hiz.hpp.
+// every texel is the farthest depth of the texels it covers in the level above, so if a box is in front
+// of a texel it is in front of everything under it
+layout (local_size_x = 8, local_size_y = 8) in;
+
+#define MODE_COPY_DEPTH 0
+#define MODE_DOWNSAMPLE 1
+#define MODE_DEBUG_VIEW 2
+uniform int mode;
+
+uniform sampler2D depthTexture; // MODE_COPY_DEPTH
+layout (r32f, binding = 0) uniform readonly image2D srcLevel; // MODE_DOWNSAMPLE, MODE_DEBUG_VIEW
+layout (r32f, binding = 1) uniform writeonly image2D dstLevel; // MODE_COPY_DEPTH, MODE_DOWNSAMPLE
+layout (rgba8, binding = 2) uniform writeonly image2D debugImage; // MODE_DEBUG_VIEW
+
+uniform ivec2 dstSize;
+uniform float nearPlane;
+uniform float farPlane;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (texel.x >= dstSize.x || texel.y >= dstSize.y)
+        return;
+
+    if (mode == MODE_COPY_DEPTH)
+    {
+        imageStore(dstLevel, texel, vec4(texelFetch(depthTexture, texel, 0).r));
+    }
+    else if (mode == MODE_DOWNSAMPLE)
+    {
+        // odd sized levels fold their last row/column into the last texel so nothing gets skipped
+        ivec2 srcSize = imageSize(srcLevel);
+        ivec2 srcTexel = texel * 2;
+        int countX = (texel.x == dstSize.x - 1 && srcSize.x % 2 == 1) ? 3 : 2;
+        int countY = (texel.y == dstSize.y - 1 && srcSize.y % 2 == 1) ? 3 : 2;
+
+        float maxDepth = 0.0;
+        for (int y = 0; y < countY; y++)
+        {
+            for (int x = 0; x < countX; x++)
+            {
+                maxDepth = max(maxDepth, imageLoad(srcLevel, min(srcTexel + ivec2(x, y), srcSize - 1)).r);
+            }
+        }
+        imageStore(dstLevel, texel, vec4(maxDepth));
+    }
+    else
+    {
+        // linear depth so the pyramid is actually readable, nearest texel of the chosen level
+        ivec2 srcSize = imageSize(srcLevel);
+        float depth = imageLoad(srcLevel, texel * srcSize / dstSize).r;
+        float ndc = depth * 2.0 - 1.0;
+        float linear = (2.0 * nearPlane * farPlane) / (farPlane + nearPlane - ndc * (farPlane - nearPlane));
+        imageStore(debugImage, texel, vec4(vec3(linear / farPlane), 1.0));
+    }
+}
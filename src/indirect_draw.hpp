@@ -0,0 +1,338 @@
+#pragma once
+
+#include "../lib/glad.h"
+
+#include "shader.hpp"
+#include "gl_state.hpp"
+#include "materials.hpp"
+#include "models.hpp"
+#include "geometry.hpp"
+#include "textures.hpp"
+#include "render_queue.hpp"
+#include "frustum.hpp"
+#include "hiz.hpp"
+
+#include <algorithm>
+#include <vector>
+
+
+// ssbo binding point of the per draw material ids, has to match materials.glsl
+const GLuint DRAW_MATERIAL_SSBO_BINDING = 2;
+
+// ssbo binding points of cull_compute.glsl
+const GLuint CULL_INPUT_SSBO_BINDING = 3;
+const GLuint CULL_INPUT_COMMAND_SSBO_BINDING = 4;
+const GLuint CULL_OUTPUT_COMMAND_SSBO_BINDING = 5;
+const GLuint CULL_OUTPUT_MATERIAL_SSBO_BINDING = 6;
+const GLuint CULL_DRAW_COUNT_SSBO_BINDING = 7;
+const GLuint CULL_VISIBILITY_SSBO_BINDING = 8;
+
+// matches the cullMode defines in cull_compute.glsl
+enum class CullMode
+{
+    FRUSTUM,
+    HIZ_FIRST_PHASE, // frustum + whatever was visible last frame
+    HIZ_SECOND_PHASE // frustum + hi-z, only outputs what the first phase didnt draw
+};
+
+// layout glMultiDrawElementsIndirect reads from the indirect buffer
+struct DrawElementsIndirectCommand
+{
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+
+
+// static meshes recorded once into indirect commands, grouped by render pass, and drawn with one
+// glMultiDrawElementsIndirect per pass. the shaders pick up the transform through the command's base instance
+// and the material through drawMaterials[drawOffset + gl_DrawID], so the cpu cost of a pass doesnt depend on
+// how many meshes are in it.
+// with culling a compute pass first compacts the commands that are in the frustum into a second buffer and
+// the passes are drawn with glMultiDrawElementsIndirectCount, so visibility never goes through the cpu.
+// hi-z occlusion culling splits that into two phases (see cull_compute.glsl), each with its own half of the outputs
+class IndirectDrawList
+{
+public:
+    // visible/culled counts are read back this many frames late so reading them never waits on the gpu
+    static const int READBACK_FRAMES = 4;
+
+    void Add(RenderPass pass, const Mesh& mesh, unsigned int objectIndex)
+    {
+        const GeometryRange& geometry = mesh.GetGeometry();
+
+        PendingDraw draw;
+        draw.pass = pass;
+        draw.command = {geometry.indexCount, 1, geometry.firstIndex, geometry.baseVertex, objectIndex};
+        draw.materialID = mesh.GetMaterialID();
+        draw.boundingSphere = glm::vec4(mesh.GetCenter(), mesh.GetRadius());
+        draws.push_back(draw);
+        dirty = true;
+    }
+
+    // builds the command and material buffers, has to be called after adding and before drawing
+    void Upload()
+    {
+        if (!dirty)
+            return;
+
+        // passes are contiguous so each one is a single range, sorted by material within a pass
+        std::stable_sort(draws.begin(), draws.end(), [](const PendingDraw& a, const PendingDraw& b)
+        {
+            if (a.pass != b.pass)
+                return a.pass < b.pass;
+            return a.materialID < b.materialID;
+        });
+
+        std::vector<DrawElementsIndirectCommand> commands;
+        std::vector<unsigned int> drawMaterials;
+        std::vector<CullInput> cullInputs;
+        for (auto& range : passRanges)
+        {
+            range = PassRange();
+        }
+        for (auto& draw : draws)
+        {
+            PassRange& range = passRanges[(int)draw.pass];
+            if (range.count == 0)
+            {
+                range.first = commands.size();
+            }
+            range.count++;
+
+            commands.push_back(draw.command);
+            drawMaterials.push_back(draw.materialID);
+        }
+        for (auto& draw : draws)
+        {
+            CullInput cullInput;
+            cullInput.boundingSphere = draw.boundingSphere;
+            cullInput.pass = (unsigned int)draw.pass;
+            cullInput.outputFirst = passRanges[(int)draw.pass].first;
+            cullInput.materialID = draw.materialID;
+            cullInputs.push_back(cullInput);
+        }
+        drawCount = commands.size();
+
+        if (commandBuffer == 0)
+        {
+            glGenBuffers(1, &commandBuffer);
+            glGenBuffers(1, &materialBuffer);
+            glGenBuffers(1, &cullInputBuffer);
+            glGenBuffers(1, &culledCommandBuffer);
+            glGenBuffers(1, &culledMaterialBuffer);
+            glGenBuffers(1, &drawCountBuffer);
+            glGenBuffers(1, &visibilityBuffer);
+            glGenBuffers(READBACK_FRAMES, readbackBuffers);
+
+            for (int i = 0; i < READBACK_FRAMES; i++)
+            {
+                GLState::Get().BindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[i]);
+                glBufferData(GL_COPY_WRITE_BUFFER, sizeof(drawCounts), NULL, GL_STREAM_READ);
+            }
+            GLState::Get().BindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+
+        GLState::Get().BindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STATIC_DRAW);
+        GLState::Get().BindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, drawMaterials.size() * sizeof(unsigned int), drawMaterials.data(), GL_STATIC_DRAW);
+
+        // culling outputs are only ever written by the gpu
+        GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, cullInputBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, cullInputs.size() * sizeof(CullInput), cullInputs.data(), GL_STATIC_DRAW);
+        GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, culledCommandBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, PHASE_COUNT * commands.size() * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_COPY);
+        GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, culledMaterialBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, PHASE_COUNT * drawMaterials.size() * sizeof(unsigned int), NULL, GL_DYNAMIC_COPY);
+        GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, drawCountBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(drawCounts), NULL, GL_DYNAMIC_COPY);
+
+        // everything starts out visible so the first hi-z phase has something to draw
+        std::vector<GLuint> visibility(commands.size(), 1);
+        GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, visibilityBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, visibility.size() * sizeof(GLuint), visibility.data(), GL_DYNAMIC_COPY);
+        GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        dirty = false;
+    }
+
+    // culls every command on the gpu, the transform buffer has to be uploaded already.
+    // after this, Draw with culled = true only draws what survived.
+    // the second hi-z phase needs the pyramid built from the first phase's draws
+    void Cull(Shader& cullShader, const glm::mat4& viewProjection, CullMode mode = CullMode::FRUSTUM, const HiZBuffer* hiZ = nullptr)
+    {
+        if (drawCount == 0)
+            return;
+
+        // the second phase adds to the counters the first one started
+        if (mode != CullMode::HIZ_SECOND_PHASE)
+        {
+            GLuint zero = 0;
+            GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, drawCountBuffer);
+            glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        }
+
+        GLState::Get().BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_INPUT_SSBO_BINDING, cullInputBuffer);
+        GLState::Get().BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_INPUT_COMMAND_SSBO_BINDING, commandBuffer);
+        GLState::Get().BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_OUTPUT_COMMAND_SSBO_BINDING, culledCommandBuffer);
+        GLState::Get().BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_OUTPUT_MATERIAL_SSBO_BINDING, culledMaterialBuffer);
+        GLState::Get().BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_DRAW_COUNT_SSBO_BINDING, drawCountBuffer);
+        GLState::Get().BindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_VISIBILITY_SSBO_BINDING, visibilityBuffer);
+
+        Frustum frustum(viewProjection);
+        cullShader.use();
+        cullShader.setInt("cullMode", (int)mode);
+        if (mode == CullMode::HIZ_SECOND_PHASE && hiZ)
+        {
+            cullShader.setMat4("viewProjection", viewProjection);
+            hiZ->Bind(cullShader);
+        }
+        for (int i = 0; i < 6; i++)
+        {
+            cullShader.setVec4("frustumPlanes[" + std::to_string(i) + "]", frustum.planes[i]);
+        }
+        cullShader.setInt("drawCount", drawCount);
+        glDispatchCompute((drawCount + 63) / 64, 1, 1);
+
+        // the commands are read as indirect args, the materials as an ssbo and the counts by the readback copy
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+        if (mode != CullMode::HIZ_FIRST_PHASE)
+        {
+            ReadBackDrawCounts();
+        }
+    }
+
+    // draws every command of the pass with the given shader, returns the number of meshes submitted
+    // (with culled the gpu decides how many of them are actually drawn). phase picks the hi-z phase's outputs
+    int Draw(RenderPass pass, Shader& shader, bool culled = false, int phase = 0)
+    {
+        const PassRange& range = passRanges[(int)pass];
+        if (range.count == 0)
+            return 0;
+
+        int first = culled ? phase * drawCount + range.first : range.first;
+        shader.use();
+        // gl_DrawID restarts at 0 for every multi draw. the depth pre-pass shader has no materials so it doesnt have it
+        int drawOffsetLocation = shader.getUniformLocation("drawOffset");
+        if (drawOffsetLocation != -1)
+        {
+            glUniform1i(drawOffsetLocation, first);
+        }
+
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D_ARRAY, TextureManager::Get().GetTexArrayID());
+        GLState::Get().BindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_MATERIAL_SSBO_BINDING, culled ? culledMaterialBuffer : materialBuffer);
+        MaterialManager::Get().Upload();
+
+        GLState::Get().BindVertexArray(GeometryBuffer::Get().GetVAO());
+        if (culled)
+        {
+            // compacted commands keep the pass's range, the count of the pass is read from the parameter buffer
+            GLState::Get().BindBuffer(GL_DRAW_INDIRECT_BUFFER, culledCommandBuffer);
+            GLState::Get().BindBuffer(GL_PARAMETER_BUFFER, drawCountBuffer);
+            glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(first * sizeof(DrawElementsIndirectCommand)),
+                (GLintptr)((phase * (int)RenderPass::COUNT + (int)pass) * sizeof(GLuint)), range.count, 0);
+        }
+        else
+        {
+            GLState::Get().BindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(range.first * sizeof(DrawElementsIndirectCommand)), range.count, 0);
+        }
+
+        return range.count;
+    }
+
+    // how many of the pass's commands survived culling a few frames ago, both hi-z phases together
+    int GetVisibleCount(RenderPass pass) const
+    {
+        return drawCounts[0][(int)pass] + drawCounts[1][(int)pass];
+    }
+
+    // how many draws only showed up in the second hi-z phase (disoccluded this frame)
+    int GetSecondPhaseCount(RenderPass pass) const
+    {
+        return drawCounts[1][(int)pass];
+    }
+
+    int GetDrawCount(RenderPass pass) const
+    {
+        return passRanges[(int)pass].count;
+    }
+
+private:
+    static const int PHASE_COUNT = 2;
+
+    struct PendingDraw
+    {
+        RenderPass pass;
+        DrawElementsIndirectCommand command;
+        unsigned int materialID;
+        glm::vec4 boundingSphere;
+    };
+
+    // matches CullInput in cull_compute.glsl
+    struct CullInput
+    {
+        glm::vec4 boundingSphere;
+        unsigned int pass;
+        unsigned int outputFirst;
+        unsigned int materialID;
+        unsigned int padding = 0;
+    };
+
+    struct PassRange
+    {
+        int first = 0;
+        int count = 0;
+    };
+
+    std::vector<PendingDraw> draws;
+    PassRange passRanges[(int)RenderPass::COUNT];
+    bool dirty = false;
+
+    int drawCount = 0;
+
+    GLuint commandBuffer = 0;
+    GLuint materialBuffer = 0;
+
+    GLuint cullInputBuffer = 0;
+    GLuint culledCommandBuffer = 0;
+    GLuint culledMaterialBuffer = 0;
+    GLuint drawCountBuffer = 0; // one counter per phase and pass, also the parameter buffer of the count draws
+    GLuint visibilityBuffer = 0; // per command, visible last frame
+
+    // copies of the counters, only read once their fence has signaled
+    GLuint readbackBuffers[READBACK_FRAMES] = {};
+    GLsync readbackFences[READBACK_FRAMES] = {};
+    int readbackFrame = 0;
+    GLuint drawCounts[PHASE_COUNT][(int)RenderPass::COUNT] = {};
+
+    void ReadBackDrawCounts()
+    {
+        int slot = readbackFrame % READBACK_FRAMES;
+
+        // the oldest copy lives in the slot about to be reused
+        if (readbackFences[slot])
+        {
+            GLenum result = glClientWaitSync(readbackFences[slot], 0, 0);
+            if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+            {
+                GLState::Get().BindBuffer(GL_COPY_READ_BUFFER, readbackBuffers[slot]);
+                glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(drawCounts), drawCounts);
+            }
+            glDeleteSync(readbackFences[slot]);
+        }
+
+        GLState::Get().BindBuffer(GL_COPY_READ_BUFFER, drawCountBuffer);
+        GLState::Get().BindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffers[slot]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(drawCounts));
+        readbackFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        readbackFrame++;
+    }
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "../lib/glad.h"
+#include "glm/glm.hpp"
+
+#include "shader.hpp"
+#include "gl_state.hpp"
+#include "models.hpp"
+#include "materials.hpp"
+#include "geometry.hpp"
+#include "textures.hpp"
+#include "transforms.hpp"
+#include "render_queue.hpp"
+
+#include <algorithm>
+#include <vector>
+
+
+// many copies of one Model drawn with a single instanced draw per mesh.
+// instances are kept in their own ssbo with the same layout as the TransformBuffer, which gets bound in its place
+// for these draws, so the regular vertex shaders index it with gl_InstanceID without any changes
+class InstanceBatch
+{
+public:
+    InstanceBatch(Model& _model) : model(&_model) {}
+
+    void Add(const glm::mat4& transform)
+    {
+        models.push_back(transform);
+        dirty = true;
+    }
+
+    void Clear()
+    {
+        models.clear();
+        dirty = true;
+    }
+
+    size_t GetCount() const
+    {
+        return models.size();
+    }
+
+    // draws every mesh of the model whose render pass matches, returns the number of draw calls
+    int Draw(RenderPass pass, Shader& shader)
+    {
+        if (models.empty())
+            return 0;
+
+        Upload();
+
+        shader.use();
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D_ARRAY, TextureManager::Get().GetTexArrayID());
+        GLState::Get().BindBufferBase(GL_SHADER_STORAGE_BUFFER, TRANSFORM_SSBO_BINDING, ssbo);
+        GLState::Get().BindVertexArray(GeometryBuffer::Get().GetVAO());
+
+        int drawCalls = 0;
+        for (auto& mesh : model->GetMeshes())
+        {
+            if (RenderPassForAlpha(mesh.alphaMode) != pass)
+                continue;
+
+            MaterialManager::Get().Bind(shader, mesh.GetMaterialID());
+
+            const GeometryRange& geometry = mesh.GetGeometry();
+            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, geometry.indexCount, GL_UNSIGNED_INT,
+                (void*)(geometry.firstIndex * sizeof(unsigned int)), (GLsizei)models.size(), geometry.baseVertex, 0);
+            drawCalls++;
+        }
+
+        // back to the regular object transforms
+        GLState::Get().BindBufferBase(GL_SHADER_STORAGE_BUFFER, TRANSFORM_SSBO_BINDING, TransformBuffer::Get().GetBufferID());
+
+        return drawCalls;
+    }
+
+private:
+    Model* model;
+
+    std::vector<glm::mat4> models;
+    std::vector<ObjectTransform> records;
+    bool dirty = false;
+
+    GLuint ssbo = 0;
+    size_t capacity = 0; // in records
+
+    // only when instances were added or cleared, a static batch is uploaded once
+    void Upload()
+    {
+        if (!dirty)
+            return;
+
+        records.resize(models.size());
+        for (size_t i = 0; i < models.size(); i++)
+        {
+            records[i].model = models[i];
+        }
+        ComputeNormalMatrices(models.data(), records.data(), models.size());
+
+        if (ssbo == 0)
+        {
+            glGenBuffers(1, &ssbo);
+        }
+        GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+        if (records.size() > capacity)
+        {
+            capacity = std::max(records.size(), capacity * 2);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(ObjectTransform), NULL, GL_DYNAMIC_DRAW);
+        }
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, records.size() * sizeof(ObjectTransform), records.data());
+
+        dirty = false;
+    }
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// singleton
+// a fixed pool of worker threads for splitting per frame cpu work into batches.
+// the calling thread works on the batches too, so ParallelFor is safe to call with no workers
+class JobSystem
+{
+public:
+    static JobSystem& Get()
+    {
+        static JobSystem instance;
+        return instance;
+    }
+
+    // runs job(begin, end) over [0, count) in batches of batchSize, returns once every batch is done.
+    // only one ParallelFor runs at a time, calls from other threads wait for their turn
+    void ParallelFor(int count, int batchSize, const std::function<void(int begin, int end)>& job)
+    {
+        if (count <= 0)
+            return;
+
+        std::lock_guard<std::mutex> callLock(callMutex);
+
+        int batchCount = (count + batchSize - 1) / batchSize;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            currentJob = &job;
+            jobCount = count;
+            jobBatchSize = batchSize;
+            jobBatches = batchCount;
+            nextBatch = 0;
+            finishedBatches = 0;
+            generation++;
+        }
+        wakeWorkers.notify_all();
+
+        RunBatches();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        jobDone.wait(lock, [&] { return finishedBatches == jobBatches; });
+        currentJob = nullptr;
+    }
+
+    // workers plus the calling thread
+    int GetThreadCount() const
+    {
+        return workers.size() + 1;
+    }
+
+private:
+    // private constructor so other instances cant be made
+    JobSystem()
+    {
+        int workerCount = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+        for (int i = 0; i < workerCount; i++)
+        {
+            workers.emplace_back(&JobSystem::WorkerLoop, this);
+        }
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wakeWorkers.notify_all();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    std::vector<std::thread> workers;
+
+    std::mutex callMutex;
+    std::mutex mutex;
+    std::condition_variable wakeWorkers;
+    std::condition_variable jobDone;
+    bool stop = false;
+    unsigned int generation = 0;
+
+    const std::function<void(int, int)>* currentJob = nullptr;
+    int jobCount = 0;
+    int jobBatchSize = 1;
+    int jobBatches = 0;
+    std::atomic<int> nextBatch{0};
+    int finishedBatches = 0;
+
+    void RunBatches()
+    {
+        int finished = 0;
+        while (true)
+        {
+            int batch = nextBatch.fetch_add(1);
+            if (batch >= jobBatches)
+                break;
+
+            int begin = batch * jobBatchSize;
+            int end = std::min(jobCount, begin + jobBatchSize);
+            (*currentJob)(begin, end);
+            finished++;
+        }
+
+        if (finished > 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finishedBatches += finished;
+            if (finishedBatches == jobBatches)
+                jobDone.notify_all();
+        }
+    }
+
+    void WorkerLoop()
+    {
+        unsigned int seenGeneration = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeWorkers.wait(lock, [&] { return stop || (generation != seenGeneration && currentJob); });
+                if (stop)
+                    return;
+                seenGeneration = generation;
+            }
+
+            RunBatches();
+        }
+    }
+};
@@ -2,12 +2,10 @@
 
 layout (location = 0) in vec3 aPos;
 
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "transforms.glsl"
+#include "frame.glsl"
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * getObjectTransform().model * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,137 @@
+#pragma once
+
+// light types and the lighting math, shared by every shader that lights a surface
+
+// material inputs, fetched (and alpha tested) once per fragment and then shared by every light
+struct Surface
+{
+    vec3 diffuse;
+    vec3 specular;
+    vec3 emission;
+    float shininess;
+    float alpha;
+    float ambient; // how much of the lights' flat ambient terms it gets, 0 when the irradiance probes replace them
+};
+
+struct DirLight
+{
+    vec3 direction;
+  
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+// laid out to match PointLight in lights.hpp (std430), the floats fill the vec3s' padding
+struct PointLight 
+{    
+    vec3 position;
+    float radius; // where the attenuation drops below the cutoff, only used to assign it to clusters
+
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;  
+};
+
+struct SpotLight
+{
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+
+vec3 calcAmbient(vec3 lightAmbient, Surface surface)
+{
+    return lightAmbient * surface.diffuse * surface.ambient;
+}
+vec3 calcDiffuse(vec3 lightDiffuse, float diffuseAmount, Surface surface)
+{
+    return lightDiffuse * diffuseAmount * surface.diffuse;
+}
+vec3 calcSpecular(vec3 lightSpecular, float specularAmount, Surface surface)
+{
+    return lightSpecular * specularAmount * surface.specular;
+}
+
+
+// shadow scales everything but the ambient, 1 = fully lit
+vec3 calcDirLight(DirLight light, Surface surface, vec3 normal, vec3 viewDir, float shadow)
+{
+    vec3 lightDir = normalize(-light.direction);
+    // diffuse
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), surface.shininess);
+    // combine diffuse specular and ambient
+    vec3 result = calcAmbient(light.ambient, surface) + shadow * (calcDiffuse(light.diffuse, diff, surface) + calcSpecular(light.specular, spec, surface));
+    return result;
+}
+
+vec3 calcPointLight(PointLight light, Surface surface, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+    // diffuse
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), surface.shininess);
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    // combine diffuse specular and ambient
+    vec3 ambient = calcAmbient(light.ambient, surface);
+    vec3 diffuse = calcDiffuse(light.diffuse, diff, surface);
+    vec3 specular = calcSpecular(light.specular, spec, surface);
+    ambient *= attenuation;
+    diffuse *= attenuation * shadow;
+    specular *= attenuation * shadow;
+
+    return (ambient + diffuse + specular);
+}
+
+vec3 calcSpotLight(SpotLight light, Surface surface, vec3 normal, vec3 fragPos, vec3 viewDir, float shadow)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+
+
+    // angle between where the spotlight is pointing and the fragment
+    float theta = dot(lightDir, normalize(-light.direction));
+    // values for smooth cutoff at the edges
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = smoothstep(0.0, 1.0, (theta - light.outerCutOff) / epsilon);
+
+    // diffuse
+    float diff = max(dot(normal, lightDir), 0.0);
+    // specular
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), surface.shininess);
+
+    vec3 ambient = calcAmbient(light.ambient, surface);
+    vec3 diffuse = calcDiffuse(light.diffuse, diff, surface);
+    vec3 specular = calcSpecular(light.specular, spec, surface);
+    diffuse *= intensity;
+    specular *= intensity;
+
+    // attenuation
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
+    ambient *= attenuation;
+    diffuse *= attenuation * shadow;
+    specular *= attenuation * shadow;
+
+    return (ambient + diffuse + specular);  
+}
\ No newline at end of file
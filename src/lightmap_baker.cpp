@@ -0,0 +1,606 @@
+// offline lightmap baker for the static scene, its own executable so the renderer doesnt need assimp's bvh or a ray tracer.
+// loads a model the same way Model does, gives every mesh lightmap uvs (its second uv set if it has one, otherwise
+// planar charts), path traces the scene lights from scene_lights.hpp into the texels on every core and writes a
+// LightmapFile next to the model. the renderer picks it up on the next start (see Model and the LIGHTMAP shader variant)
+//
+// usage: lightmap_baker [model] [output] [scale] [texels per unit] [samples] [bounces]
+// scale has to match the model matrix main.cpp draws the model with, the bake is done in world space
+
+#include "glm/glm.hpp"
+#include "glm/gtc/packing.hpp"
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../lib/stb_image.h"
+
+#include "bake_scene.hpp"
+#include "job_system.hpp"
+#include "lightmap_file.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+const int PAGE_SIZE = 2048;
+const int CHART_PADDING = 2; // texels around every chart, filled by dilation so bilinear filtering doesnt bleed
+
+struct BakeSettings
+{
+    std::string modelPath = "../models/Sponza-master/sponza.obj";
+    std::string outputPath = "../models/Sponza-master/sponza.lightmap";
+    float scale = 0.025f;
+    float texelsPerUnit = 4.0f;
+    int samples = 64;
+    int bounces = 2;
+};
+
+struct BakeMesh
+{
+    std::vector<glm::vec3> positions; // world space
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> lightmapUVs; // the second uv set, empty when there is none
+    std::vector<uint32_t> indices;
+    glm::vec3 albedo = glm::vec3(1.0f);
+};
+
+// a piece of a mesh that is laid out flat in one page
+struct Chart
+{
+    int mesh = 0;
+    std::vector<uint32_t> triangles;
+    std::vector<uint32_t> sourceVertices;
+    std::vector<glm::vec2> uvs; // in texels, relative to the chart's corner
+    std::vector<uint32_t> indices; // into sourceVertices/uvs, 3 per triangle
+    glm::ivec2 size = glm::ivec2(0);
+    glm::ivec2 offset = glm::ivec2(0);
+    int page = 0;
+};
+
+// one texel to bake
+struct TexelSample
+{
+    int page, x, y;
+    glm::vec3 position;
+    glm::vec3 normal;
+};
+
+// average color of a texture, the bake only needs the albedo per mesh
+glm::vec3 AverageTextureColor(const std::string& path, std::unordered_map<std::string, glm::vec3>& cache)
+{
+    auto it = cache.find(path);
+    if (it != cache.end())
+        return it->second;
+
+    glm::vec3 average(1.0f);
+    int width, height, channels;
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb);
+    if (data)
+    {
+        glm::dvec3 sum(0.0);
+        for (int i = 0; i < width * height; i++)
+        {
+            sum += glm::dvec3(data[i * 3], data[i * 3 + 1], data[i * 3 + 2]) / 255.0;
+        }
+        // raw like the renderer samples them, the texture array isnt srgb
+        average = glm::vec3(sum / (double)(width * height));
+        stbi_image_free(data);
+    }
+    else
+    {
+        std::cout << "(LightmapBaker): Error: cant load texture " << path << ", using white" << std::endl;
+    }
+    cache[path] = average;
+    return average;
+}
+
+// same node order as Model::ProcessNode, so the meshes line up with what the renderer loads
+void CollectMeshes(aiNode* node, const aiScene* scene, const std::string& directory, float scale, std::vector<BakeMesh>& meshes, std::unordered_map<std::string, glm::vec3>& textureCache)
+{
+    for (unsigned int i = 0; i < node->mNumMeshes; i++)
+    {
+        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+        BakeMesh bakeMesh;
+        for (unsigned int v = 0; v < mesh->mNumVertices; v++)
+        {
+            bakeMesh.positions.push_back(glm::vec3(mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z) * scale);
+            bakeMesh.normals.push_back(glm::normalize(glm::vec3(mesh->mNormals[v].x, mesh->mNormals[v].y, mesh->mNormals[v].z)));
+            if (mesh->mTextureCoords[1])
+            {
+                bakeMesh.lightmapUVs.push_back(glm::vec2(mesh->mTextureCoords[1][v].x, mesh->mTextureCoords[1][v].y));
+            }
+        }
+        for (unsigned int f = 0; f < mesh->mNumFaces; f++)
+        {
+            for (unsigned int j = 0; j < mesh->mFaces[f].mNumIndices; j++)
+            {
+                bakeMesh.indices.push_back(mesh->mFaces[f].mIndices[j]);
+            }
+        }
+
+        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+        aiColor3D diffuse(1.0f, 1.0f, 1.0f);
+        material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse);
+        bakeMesh.albedo = glm::vec3(diffuse.r, diffuse.g, diffuse.b);
+        if (material->GetTextureCount(aiTextureType_DIFFUSE) > 0)
+        {
+            aiString texturePath;
+            material->GetTexture(aiTextureType_DIFFUSE, 0, &texturePath);
+            bakeMesh.albedo *= AverageTextureColor(directory + "/" + texturePath.C_Str(), textureCache);
+        }
+
+        meshes.push_back(bakeMesh);
+    }
+    for (unsigned int i = 0; i < node->mNumChildren; i++)
+    {
+        CollectMeshes(node->mChildren[i], scene, directory, scale, meshes, textureCache);
+    }
+}
+
+
+struct UnionFind
+{
+    std::vector<uint32_t> parents;
+
+    explicit UnionFind(size_t count) : parents(count)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            parents[i] = i;
+        }
+    }
+
+    uint32_t Find(uint32_t i)
+    {
+        while (parents[i] != i)
+        {
+            parents[i] = parents[parents[i]];
+            i = parents[i];
+        }
+        return i;
+    }
+
+    void Union(uint32_t a, uint32_t b)
+    {
+        parents[Find(a)] = Find(b);
+    }
+};
+
+// copies the triangles' vertices into the chart, a source vertex used by two charts ends up in both
+void AddChartTriangles(Chart& chart, const BakeMesh& mesh, const std::vector<glm::vec2>& vertexUVs)
+{
+    std::unordered_map<uint32_t, uint32_t> chartVertices;
+    for (uint32_t triangle : chart.triangles)
+    {
+        for (int corner = 0; corner < 3; corner++)
+        {
+            uint32_t source = mesh.indices[triangle * 3 + corner];
+            auto it = chartVertices.find(source);
+            if (it == chartVertices.end())
+            {
+                it = chartVertices.emplace(source, chart.sourceVertices.size()).first;
+                chart.sourceVertices.push_back(source);
+                chart.uvs.push_back(vertexUVs[source]);
+            }
+            chart.indices.push_back(it->second);
+        }
+    }
+}
+
+// scales the chart's uvs to texels, moves them to the padded corner and works out its size
+void FinishChart(Chart& chart)
+{
+    glm::vec2 min(FLT_MAX), max(-FLT_MAX);
+    for (auto& uv : chart.uvs)
+    {
+        min = glm::min(min, uv);
+        max = glm::max(max, uv);
+    }
+    glm::vec2 extent = max - min;
+
+    // charts bigger than a page get squashed into one
+    float limit = PAGE_SIZE - 2 * CHART_PADDING - 1;
+    float fit = std::min(1.0f, limit / std::max({extent.x, extent.y, 1e-6f}));
+    for (auto& uv : chart.uvs)
+    {
+        uv = (uv - min) * fit + glm::vec2(CHART_PADDING);
+    }
+    chart.size = glm::ivec2(glm::ceil(extent * fit)) + glm::ivec2(2 * CHART_PADDING + 1);
+}
+
+// planar charts: triangles facing the same major axis that share a position end up in one chart,
+// projected along that axis. a mesh with its own second uv set is one chart
+void BuildCharts(const std::vector<BakeMesh>& meshes, float texelsPerUnit, std::vector<Chart>& charts)
+{
+    for (int meshIndex = 0; meshIndex < meshes.size(); meshIndex++)
+    {
+        const BakeMesh& mesh = meshes[meshIndex];
+        int triangleCount = mesh.indices.size() / 3;
+        if (triangleCount == 0)
+            continue;
+
+        if (!mesh.lightmapUVs.empty())
+        {
+            float area = 0.0f;
+            for (int t = 0; t < triangleCount; t++)
+            {
+                glm::vec3 a = mesh.positions[mesh.indices[t * 3]];
+                area += 0.5f * glm::length(glm::cross(mesh.positions[mesh.indices[t * 3 + 1]] - a, mesh.positions[mesh.indices[t * 3 + 2]] - a));
+            }
+            float side = std::max(4.0f, std::sqrt(area) * texelsPerUnit);
+
+            Chart chart;
+            chart.mesh = meshIndex;
+            for (int t = 0; t < triangleCount; t++)
+            {
+                chart.triangles.push_back(t);
+            }
+            std::vector<glm::vec2> vertexUVs(mesh.lightmapUVs.size());
+            for (int v = 0; v < vertexUVs.size(); v++)
+            {
+                vertexUVs[v] = mesh.lightmapUVs[v] * side;
+            }
+            AddChartTriangles(chart, mesh, vertexUVs);
+            FinishChart(chart);
+            charts.push_back(std::move(chart));
+            continue;
+        }
+
+        // major axis and side of every triangle's face normal, 0-5
+        std::vector<int> buckets(triangleCount);
+        for (int t = 0; t < triangleCount; t++)
+        {
+            glm::vec3 a = mesh.positions[mesh.indices[t * 3]];
+            glm::vec3 normal = glm::cross(mesh.positions[mesh.indices[t * 3 + 1]] - a, mesh.positions[mesh.indices[t * 3 + 2]] - a);
+            glm::vec3 absNormal = glm::abs(normal);
+            int axis = absNormal.x >= absNormal.y && absNormal.x >= absNormal.z ? 0 : (absNormal.y >= absNormal.z ? 1 : 2);
+            buckets[t] = axis * 2 + (normal[axis] < 0.0f ? 1 : 0);
+        }
+
+        // obj meshes dont share vertices between faces, so triangles are joined by (quantized) position instead of index
+        UnionFind components(triangleCount);
+        std::unordered_map<uint64_t, uint32_t> firstTriangle;
+        for (int t = 0; t < triangleCount; t++)
+        {
+            for (int corner = 0; corner < 3; corner++)
+            {
+                glm::ivec3 cell = glm::ivec3(glm::round(mesh.positions[mesh.indices[t * 3 + corner]] * 1000.0f));
+                uint64_t key = ((uint64_t)(cell.x & 0xfffff) << 43) ^ ((uint64_t)(cell.y & 0xfffff) << 23) ^ ((uint64_t)(cell.z & 0xfffff) << 3) ^ (uint64_t)buckets[t];
+                auto it = firstTriangle.find(key);
+                if (it == firstTriangle.end())
+                    firstTriangle.emplace(key, t);
+                else if (buckets[it->second] == buckets[t])
+                    components.Union(t, it->second);
+            }
+        }
+
+        std::unordered_map<uint32_t, int> chartOfComponent;
+        int firstChart = charts.size();
+        for (int t = 0; t < triangleCount; t++)
+        {
+            uint32_t root = components.Find(t);
+            auto it = chartOfComponent.find(root);
+            if (it == chartOfComponent.end())
+            {
+                it = chartOfComponent.emplace(root, charts.size()).first;
+                charts.push_back(Chart());
+                charts.back().mesh = meshIndex;
+            }
+            charts[it->second].triangles.push_back(t);
+        }
+
+        for (int c = firstChart; c < charts.size(); c++)
+        {
+            Chart& chart = charts[c];
+            int axis = buckets[chart.triangles[0]] / 2;
+            std::vector<glm::vec2> vertexUVs(mesh.positions.size());
+            for (int v = 0; v < mesh.positions.size(); v++)
+            {
+                glm::vec3 p = mesh.positions[v];
+                vertexUVs[v] = glm::vec2(p[(axis + 1) % 3], p[(axis + 2) % 3]) * texelsPerUnit;
+            }
+            AddChartTriangles(chart, mesh, vertexUVs);
+            FinishChart(chart);
+        }
+    }
+}
+
+// shelf packing, tallest charts first. returns the page count
+int PackCharts(std::vector<Chart>& charts)
+{
+    std::vector<Chart*> order;
+    for (auto& chart : charts)
+    {
+        order.push_back(&chart);
+    }
+    std::sort(order.begin(), order.end(), [](const Chart* a, const Chart* b) { return a->size.y > b->size.y; });
+
+    int page = 0, x = 0, y = 0, shelfHeight = 0;
+    for (Chart* chart : order)
+    {
+        if (x + chart->size.x > PAGE_SIZE)
+        {
+            x = 0;
+            y += shelfHeight;
+            shelfHeight = 0;
+        }
+        if (y + chart->size.y > PAGE_SIZE)
+        {
+            page++;
+            x = 0;
+            y = 0;
+            shelfHeight = 0;
+        }
+        chart->page = page;
+        chart->offset = glm::ivec2(x, y);
+        x += chart->size.x;
+        shelfHeight = std::max(shelfHeight, chart->size.y);
+    }
+    return charts.empty() ? 0 : page + 1;
+}
+
+// finds the texels whose centers are covered by a chart's triangles
+void RasterizeCharts(const std::vector<BakeMesh>& meshes, const std::vector<Chart>& charts, int pageCount, std::vector<TexelSample>& samples)
+{
+    std::vector<uint8_t> covered((size_t)pageCount * PAGE_SIZE * PAGE_SIZE, 0);
+    for (auto& chart : charts)
+    {
+        const BakeMesh& mesh = meshes[chart.mesh];
+        for (int t = 0; t < chart.triangles.size(); t++)
+        {
+            glm::vec2 uv[3];
+            glm::vec3 position[3], normal[3];
+            for (int corner = 0; corner < 3; corner++)
+            {
+                uint32_t local = chart.indices[t * 3 + corner];
+                uv[corner] = chart.uvs[local] + glm::vec2(chart.offset);
+                position[corner] = mesh.positions[chart.sourceVertices[local]];
+                normal[corner] = mesh.normals[chart.sourceVertices[local]];
+            }
+
+            float area = (uv[1].x - uv[0].x) * (uv[2].y - uv[0].y) - (uv[2].x - uv[0].x) * (uv[1].y - uv[0].y);
+            if (std::abs(area) < 1e-8f)
+                continue;
+
+            glm::ivec2 min = glm::max(glm::ivec2(glm::floor(glm::min(uv[0], glm::min(uv[1], uv[2])))), glm::ivec2(0));
+            glm::ivec2 max = glm::min(glm::ivec2(glm::ceil(glm::max(uv[0], glm::max(uv[1], uv[2])))), glm::ivec2(PAGE_SIZE - 1));
+            for (int y = min.y; y <= max.y; y++)
+            {
+                for (int x = min.x; x <= max.x; x++)
+                {
+                    glm::vec2 p(x + 0.5f, y + 0.5f);
+                    float w1 = ((p.x - uv[0].x) * (uv[2].y - uv[0].y) - (uv[2].x - uv[0].x) * (p.y - uv[0].y)) / area;
+                    float w2 = ((uv[1].x - uv[0].x) * (p.y - uv[0].y) - (p.x - uv[0].x) * (uv[1].y - uv[0].y)) / area;
+                    float w0 = 1.0f - w1 - w2;
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                        continue;
+
+                    size_t texel = ((size_t)chart.page * PAGE_SIZE + y) * PAGE_SIZE + x;
+                    if (covered[texel])
+                        continue;
+                    covered[texel] = 1;
+
+                    glm::vec3 interpolated = normal[0] * w0 + normal[1] * w1 + normal[2] * w2;
+                    if (glm::length(interpolated) < 1e-6f)
+                    {
+                        interpolated = glm::cross(position[1] - position[0], position[2] - position[0]);
+                    }
+                    samples.push_back({chart.page, x, y, position[0] * w0 + position[1] * w1 + position[2] * w2, glm::normalize(interpolated)});
+                }
+            }
+        }
+    }
+}
+
+
+// what the texel gets multiplied with at runtime: direct light, the flat ambient terms the dynamic path uses,
+// and diffuse bounces traced from cosine weighted directions
+glm::vec3 BakeTexel(const BakeScene& scene, const TexelSample& texel, const BakeSettings& settings, BakeRandom& random)
+{
+    auto attenuation = [&](glm::vec3 lightPosition, float constant, float linear, float quadratic)
+    {
+        float distance = glm::length(lightPosition - texel.position);
+        return 1.0f / (constant + linear * distance + quadratic * distance * distance);
+    };
+    glm::vec3 ambient = scene.sun.ambient
+        + scene.lamp.ambient * attenuation(scene.lamp.position, scene.lamp.constant, scene.lamp.linear, scene.lamp.quadratic)
+        + scene.spot.ambient * attenuation(scene.spot.position, scene.spot.constant, scene.spot.linear, scene.spot.quadratic);
+    glm::vec3 result = ambient + scene.DirectLight(texel.position, texel.normal);
+
+    glm::vec3 indirect(0.0f);
+    for (int s = 0; s < settings.samples; s++)
+    {
+        glm::vec3 position = texel.position;
+        glm::vec3 normal = texel.normal;
+        glm::vec3 throughput(1.0f);
+        for (int bounce = 0; bounce < settings.bounces; bounce++)
+        {
+            glm::vec3 direction = CosineSampleHemisphere(normal, random);
+            TriangleBVH::Hit hit;
+            if (!scene.bvh.Intersect(position + normal * BakeScene::RAY_EPSILON, direction, FLT_MAX, hit))
+                break;
+
+            position += direction * hit.t;
+            normal = scene.HitNormal(hit, direction); // backs are lit as if they were the front
+
+            throughput *= scene.albedos[hit.triangle];
+            indirect += throughput * scene.DirectLight(position, normal);
+        }
+    }
+    return result + indirect / (float)std::max(settings.samples, 1);
+}
+
+// empty texels next to baked ones take their average, so bilinear filtering at chart edges doesnt pull in black
+void Dilate(std::vector<glm::vec4>& texels, int pageCount, int passes)
+{
+    std::vector<glm::vec4> source;
+    for (int pass = 0; pass < passes; pass++)
+    {
+        source = texels;
+        for (int page = 0; page < pageCount; page++)
+        {
+            for (int y = 0; y < PAGE_SIZE; y++)
+            {
+                for (int x = 0; x < PAGE_SIZE; x++)
+                {
+                    size_t texel = ((size_t)page * PAGE_SIZE + y) * PAGE_SIZE + x;
+                    if (source[texel].a > 0.0f)
+                        continue;
+
+                    glm::vec3 sum(0.0f);
+                    int count = 0;
+                    for (int dy = -1; dy <= 1; dy++)
+                    {
+                        for (int dx = -1; dx <= 1; dx++)
+                        {
+                            int nx = x + dx, ny = y + dy;
+                            if (nx < 0 || ny < 0 || nx >= PAGE_SIZE || ny >= PAGE_SIZE)
+                                continue;
+                            const glm::vec4& neighbour = source[((size_t)page * PAGE_SIZE + ny) * PAGE_SIZE + nx];
+                            if (neighbour.a > 0.0f)
+                            {
+                                sum += glm::vec3(neighbour);
+                                count++;
+                            }
+                        }
+                    }
+                    if (count > 0)
+                    {
+                        texels[texel] = glm::vec4(sum / (float)count, 1.0f);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    BakeSettings settings;
+    if (argc > 1) settings.modelPath = argv[1];
+    if (argc > 2) settings.outputPath = argv[2];
+    if (argc > 3) settings.scale = std::stof(argv[3]);
+    if (argc > 4) settings.texelsPerUnit = std::stof(argv[4]);
+    if (argc > 5) settings.samples = std::stoi(argv[5]);
+    if (argc > 6) settings.bounces = std::stoi(argv[6]);
+
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [&]() { return std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count(); };
+
+    // has to be the same flags as Model::LoadModel or the vertices wont line up
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(settings.modelPath, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_OptimizeMeshes | aiProcess_GenSmoothNormals);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        std::cout << "(Assimp): Error: " << importer.GetErrorString() << std::endl;
+        return 1;
+    }
+    std::string directory = settings.modelPath.substr(0, settings.modelPath.find_last_of('/'));
+
+    std::vector<BakeMesh> meshes;
+    std::unordered_map<std::string, glm::vec3> textureCache;
+    CollectMeshes(scene->mRootNode, scene, directory, settings.scale, meshes, textureCache);
+
+    std::vector<Chart> charts;
+    BuildCharts(meshes, settings.texelsPerUnit, charts);
+    int pageCount = PackCharts(charts);
+
+    std::vector<TexelSample> samples;
+    RasterizeCharts(meshes, charts, pageCount, samples);
+    std::cout << meshes.size() << " meshes, " << charts.size() << " charts in " << pageCount << " pages, " << samples.size() << " texels (" << elapsed() << " s)" << std::endl;
+
+    // flatten everything for the bvh
+    BakeScene bakeScene;
+    std::vector<glm::vec3> positions;
+    for (auto& mesh : meshes)
+    {
+        for (uint32_t index : mesh.indices)
+        {
+            positions.push_back(mesh.positions[index]);
+            bakeScene.normals.push_back(mesh.normals[index]);
+        }
+        bakeScene.albedos.insert(bakeScene.albedos.end(), mesh.indices.size() / 3, mesh.albedo);
+    }
+    bakeScene.Build(positions);
+    bakeScene.sun = SceneSunLight();
+    bakeScene.spot = SceneSpotLight();
+    bakeScene.lamp = SceneLamp();
+    std::cout << "bvh: " << positions.size() / 3 << " triangles, " << bakeScene.bvh.GetNodeCount() << " nodes (" << elapsed() << " s)" << std::endl;
+
+    // every core, texels in small batches so the slow ones (lots of bounces hitting geometry) spread out
+    std::vector<glm::vec4> texels((size_t)pageCount * PAGE_SIZE * PAGE_SIZE, glm::vec4(0.0f));
+    std::atomic<int> baked{0};
+    std::mutex printMutex;
+    int lastPercent = 0;
+    std::cout << "baking on " << JobSystem::Get().GetThreadCount() << " threads, " << settings.samples << " samples, " << settings.bounces << " bounces" << std::endl;
+    JobSystem::Get().ParallelFor(samples.size(), 64, [&](int begin, int end)
+    {
+        for (int i = begin; i < end; i++)
+        {
+            const TexelSample& sample = samples[i];
+            size_t texel = ((size_t)sample.page * PAGE_SIZE + sample.y) * PAGE_SIZE + sample.x;
+            BakeRandom random(texel);
+            texels[texel] = glm::vec4(BakeTexel(bakeScene, sample, settings, random), 1.0f);
+        }
+
+        int percent = (baked += end - begin) * 100ll / samples.size();
+        std::lock_guard<std::mutex> lock(printMutex);
+        if (percent >= lastPercent + 10)
+        {
+            lastPercent = percent - percent % 10;
+            std::cout << lastPercent << "% (" << elapsed() << " s)" << std::endl;
+        }
+    });
+
+    Dilate(texels, pageCount, CHART_PADDING + 1);
+
+    // charts back into per mesh vertex and index lists
+    LightmapFile file;
+    file.pageSize = PAGE_SIZE;
+    file.pageCount = pageCount;
+    file.meshes.resize(meshes.size());
+    for (int m = 0; m < meshes.size(); m++)
+    {
+        file.meshes[m].sourceVertexCount = meshes[m].positions.size();
+    }
+    for (auto& chart : charts)
+    {
+        LightmapMesh& mesh = file.meshes[chart.mesh];
+        uint32_t first = mesh.sourceVertices.size();
+        for (int v = 0; v < chart.sourceVertices.size(); v++)
+        {
+            mesh.sourceVertices.push_back(chart.sourceVertices[v]);
+            glm::vec2 uv = (chart.uvs[v] + glm::vec2(chart.offset)) / (float)PAGE_SIZE;
+            mesh.coords.push_back(glm::vec3(uv, chart.page));
+        }
+        for (uint32_t index : chart.indices)
+        {
+            mesh.indices.push_back(first + index);
+        }
+    }
+    file.texels.resize(texels.size() * 4);
+    for (size_t i = 0; i < texels.size(); i++)
+    {
+        for (int c = 0; c < 4; c++)
+        {
+            file.texels[i * 4 + c] = glm::packHalf1x16(texels[i][c]);
+        }
+    }
+
+    if (!file.Save(settings.outputPath))
+        return 1;
+    std::cout << "wrote " << settings.outputPath << " (" << elapsed() << " s)" << std::endl;
+    return 0;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+// what lightmap_baker writes and the renderer reads back, no gl in here.
+// the bake splits vertices along its chart seams, so every mesh gets a new vertex list (which source vertex
+// each one copies and where it is in the lightmap) and a new index list.
+// meshes are in the order Model loads them, with the same assimp flags
+struct LightmapMesh
+{
+    uint32_t sourceVertexCount = 0; // to check it still belongs to the same mesh
+    std::vector<uint32_t> sourceVertices;
+    std::vector<glm::vec3> coords; // lightmap uv in xy, page (texture array layer) in z
+    std::vector<uint32_t> indices;
+};
+
+struct LightmapFile
+{
+    static const uint32_t MAGIC = 0x50414d4c; // "LMAP"
+    static const uint32_t VERSION = 1;
+
+    int pageSize = 0;
+    int pageCount = 0;
+    std::vector<LightmapMesh> meshes;
+    std::vector<uint16_t> texels; // rgba16f, pages one after the other. rgb is multiplied with the albedo, a is coverage
+
+    bool Save(const std::string& path) const
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+        {
+            std::cout << "(LightmapFile): Error: cant write " << path << std::endl;
+            return false;
+        }
+
+        Write(file, MAGIC);
+        Write(file, VERSION);
+        Write(file, (uint32_t)pageSize);
+        Write(file, (uint32_t)pageCount);
+        Write(file, (uint32_t)meshes.size());
+        for (auto& mesh : meshes)
+        {
+            Write(file, mesh.sourceVertexCount);
+            WriteVector(file, mesh.sourceVertices);
+            WriteVector(file, mesh.coords);
+            WriteVector(file, mesh.indices);
+        }
+        WriteVector(file, texels);
+        return (bool)file;
+    }
+
+    // silent when the file doesnt exist, not every model has been baked
+    bool Load(const std::string& path)
+    {
+        Clear();
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+
+        uint32_t magic = 0, version = 0, size = 0, count = 0, meshCount = 0;
+        Read(file, magic);
+        Read(file, version);
+        if (magic != MAGIC || version != VERSION)
+        {
+            std::cout << "(LightmapFile): Error: " << path << " is not a lightmap or from another version" << std::endl;
+            return false;
+        }
+
+        Read(file, size);
+        Read(file, count);
+        Read(file, meshCount);
+        pageSize = size;
+        pageCount = count;
+        meshes.resize(meshCount);
+        for (auto& mesh : meshes)
+        {
+            Read(file, mesh.sourceVertexCount);
+            ReadVector(file, mesh.sourceVertices);
+            ReadVector(file, mesh.coords);
+            ReadVector(file, mesh.indices);
+        }
+        ReadVector(file, texels);
+
+        if (!file || !HasAllTexels())
+        {
+            std::cout << "(LightmapFile): Error: " << path << " is truncated" << std::endl;
+            Clear();
+            return false;
+        }
+        return true;
+    }
+
+    // every page's texels are there, Lightmaps only uploads files where this holds
+    bool HasAllTexels() const
+    {
+        return pageSize > 0 && pageCount > 0 && texels.size() == (size_t)pageSize * pageSize * pageCount * 4;
+    }
+
+private:
+    // a failed load leaves an empty file behind, nothing of the partial read
+    void Clear()
+    {
+        pageSize = 0;
+        pageCount = 0;
+        meshes.clear();
+        texels.clear();
+    }
+
+    template <typename T>
+    static void Write(std::ofstream& file, const T& value)
+    {
+        file.write((const char*)&value, sizeof(T));
+    }
+
+    template <typename T>
+    static void WriteVector(std::ofstream& file, const std::vector<T>& values)
+    {
+        Write(file, (uint64_t)values.size());
+        file.write((const char*)values.data(), values.size() * sizeof(T));
+    }
+
+    template <typename T>
+    static void Read(std::ifstream& file, T& value)
+    {
+        file.read((char*)&value, sizeof(T));
+    }
+
+    template <typename T>
+    static void ReadVector(std::ifstream& file, std::vector<T>& values)
+    {
+        uint64_t size = 0;
+        Read(file, size);
+        if (!file || size > (1ull << 32))
+        {
+            file.setstate(std::ios::failbit);
+            return;
+        }
+        values.resize(size);
+        file.read((char*)values.data(), size * sizeof(T));
+    }
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "../lib/glad.h"
+
+#include "gl_state.hpp"
+#include "lightmap_file.hpp"
+
+#include <iostream>
+
+
+// the baked lighting of one model on the gpu, every page of the LightmapFile is a layer of a texture array.
+// the file's meshes are used while loading the model (see Model), this only keeps the texels
+class Lightmaps
+{
+public:
+    static const GLuint TEXTURE_UNIT = 10; // has to match the LIGHTMAP variant of fragment.glsl
+
+    void Upload(const LightmapFile& file)
+    {
+        if (!file.HasAllTexels())
+            return;
+
+        if (texture == 0)
+        {
+            glGenTextures(1, &texture);
+        }
+        GLState::Get().BindTexture(TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, texture);
+
+        int mipLevels = 1;
+        while ((file.pageSize >> mipLevels) > 0)
+        {
+            mipLevels++;
+        }
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, mipLevels, GL_RGBA16F, file.pageSize, file.pageSize, file.pageCount);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, file.pageSize, file.pageSize, file.pageCount, GL_RGBA, GL_HALF_FLOAT, file.texels.data());
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        pageSize = file.pageSize;
+        pageCount = file.pageCount;
+    }
+
+    void Bind()
+    {
+        GLState::Get().BindTexture(TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, texture);
+    }
+
+    bool IsLoaded() const
+    {
+        return texture != 0;
+    }
+
+    int GetPageSize() const
+    {
+        return pageSize;
+    }
+
+    int GetPageCount() const
+    {
+        return pageCount;
+    }
+
+    void Delete()
+    {
+        if (texture != 0)
+        {
+            glDeleteTextures(1, &texture);
+            texture = 0;
+        }
+    }
+
+private:
+    GLuint texture = 0;
+    int pageSize = 0;
+    int pageCount = 0;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+// clustered point lights, see ClusteredLights in lights.hpp.
+// the view frustum is split into a grid of clusters (screen tiles x exponential depth slices) and
+// cluster_compute.glsl writes the indices of the lights touching each cluster into a fixed size slot
+#include "lighting.glsl"
+#include "frame.glsl"
+
+// has to match ClusteredLights
+#define CLUSTER_GRID_X 16
+#define CLUSTER_GRID_Y 9
+#define CLUSTER_GRID_Z 24
+#define CLUSTER_COUNT (CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z)
+#define MAX_LIGHTS_PER_CLUSTER 256
+
+layout (std430, binding = 9) readonly buffer PointLights
+{
+    PointLight pointLights[];
+};
+layout (std430, binding = 10) buffer ClusterLightCounts
+{
+    uint clusterLightCounts[];
+};
+layout (std430, binding = 11) buffer ClusterLightIndices
+{
+    uint clusterLightIndices[]; // MAX_LIGHTS_PER_CLUSTER per cluster
+};
+
+// per mesh light lists from LightLists in lights.hpp, draws pick theirs with the lightList uniform
+#define MAX_LIGHTS_PER_LIST 64
+
+struct LightList
+{
+    uint count;
+    uint spotLight; // 1 if the spot light reaches the mesh
+    uint clipped;   // 1 if it ran out of room, shading falls back to the clusters
+    uint padding;
+};
+layout (std430, binding = 14) readonly buffer LightLists
+{
+    LightList lightLists[];
+};
+layout (std430, binding = 15) readonly buffer LightListIndices
+{
+    uint lightListIndices[]; // MAX_LIGHTS_PER_LIST per list
+};
+
+// near * (far / near)^(slice / CLUSTER_GRID_Z), so clusters stay roughly cube shaped with distance
+float getSliceDepth(float slice)
+{
+    return nearPlane * pow(farPlane / nearPlane, slice / float(CLUSTER_GRID_Z));
+}
+
+uint getClusterIndex(vec2 fragCoord, float viewDepth)
+{
+    vec2 uv = (fragCoord - viewport.xy) / viewport.zw;
+    uvec2 tile = uvec2(clamp(uv * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y), vec2(0.0), vec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1)));
+    float slice = log(viewDepth / nearPlane) / log(farPlane / nearPlane) * float(CLUSTER_GRID_Z);
+    uint z = uint(clamp(slice, 0.0, float(CLUSTER_GRID_Z - 1)));
+    return (z * CLUSTER_GRID_Y + tile.y) * CLUSTER_GRID_X + tile.x;
+}
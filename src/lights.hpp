@@ -0,0 +1,195 @@
+#pragma once
+
+#include "../lib/glad.h"
+#include "glm/glm.hpp"
+
+#include "shader.hpp"
+#include "gl_state.hpp"
+#include "ring_buffer.hpp"
+#include "scene_lights.hpp"
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+
+// ssbo binding points, have to match lights.glsl
+const GLuint POINT_LIGHT_SSBO_BINDING = 9;
+const GLuint CLUSTER_LIGHT_COUNT_SSBO_BINDING = 10;
+const GLuint CLUSTER_LIGHT_INDEX_SSBO_BINDING = 11;
+const GLuint LIGHT_LIST_SSBO_BINDING = 14;
+const GLuint LIGHT_LIST_INDEX_SSBO_BINDING = 15;
+
+
+// clustered forward lighting. the lights are uploaded every frame through the DynamicRingBuffer and
+// cluster_compute.glsl writes a light list per cluster, which fragment.glsl looks up from the fragment's position.
+// the cluster grid is recomputed from the camera every time, so nothing has to be rebuilt when the window resizes
+class ClusteredLights
+{
+public:
+    // have to match lights.glsl
+    static const int GRID_X = 16;
+    static const int GRID_Y = 9;
+    static const int GRID_Z = 24;
+    static const int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+    static const int MAX_LIGHTS_PER_CLUSTER = 256;
+
+    static const int MAX_POINT_LIGHTS = 4096;
+
+    // the FrameUniforms block has to be bound already, the cluster bounds come from its projection
+    void Build(Shader& clusterShader, const std::vector<PointLight>& lights)
+    {
+        if (countBuffer == 0)
+        {
+            glGenBuffers(1, &countBuffer);
+            GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+
+            glGenBuffers(1, &indexBuffer);
+            GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+        }
+
+        lightCount = std::min((int)lights.size(), MAX_POINT_LIGHTS);
+
+        // an empty range cant be bound, so there is always at least one light worth of space
+        auto allocation = DynamicRingBuffer::Get().AllocateStorage(std::max(lightCount, 1) * sizeof(PointLight));
+        if (!allocation.data)
+        {
+            lightCount = 0;
+        }
+        else
+        {
+            std::memcpy(allocation.data, lights.data(), lightCount * sizeof(PointLight));
+            GLState::Get().BindBufferRange(GL_SHADER_STORAGE_BUFFER, POINT_LIGHT_SSBO_BINDING, allocation.buffer, allocation.offset, allocation.size);
+        }
+        GLState::Get().BindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_LIGHT_COUNT_SSBO_BINDING, countBuffer);
+        GLState::Get().BindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_LIGHT_INDEX_SSBO_BINDING, indexBuffer);
+
+        clusterShader.use();
+        clusterShader.setInt("pointLightCount", lightCount);
+        glDispatchCompute((CLUSTER_COUNT + 63) / 64, 1, 1);
+
+        // fragment shaders read the lists next
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    int GetLightCount() const
+    {
+        return lightCount;
+    }
+
+private:
+    GLuint countBuffer = 0;
+    GLuint indexBuffer = 0;
+    int lightCount = 0;
+};
+
+
+// per mesh light lists, built on the cpu instead of per cluster on the gpu. a mesh's list is every point light whose
+// radius (PointLightRadius) reaches its world box, and whether the spot light's does. draws from the render queue
+// pass their list's index in the lightList uniform, -1 falls back to the clusters
+class LightLists
+{
+public:
+    static const int MAX_LIGHTS_PER_LIST = 64; // has to match lights.glsl
+
+    struct Stats
+    {
+        int lists = 0;
+        int totalLights = 0;
+        int maxLights = 0;
+        int clippedLists = 0; // hit MAX_LIGHTS_PER_LIST, these meshes use the clusters instead
+        int spotLists = 0;
+        float buildMs = 0.0f;
+    };
+
+    // world boxes as centers and extents, one list per box in the same order. call after ClusteredLights::Build,
+    // lights are indexed the way it uploaded them. returns false when the ring buffer is out of space, the bindings
+    // still point at old ranges then so draws have to use the clusters this frame
+    bool Build(const std::vector<glm::vec3>& centers, const std::vector<glm::vec3>& extents, const std::vector<PointLight>& lights, int lightCount,
+        const SpotLight& spotLight, float spotRadius)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        int listCount = centers.size();
+        auto listAllocation = DynamicRingBuffer::Get().AllocateStorage(std::max(listCount, 1) * sizeof(LightListData));
+        auto indexAllocation = DynamicRingBuffer::Get().AllocateStorage(std::max(listCount, 1) * MAX_LIGHTS_PER_LIST * sizeof(GLuint));
+        if (!listAllocation.data || !indexAllocation.data)
+            return false;
+
+        // every list has its own fixed slot so the jobs never share anything. built in cpu memory and copied after,
+        // the stats read it back and the mapped ring buffer is slow to read
+        lists.resize(listCount);
+        indices.resize(listCount * MAX_LIGHTS_PER_LIST);
+        JobSystem::Get().ParallelFor(listCount, 16, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                GLuint* listIndices = &indices[i * MAX_LIGHTS_PER_LIST];
+                int count = 0;
+                bool clipped = false;
+                for (int light = 0; light < lightCount; light++)
+                {
+                    if (!SphereTouchesBox(lights[light].position, lights[light].radius, centers[i], extents[i]))
+                        continue;
+                    if (count == MAX_LIGHTS_PER_LIST)
+                    {
+                        clipped = true;
+                        break;
+                    }
+                    listIndices[count++] = light;
+                }
+                lists[i].count = count;
+                lists[i].spotLight = SphereTouchesBox(spotLight.position, spotRadius, centers[i], extents[i]) ? 1 : 0;
+                lists[i].clipped = clipped ? 1 : 0;
+            }
+        });
+        std::memcpy(listAllocation.data, lists.data(), listCount * sizeof(LightListData));
+        std::memcpy(indexAllocation.data, indices.data(), indices.size() * sizeof(GLuint));
+
+        stats = Stats();
+        stats.lists = listCount;
+        for (auto& list : lists)
+        {
+            stats.totalLights += list.count;
+            stats.maxLights = std::max(stats.maxLights, (int)list.count);
+            stats.clippedLists += list.clipped;
+            stats.spotLists += list.spotLight;
+        }
+
+        GLState::Get().BindBufferRange(GL_SHADER_STORAGE_BUFFER, LIGHT_LIST_SSBO_BINDING, listAllocation.buffer, listAllocation.offset, listAllocation.size);
+        GLState::Get().BindBufferRange(GL_SHADER_STORAGE_BUFFER, LIGHT_LIST_INDEX_SSBO_BINDING, indexAllocation.buffer, indexAllocation.offset, indexAllocation.size);
+
+        stats.buildMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    const Stats& GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    // matches LightList in lights.glsl (std430)
+    struct LightListData
+    {
+        GLuint count;
+        GLuint spotLight;
+        GLuint clipped; // the shader uses the clusters for clipped lists
+        GLuint padding;
+    };
+
+    std::vector<LightListData> lists;
+    std::vector<GLuint> indices;
+    Stats stats;
+
+    static bool SphereTouchesBox(const glm::vec3& position, float radius, const glm::vec3& center, const glm::vec3& extents)
+    {
+        glm::vec3 outside = glm::max(glm::abs(position - center) - extents, glm::vec3(0.0f));
+        return glm::dot(outside, outside) <= radius * radius;
+    }
+};
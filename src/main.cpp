@@ -9,16 +9,37 @@
 #include "../lib/imgui/backends/imgui_impl_opengl3.h"
 
 #include "shader.hpp"
+#include "shader_reload.hpp"
+#include "gl_state.hpp"
+#include "ring_buffer.hpp"
 #include "cube.hpp"
 #include "keymap.hpp"
 #include "helpers.hpp"
 #include "camera.hpp"
 #include "textures.hpp"
 #include "models.hpp"
+#include "gpu_profiler.hpp"
+#include "transforms.hpp"
+#include "render_queue.hpp"
+#include "indirect_draw.hpp"
+#include "culling.hpp"
+#include "occlusion.hpp"
+#include "instancing.hpp"
+#include "lights.hpp"
+#include "gbuffer.hpp"
+#include "shadows.hpp"
+#include "lightmaps.hpp"
+#include "probes.hpp"
+#include "ssao.hpp"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cfloat>
 #include <cmath>
+#include <cstring>
 #include <iostream>
+#include <random>
 
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -31,6 +52,22 @@ void update(GLFWwindow* window);
 const unsigned int initWidth = 1280, initHeight = 720;
 unsigned int viewWidth = initWidth, viewHeight = initHeight;
 
+const float nearPlane = 0.1f, farPlane = 100.0f;
+
+// matches FrameUniforms in frame.glsl (std140)
+const GLuint FRAME_UBO_BINDING = 0;
+struct FrameData
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 viewPos;
+    float nearPlane;
+    glm::vec4 viewport;
+    float farPlane;
+    float pad[3];
+};
+static_assert(sizeof(FrameData) == 176, "FrameData has to match the std140 layout of FrameUniforms");
+
 float deltaTime = 0.0f;
 int fps;
 float msPerFrame;
@@ -80,8 +117,28 @@ int main()
 
     
     // rendering and shader stuff
-    Shader objectShader("/home/jonah/Programming/Opengl/opengl-first-project/src/vertex.glsl", "/home/jonah/Programming/Opengl/opengl-first-project/src/fragment.glsl");
-    Shader lightSourceShader("/home/jonah/Programming/Opengl/opengl-first-project/src/light_source_vertex.glsl", "/home/jonah/Programming/Opengl/opengl-first-project/src/light_source_fragment.glsl");
+    Shader objectShader(SHADER_DIR "vertex.glsl", SHADER_DIR "fragment.glsl"); // opaque variant, no discard so early depth test survives
+    Shader alphaTestShader(SHADER_DIR "vertex.glsl", SHADER_DIR "fragment.glsl", {"ALPHA_TEST"});
+    Shader multiDrawShader(SHADER_DIR "vertex.glsl", SHADER_DIR "fragment.glsl", {"MULTI_DRAW"}); // materials from an ssbo per gl_DrawID
+    Shader multiDrawAlphaTestShader(SHADER_DIR "vertex.glsl", SHADER_DIR "fragment.glsl", {"MULTI_DRAW", "ALPHA_TEST"});
+    Shader deferredShader(SHADER_DIR "vertex.glsl", SHADER_DIR "fragment.glsl", {"DEFERRED"}); // writes the g-buffer instead of lighting
+    Shader deferredAlphaTestShader(SHADER_DIR "vertex.glsl", SHADER_DIR "fragment.glsl", {"DEFERRED", "ALPHA_TEST"});
+    Shader multiDrawDeferredShader(SHADER_DIR "vertex.glsl", SHADER_DIR "fragment.glsl", {"MULTI_DRAW", "DEFERRED"});
+    Shader multiDrawDeferredAlphaTestShader(SHADER_DIR "vertex.glsl", SHADER_DIR "fragment.glsl", {"MULTI_DRAW", "DEFERRED", "ALPHA_TEST"});
+    Shader deferredLightingShader(SHADER_DIR "fullscreen_vertex.glsl", SHADER_DIR "deferred_lighting.glsl");
+    Shader lightSourceShader(SHADER_DIR "light_source_vertex.glsl", SHADER_DIR "light_source_fragment.glsl");
+    Shader depthShader(SHADER_DIR "depth_vertex.glsl", SHADER_DIR "depth_fragment.glsl");
+    Shader shadowShader(SHADER_DIR "shadow_vertex.glsl", SHADER_DIR "shadow_fragment.glsl");
+    Shader shadowAlphaTestShader(SHADER_DIR "shadow_vertex.glsl", SHADER_DIR "shadow_fragment.glsl", {"ALPHA_TEST"});
+    Shader lightmapShader(SHADER_DIR "vertex.glsl", SHADER_DIR "fragment.glsl", {"LIGHTMAP"}); // baked lighting instead of the light loops
+    Shader lightmapAlphaTestShader(SHADER_DIR "vertex.glsl", SHADER_DIR "fragment.glsl", {"LIGHTMAP", "ALPHA_TEST"});
+    Shader bakedShader(SHADER_DIR "vertex.glsl", SHADER_DIR "fragment.glsl", {"BAKED"}); // albedo times the vertex colors, no light loops
+    Shader bakedAlphaTestShader(SHADER_DIR "vertex.glsl", SHADER_DIR "fragment.glsl", {"BAKED", "ALPHA_TEST"});
+    Shader cullShader = Shader::Compute(SHADER_DIR "cull_compute.glsl", {"RENDER_PASS_COUNT " + std::to_string((int)RenderPass::COUNT)});
+    Shader hiZShader = Shader::Compute(SHADER_DIR "hiz_compute.glsl");
+    Shader clusterShader = Shader::Compute(SHADER_DIR "cluster_compute.glsl");
+    Shader ssaoShader = Shader::Compute(SHADER_DIR "ssao_compute.glsl");
+    SSAO::InitShader(ssaoShader);
 
 
     // unsigned int VAO; //vertex array object
@@ -92,7 +149,7 @@ int main()
     
     unsigned int VBO; // vertex byffer object
     glGenBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLState::Get().BindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices_cube), vertices_cube, GL_STATIC_DRAW);
 
     // unsigned int EBO; // element buffer object
@@ -103,52 +160,348 @@ int main()
     // glBindVertexArray(VAO);
     // setVertAttributes();
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLState::Get().BindBuffer(GL_ARRAY_BUFFER, VBO);
     // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBindVertexArray(lightVAO);
+    GLState::Get().BindVertexArray(lightVAO);
     setLightSourceVertAttribs();
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0); // unbinding VBO
-    glBindVertexArray(0); // unbinding VAO
+    GLState::Get().BindBuffer(GL_ARRAY_BUFFER, 0); // unbinding VBO
+    GLState::Get().BindVertexArray(0); // unbinding VAO
 
     // enable depth testing and face culling
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_CULL_FACE);
+    GLState::Get().SetEnabled(GL_DEPTH_TEST, true);
+    GLState::Get().SetEnabled(GL_CULL_FACE, true);
+    GLState::Get().DepthFunc(GL_LESS);
+    GLState::Get().DepthMask(true);
+    GLState::Get().ColorMask(true);
+    GLState::Get().SetEnabled(GL_BLEND, false);
 
     // texture stuff
     TextureManager::Get().GenerateTextureArray(4096, 4096, 100);
     
     GLuint texArrayID = TextureManager::Get().GetTexArrayID();
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, texArrayID);
+    GLState::Get().BindTexture(0, GL_TEXTURE_2D_ARRAY, texArrayID);
 
     // stbi_set_flip_vertically_on_load(true);
 
-    objectShader.use();
-    objectShader.setInt("texArray", 0); // tex array should use tex unit 0
-
-    objectShader.setFloat("material.emissionStrength", 1.0f);
-    objectShader.setFloat("material.shininess", 128.0f);
-
     // model loading
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
+    // written by lightmap_baker, without it sponza just has no lightmapped meshes
+    LightmapFile sponzaLightmap;
+    sponzaLightmap.Load("../models/Sponza-master/sponza.lightmap");
+
     Model goldOre("../models/Gold_Ore_Block/Gold.obj");
-    Model windfall("../models/Sponza-master/sponza.obj");
+    Model windfall("../models/Sponza-master/sponza.obj", &sponzaLightmap);
+    // the plain windfall dae files are the ones with COLOR streams, the _bake ones keep their bake in a separate
+    // palette textured copy of every mesh instead
+    Model windfallRoom("../models/Windfall/Room11.dae", nullptr, true);
+
+    Lightmaps lightmaps;
+    lightmaps.Upload(sponzaLightmap);
+    sponzaLightmap = LightmapFile(); // the texels are on the gpu and the meshes have their coords now
 
     TextureManager::Get().GenerateMipmaps(); // generate texture array mipmaps once all textures have been loaded in
-    TextureManager::Get().SendSubTexResArrayToShader(objectShader); // send the tex res array to the frag shader
+    GeometryBuffer::Get().Upload(); // every mesh has been appended to the shared vertex/index buffers by now
+
+    // uniforms that only get set once, also rerun whenever the shader is hot reloaded
+    auto initObjectShader = [](Shader& shader)
+    {
+        shader.setInt("texArray", 0); // tex array should use tex unit 0
+
+        TextureManager::Get().SendSubTexResArrayToShader(shader); // send the tex res array to the frag shader
+    };
+    objectShader.use();
+    initObjectShader(objectShader);
+    alphaTestShader.use();
+    initObjectShader(alphaTestShader);
+    multiDrawShader.use();
+    initObjectShader(multiDrawShader);
+    multiDrawAlphaTestShader.use();
+    initObjectShader(multiDrawAlphaTestShader);
+    for (Shader* shader : {&deferredShader, &deferredAlphaTestShader, &multiDrawDeferredShader, &multiDrawDeferredAlphaTestShader, &shadowAlphaTestShader, &lightmapShader, &lightmapAlphaTestShader, &bakedShader, &bakedAlphaTestShader})
+    {
+        shader->use();
+        initObjectShader(*shader);
+    }
+
+    // rebuild shaders in the background whenever their glsl files are saved
+    ShaderHotReloader shaderReloader(window);
+    shaderReloader.Watch(objectShader, initObjectShader);
+    shaderReloader.Watch(alphaTestShader, initObjectShader);
+    shaderReloader.Watch(multiDrawShader, initObjectShader);
+    shaderReloader.Watch(multiDrawAlphaTestShader, initObjectShader);
+    shaderReloader.Watch(deferredShader, initObjectShader);
+    shaderReloader.Watch(deferredAlphaTestShader, initObjectShader);
+    shaderReloader.Watch(multiDrawDeferredShader, initObjectShader);
+    shaderReloader.Watch(multiDrawDeferredAlphaTestShader, initObjectShader);
+    shaderReloader.Watch(deferredLightingShader);
+    shaderReloader.Watch(lightSourceShader);
+    shaderReloader.Watch(depthShader);
+    shaderReloader.Watch(shadowShader);
+    shaderReloader.Watch(shadowAlphaTestShader, initObjectShader);
+    shaderReloader.Watch(lightmapShader, initObjectShader);
+    shaderReloader.Watch(lightmapAlphaTestShader, initObjectShader);
+    shaderReloader.Watch(bakedShader, initObjectShader);
+    shaderReloader.Watch(bakedAlphaTestShader, initObjectShader);
+    shaderReloader.Watch(cullShader);
+    shaderReloader.Watch(hiZShader);
+    shaderReloader.Watch(clusterShader);
+    shaderReloader.Watch(ssaoShader, SSAO::InitShader);
 
     
     glm::vec3 pointLightPos[] = {
-        glm::vec3( 0.7f,  5.0f,  2.0f),
+        SceneLamp().position,
         glm::vec3( 2.3f, -3.3f, -4.0f),
         glm::vec3(-4.0f,  2.0f, -12.0f),
         glm::vec3( 0.0f,  0.0f, -3.0f)
     };
+
+    // object transforms, normal matrices only get recomputed when one of these is changed with Set()
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
+    model = glm::scale(model, glm::vec3(0.025f, 0.025f, 0.025f));
+    unsigned int windfallObject = TransformBuffer::Get().Add(model);
+
+    // centimeters, next to sponza instead of on top of it
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(110.0f, 0.0f, 0.0f));
+    model = glm::scale(model, glm::vec3(0.01f, 0.01f, 0.01f));
+    unsigned int windfallRoomObject = TransformBuffer::Get().Add(model);
+
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(0.0f, -2.0f, 2.0f));
+    unsigned int goldOreObject = TransformBuffer::Get().Add(model);
+
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, pointLightPos[0]);
+    unsigned int lightCubeObject = TransformBuffer::Get().Add(model);
     
 
+    RenderQueue renderQueue;
+
+    // every mesh instance in the scene with its frustum culling slot
+    struct SceneMesh
+    {
+        Mesh* mesh;
+        unsigned int objectIndex;
+        unsigned int cullIndex;
+        unsigned int occludeeIndex;
+        bool isStatic; // only static meshes go into the cached shadow cascades
+    };
+    std::vector<SceneMesh> sceneMeshes;
+    std::vector<glm::vec3> sceneMeshCenters, sceneMeshExtents; // world boxes, the light lists are tested against these
+    FrustumCuller frustumCuller;
+    OcclusionCuller occlusionCuller;
+    const float occluderMinArea = 1.0f; // world space, only the big triangles (walls, floors, pillars) are worth rasterizing
+    auto addSceneModel = [&](Model& model, unsigned int objectIndex)
+    {
+        const glm::mat4& objectModel = TransformBuffer::Get().GetModel(objectIndex);
+        for (auto& mesh : model.GetMeshes())
+        {
+            unsigned int cullIndex = frustumCuller.Add(mesh.GetBounds(), objectModel);
+            unsigned int occludeeIndex = occlusionCuller.AddOccludee(mesh.GetBounds(), objectModel);
+            if (mesh.alphaMode == AlphaMode::OPAQUE)
+            {
+                occlusionCuller.AddOccluder(mesh.vertices, mesh.indices, objectModel, occluderMinArea);
+            }
+            sceneMeshes.push_back({&mesh, objectIndex, cullIndex, occludeeIndex, true});
+
+            glm::vec3 center, extents;
+            mesh.GetBounds().GetWorldBox(objectModel, center, extents);
+            sceneMeshCenters.push_back(center);
+            sceneMeshExtents.push_back(extents);
+        }
+    };
+    addSceneModel(windfall, windfallObject);
+    addSceneModel(windfallRoom, windfallRoomObject);
+    addSceneModel(goldOre, goldOreObject);
+
+    // skip meshes outside the camera frustum before they go into the render queue
+    bool cpuCulling = true;
+    int cpuVisibleCount = 0;
+    float cpuCullMs = 0.0f;
+    FrustumCuller::BenchmarkResult cullBenchmark;
+
+    // skip meshes hidden behind the big occluders in a cpu depth buffer
+    bool occlusionCulling = false;
+    int occlusionCandidates = 0, occlusionRejected = 0;
+    glm::mat4 lastViewProjection = glm::mat4(1.0f); // the benchmark runs from the imgui code, before this frame's camera
+
+    // build the render queue's draws on the job system, each batch into its own list, merged on this thread
+    bool parallelDrawList = true;
+    const int DRAW_LIST_BATCH_SIZE = 256;
+    float drawListBuildMs = 0.0f;
+    float drawListSerialMs = 0.0f, drawListParallelMs = 0.0f; // benchmark
+    Shader* passShaders[] = {&depthShader, &objectShader, &alphaTestShader, &alphaTestShader};
+
+    // the static scene recorded once as indirect commands. blended meshes are left out,
+    // they need to be sorted back to front every frame so they always go through the render queue
+    IndirectDrawList staticDraws;
+    auto recordModel = [&](Model& model, unsigned int objectIndex)
+    {
+        for (auto& mesh : model.GetMeshes())
+        {
+            RenderPass pass = RenderPassForAlpha(mesh.alphaMode);
+            if (pass == RenderPass::BLENDED)
+                continue;
+
+            staticDraws.Add(pass, mesh, objectIndex);
+        }
+    };
+    recordModel(windfall, windfallObject);
+    recordModel(windfallRoom, windfallRoomObject);
+    recordModel(goldOre, goldOreObject);
+    staticDraws.Upload();
+
+    // clustered point lights. the first one is the original scene light (the light cube is drawn there),
+    // the rest are scattered through sponza with a short range
+    ClusteredLights clusteredLights;
+    // per mesh light lists for the render queue's draws instead of the clusters. big meshes like sponza's floor
+    // reach far more lights than fit in a list and fall back to the clusters, so the clusters stay the default
+    bool perMeshLightLists = false;
+    LightLists lightLists;
+    int pointLightCount = 1024;
+    bool animateLights = true;
+    std::vector<PointLight> basePointLights(ClusteredLights::MAX_POINT_LIGHTS);
+    std::vector<PointLight> pointLights; // this frame's, after animating
+    {
+        glm::vec3 sceneMin(FLT_MAX), sceneMax(-FLT_MAX);
+        const glm::mat4& sponzaModel = TransformBuffer::Get().GetModel(windfallObject);
+        for (auto& mesh : windfall.GetMeshes())
+        {
+            // only scaled and translated, so the corners stay min/max
+            glm::vec3 meshMin = glm::vec3(sponzaModel * glm::vec4(mesh.GetBounds().min, 1.0f));
+            glm::vec3 meshMax = glm::vec3(sponzaModel * glm::vec4(mesh.GetBounds().max, 1.0f));
+            sceneMin = glm::min(sceneMin, glm::min(meshMin, meshMax));
+            sceneMax = glm::max(sceneMax, glm::max(meshMin, meshMax));
+        }
+
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (int i = 0; i < ClusteredLights::MAX_POINT_LIGHTS; i++)
+        {
+            PointLight& light = basePointLights[i];
+            glm::vec3 color = glm::vec3(unit(rng), unit(rng), unit(rng));
+            color /= std::max({color.r, color.g, color.b, 0.001f});
+
+            light.position = glm::vec3(
+                glm::mix(sceneMin.x, sceneMax.x, unit(rng)),
+                glm::mix(sceneMin.y + 0.5f, sceneMin.y + 0.4f * (sceneMax.y - sceneMin.y), unit(rng)),
+                glm::mix(sceneMin.z, sceneMax.z, unit(rng)));
+            light.ambient = glm::vec3(0.0f);
+            light.diffuse = color;
+            light.specular = color * 0.5f;
+            light.constant = 1.0f;
+            light.linear = 0.7f;
+            light.quadratic = 1.8f;
+        }
+
+        basePointLights[0] = SceneLamp();
+        for (int i = 1; i < 4; i++)
+        {
+            basePointLights[i].position = pointLightPos[i];
+        }
+
+        for (auto& light : basePointLights)
+        {
+            light.radius = PointLightRadius(light);
+        }
+    }
+
+    // draw opaque and cutout meshes with one glMultiDrawElementsIndirect per pass instead of through the queue
+    bool multiDraw = false;
+    // frustum cull the multi draw commands in a compute shader and draw them with glMultiDrawElementsIndirectCount
+    bool gpuCulling = true;
+    // two phase occlusion culling against a depth pyramid of what was visible last frame
+    bool hiZCulling = false;
+    HiZBuffer hiZ;
+    bool hiZDebugView = false;
+    int hiZDebugLevel = 0;
+
+    // stress test, a big grid of ore blocks drawn with one instanced draw per mesh
+    const int ORE_GRID_X = 50, ORE_GRID_Y = 40, ORE_GRID_Z = 50;
+    InstanceBatch oreInstances(goldOre);
+    bool oreStressTest = false;
+    int oreDrawCalls = 0;
+
+    // opaque and cutout meshes write a g-buffer that is lit in one fullscreen pass, blended ones stay forward
+    bool deferred = false;
+    GBuffer gBuffer;
+    GLuint fullscreenVAO; // the fullscreen triangle has no vertex data but core profile still wants a vao bound
+    glGenVertexArrays(1, &fullscreenVAO);
+
+    // baked lighting for the meshes lightmap_baker covered, only in the forward render queue (not multi draw or deferred)
+    bool bakedLightmaps = lightmaps.IsLoaded();
+
+    // the same for meshes with imported vertex colors, the cheapest way to draw the static environment
+    bool vertexColorLighting = true;
+    int vertexColoredMeshes = std::count_if(windfallRoom.GetMeshes().begin(), windfallRoom.GetMeshes().end(), [](const Mesh& mesh) { return mesh.vertexColored; });
+
+    // cascaded shadow maps for the directional light, the far cascades are cached until something changes
+    bool shadows = true;
+    CascadedShadowMap shadowMap;
+    float shadowDistance = 60.0f;
+    DirLight sunLight = SceneSunLight();
+    int shadowCasterDraws[CascadedShadowMap::CASCADE_COUNT] = {};
+    const char* shadowCascadeNames[CascadedShadowMap::CASCADE_COUNT] = {"shadow cascade 0", "shadow cascade 1", "shadow cascade 2", "shadow cascade 3"};
+
+    // point and spot light shadows share one atlas, only a budget of its tiles is re-rendered per frame
+    bool localShadows = true;
+    ShadowAtlas shadowAtlas;
+    int shadowAtlasDraws = 0;
+
+    const SpotLight spotLight = SceneSpotLight();
+    SpotShadowCaster spotShadowCaster = {spotLight.position, spotLight.direction, SpotLightRadius(spotLight), glm::radians(spotLight.outerCutOff)};
+
+    // sh irradiance probes baked on the cpu from the static meshes, they replace the lights' flat ambient terms.
+    // the bvh is only kept for the bake, rebaking (after moving the sun) builds it again
+    bool irradianceProbes = true;
+    IrradianceProbes probes;
+    float probeBvhMs = 0.0f;
+    auto bakeProbes = [&]()
+    {
+        auto bvhStart = std::chrono::steady_clock::now();
+        BakeScene bakeScene;
+        std::vector<glm::vec3> positions;
+        glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+        for (auto& sceneMesh : sceneMeshes)
+        {
+            // vertex colored meshes bring their own baked light, the grid only has to cover the rest
+            if (!sceneMesh.isStatic || sceneMesh.mesh->vertexColored)
+                continue;
+
+            const glm::mat4& objectModel = TransformBuffer::Get().GetModel(sceneMesh.objectIndex);
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(objectModel)));
+            Mesh& mesh = *sceneMesh.mesh;
+            for (unsigned int index : mesh.indices)
+            {
+                glm::vec3 position = glm::vec3(objectModel * glm::vec4(mesh.vertices[index].position, 1.0f));
+                positions.push_back(position);
+                bakeScene.normals.push_back(glm::normalize(normalMatrix * mesh.vertices[index].normal));
+                boundsMin = glm::min(boundsMin, position);
+                boundsMax = glm::max(boundsMax, position);
+            }
+            bakeScene.albedos.insert(bakeScene.albedos.end(), mesh.indices.size() / 3, mesh.GetAlbedo());
+        }
+        bakeScene.sun = sunLight;
+        bakeScene.spot = spotLight;
+        bakeScene.lamp = SceneLamp();
+        bakeScene.Build(positions);
+        probeBvhMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - bvhStart).count();
+
+        probes.Bake(bakeScene, boundsMin, boundsMax);
+    };
+    bakeProbes();
+
+    // draw opaque geometry depth only first, then shade it with depth func GL_EQUAL so each pixel is only lit once
+    bool depthPrepass = false;
+
+    // half res screen space ao, it needs depth before shading so it only runs with the pre-pass or the g-buffer
+    bool ssaoEnabled = false;
+    SSAO ssao;
+
     // imgui stuff
     bool demoWindow = false;
     bool changingKeybind = false;
@@ -161,6 +514,11 @@ int main()
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        shaderReloader.Poll();
+        GpuProfiler::Get().BeginFrame();
+        GLState::Get().BeginFrame();
+        DynamicRingBuffer::Get().BeginFrame();
+
         // imgui
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
@@ -190,6 +548,256 @@ int main()
         ImGui::Begin("Info", NULL, ImGuiWindowFlags_None);
         ImGui::Text("ms per frame: %f", msPerFrame);
         ImGui::Text("fps: %i", fps);
+
+        ImGui::Separator();
+        ImGui::Checkbox("Depth pre-pass", &depthPrepass);
+        ImGui::Checkbox("Deferred shading", &deferred);
+        if (lightmaps.IsLoaded())
+        {
+            ImGui::Checkbox("Baked lightmaps", &bakedLightmaps);
+            ImGui::Text("%i pages of %i x %i%s", lightmaps.GetPageCount(), lightmaps.GetPageSize(), lightmaps.GetPageSize(),
+                multiDraw || deferred ? " (forward render queue only)" : "");
+        }
+        if (vertexColoredMeshes > 0)
+        {
+            ImGui::Checkbox("Vertex color lighting", &vertexColorLighting);
+            ImGui::Text("%i vertex colored meshes%s", vertexColoredMeshes, multiDraw || deferred ? " (forward render queue only)" : "");
+        }
+        ImGui::Checkbox("CPU frustum culling", &cpuCulling);
+        if (cpuCulling)
+        {
+            ImGui::Text("visible: %i, culled: %i (%.3f ms)", cpuVisibleCount, (int)sceneMeshes.size() - cpuVisibleCount, cpuCullMs);
+        }
+        if (ImGui::Button("Benchmark culling (100k objects)"))
+        {
+            cullBenchmark = FrustumCuller::RunBenchmark(Frustum(lastViewProjection));
+        }
+        if (cullBenchmark.objectCount > 0)
+        {
+            ImGui::Text("simd: %.3f ms, scalar: %.3f ms, %i visible", cullBenchmark.simdMs, cullBenchmark.scalarMs, cullBenchmark.visibleCount);
+        }
+        ImGui::SliderInt("Point lights", &pointLightCount, 1, ClusteredLights::MAX_POINT_LIGHTS);
+        ImGui::Checkbox("Animate lights", &animateLights);
+        ImGui::Text("clusters: %i x %i x %i, up to %i lights each", ClusteredLights::GRID_X, ClusteredLights::GRID_Y, ClusteredLights::GRID_Z, ClusteredLights::MAX_LIGHTS_PER_CLUSTER);
+        ImGui::Checkbox("Per mesh light lists", &perMeshLightLists);
+        if (perMeshLightLists)
+        {
+            auto& listStats = lightLists.GetStats();
+            ImGui::Text("%i lists, %.1f lights avg, %i max (%i clipped at %i)", listStats.lists, listStats.lists > 0 ? (float)listStats.totalLights / listStats.lists : 0.0f,
+                listStats.maxLights, listStats.clippedLists, LightLists::MAX_LIGHTS_PER_LIST);
+            ImGui::Text("spot light reaches %i meshes, build: %.3f ms", listStats.spotLists, listStats.buildMs);
+            ImGui::Text("(render queue draws only, multi draw and deferred use the clusters)");
+        }
+
+        ImGui::Separator();
+        ImGui::Checkbox("Cascaded shadows", &shadows);
+        if (shadows)
+        {
+            ImGui::SliderFloat3("Sun direction", &sunLight.direction.x, -1.0f, 1.0f);
+            if (glm::length(sunLight.direction) < 0.01f)
+            {
+                sunLight.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+            }
+            ImGui::SliderFloat("Shadow distance", &shadowDistance, 5.0f, farPlane);
+            auto& shadowStats = shadowMap.GetStats();
+            ImGui::Text("cascades rendered: %i, cached: %i", shadowStats.renderedCascades, shadowStats.cachedCascades);
+            for (int cascade = 0; cascade < CascadedShadowMap::CASCADE_COUNT; cascade++)
+            {
+                ImGui::Text("%s: %i draws%s", shadowCascadeNames[cascade], shadowCasterDraws[cascade], shadowMap.NeedsRender(cascade) ? "" : " (cached)");
+            }
+        }
+        ImGui::Checkbox("Point/spot light shadows", &localShadows);
+        if (localShadows)
+        {
+            ImGui::SliderInt("Tiles per frame", &shadowAtlas.tileBudget, 1, 96);
+            auto& atlasStats = shadowAtlas.GetStats();
+            ImGui::Text("shadowed lights: %i (max %i)", atlasStats.shadowedLights, ShadowAtlas::MAX_SHADOWED_LIGHTS);
+            ImGui::Text("tiles rendered: %i, cached: %i, stale: %i (%i draws)", atlasStats.renderedTiles, atlasStats.cachedTiles, atlasStats.staleTiles, shadowAtlasDraws);
+            for (int level = 0; level < ShadowAtlas::LEVEL_COUNT; level++)
+            {
+                ImGui::Text("%ipx tiles: %i/%i", ShadowAtlas::TILE_SIZES[level], atlasStats.usedSlots[level], atlasStats.slotCounts[level]);
+            }
+        }
+
+        ImGui::Separator();
+        ImGui::Checkbox("Irradiance probes", &irradianceProbes);
+        if (irradianceProbes)
+        {
+            auto& probeStats = probes.GetStats();
+            ImGui::Text("probes: %i x %i x %i, %i inside geometry", probeStats.counts.x, probeStats.counts.y, probeStats.counts.z, probeStats.insideProbes);
+            ImGui::Text("bake: %.1f ms (+ %.1f ms bvh), %i rays per probe", probeStats.bakeMs, probeBvhMs, probes.raysPerProbe);
+            ImGui::SliderFloat("Probe spacing", &probes.probeSpacing, 1.0f, 10.0f);
+            if (ImGui::Button("Rebake probes"))
+            {
+                bakeProbes(); // picks up the current sun direction
+            }
+        }
+
+        ImGui::Separator();
+        ImGui::Checkbox("SSAO (half res)", &ssaoEnabled);
+        if (ssaoEnabled)
+        {
+            if (!deferred && !depthPrepass)
+            {
+                ImGui::Text("needs the depth pre-pass or deferred shading");
+            }
+            float ssaoMs = GpuProfiler::Get().GetMs("ssao");
+            ImGui::Text("ssao: %.3f ms, %.1f%% of the frame (budget %.0f%%)", ssaoMs, msPerFrame > 0.0f ? 100.0f * ssaoMs / msPerFrame : 0.0f, 100.0f * ssao.budgetFraction);
+            ImGui::Text("%i x %i, %i samples", ssao.GetWidth(), ssao.GetHeight(), ssao.sampleCount);
+            ImGui::SliderFloat("AO radius", &ssao.radius, 0.1f, 2.0f);
+            ImGui::SliderFloat("AO power", &ssao.power, 0.5f, 4.0f);
+            ImGui::Checkbox("Fit samples to budget", &ssao.fitToBudget);
+            if (ssao.fitToBudget)
+            {
+                ImGui::SliderFloat("AO budget", &ssao.budgetFraction, 0.02f, 0.25f);
+            }
+            else
+            {
+                ImGui::SliderInt("AO samples", &ssao.sampleCount, SSAO::MIN_SAMPLES, SSAO::MAX_SAMPLES);
+            }
+        }
+
+        ImGui::Separator();
+        ImGui::Checkbox("Parallel draw list build", &parallelDrawList);
+        ImGui::Text("draw list build: %.3f ms", drawListBuildMs);
+        if (ImGui::Button("Benchmark draw list build (50k objects)") && !sceneMeshes.empty())
+        {
+            // the scene's meshes over and over, no culling, so only the key generation and packing is measured
+            const int BENCHMARK_OBJECTS = 50000, BENCHMARK_RUNS = 10;
+            RenderQueue benchmarkQueue;
+            auto submitBenchmarkMesh = [&](int index, auto& target)
+            {
+                SceneMesh& sceneMesh = sceneMeshes[index % sceneMeshes.size()];
+                RenderPass pass = RenderPassForAlpha(sceneMesh.mesh->alphaMode);
+                target.Submit(pass, *passShaders[(int)pass], *sceneMesh.mesh, sceneMesh.objectIndex, sceneMesh.mesh->GetMaterialID());
+            };
+
+            auto start = std::chrono::steady_clock::now();
+            for (int run = 0; run < BENCHMARK_RUNS; run++)
+            {
+                benchmarkQueue.Begin(camera.GetViewMatrix(), farPlane);
+                for (int i = 0; i < BENCHMARK_OBJECTS; i++)
+                {
+                    submitBenchmarkMesh(i, benchmarkQueue);
+                }
+            }
+            drawListSerialMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() / BENCHMARK_RUNS;
+
+            start = std::chrono::steady_clock::now();
+            for (int run = 0; run < BENCHMARK_RUNS; run++)
+            {
+                benchmarkQueue.Begin(camera.GetViewMatrix(), farPlane);
+                benchmarkQueue.BuildParallel(BENCHMARK_OBJECTS, DRAW_LIST_BATCH_SIZE, [&](int index, DrawList& list) { submitBenchmarkMesh(index, list); });
+            }
+            drawListParallelMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() / BENCHMARK_RUNS;
+
+            std::cout << "(Render Queue): " << BENCHMARK_OBJECTS << " objects, serial " << drawListSerialMs << " ms, parallel "
+                << drawListParallelMs << " ms (" << JobSystem::Get().GetThreadCount() << " threads)" << std::endl;
+        }
+        if (drawListSerialMs > 0.0f)
+        {
+            ImGui::Text("serial: %.3f ms, parallel: %.3f ms, %i threads", drawListSerialMs, drawListParallelMs, JobSystem::Get().GetThreadCount());
+        }
+        ImGui::Checkbox("CPU occlusion culling", &occlusionCulling);
+        if (occlusionCulling)
+        {
+            auto& occlusionStats = occlusionCuller.GetStats();
+            ImGui::Text("rejected: %.1f%% of draws (%i/%i)", occlusionCandidates > 0 ? 100.0f * occlusionRejected / occlusionCandidates : 0.0f, occlusionRejected, occlusionCandidates);
+            ImGui::Text("raster: %.3f ms, test: %.3f ms, %i threads", occlusionStats.rasterMs, occlusionStats.testMs, JobSystem::Get().GetThreadCount());
+            ImGui::Text("occluder triangles: %i", occlusionStats.occluderTriangles);
+        }
+        ImGui::Checkbox("Multi-draw indirect", &multiDraw);
+        if (ImGui::Checkbox("Instanced ore stress test (100k)", &oreStressTest) && oreStressTest && oreInstances.GetCount() == 0)
+        {
+            // filled once, the batch only uploads again if it changes
+            for (int x = 0; x < ORE_GRID_X; x++)
+            {
+                for (int y = 0; y < ORE_GRID_Y; y++)
+                {
+                    for (int z = 0; z < ORE_GRID_Z; z++)
+                    {
+                        glm::mat4 instance = glm::translate(glm::mat4(1.0f), glm::vec3(2.0f * x + 4.0f, -2.0f * y - 4.0f, -2.0f * z));
+                        oreInstances.Add(instance);
+                    }
+                }
+            }
+        }
+        if (oreStressTest)
+        {
+            ImGui::Text("instances: %i, draw calls: %i", (int)oreInstances.GetCount(), oreDrawCalls);
+            ImGui::Text("frame: %.3f ms (%i fps)", msPerFrame, fps);
+        }
+        if (multiDraw)
+        {
+            ImGui::Checkbox("GPU frustum culling", &gpuCulling);
+            if (gpuCulling)
+            {
+                int total = staticDraws.GetDrawCount(RenderPass::OPAQUE) + staticDraws.GetDrawCount(RenderPass::CUTOUT);
+                int visible = staticDraws.GetVisibleCount(RenderPass::OPAQUE) + staticDraws.GetVisibleCount(RenderPass::CUTOUT);
+                ImGui::Text("visible: %i, culled: %i", visible, total - visible);
+
+                ImGui::Checkbox("Hi-Z occlusion culling", &hiZCulling);
+                if (hiZCulling)
+                {
+                    int secondPhase = staticDraws.GetSecondPhaseCount(RenderPass::OPAQUE) + staticDraws.GetSecondPhaseCount(RenderPass::CUTOUT);
+                    ImGui::Text("drawn in second phase: %i", secondPhase);
+                    ImGui::Checkbox("Show depth pyramid", &hiZDebugView);
+                    if (hiZDebugView && hiZ.GetLevelCount() > 0)
+                    {
+                        ImGui::SliderInt("Level", &hiZDebugLevel, 0, hiZ.GetLevelCount() - 1);
+                        ImGui::Text("%i x %i", hiZ.GetLevelWidth(hiZDebugLevel), hiZ.GetLevelHeight(hiZDebugLevel));
+                        // gl textures start at the bottom
+                        ImGui::Image((ImTextureID)hiZ.GetDebugTextureID(), ImVec2(HiZBuffer::DEBUG_WIDTH, HiZBuffer::DEBUG_HEIGHT), ImVec2(0, 1), ImVec2(1, 0));
+                    }
+                }
+            }
+        }
+
+        ImGui::Separator();
+        ImGui::Text("GPU timings");
+        for (auto& scope : GpuProfiler::Get().GetScopes())
+        {
+            ImGui::Text("%s: %.3f ms", scope.name.c_str(), scope.avgMs);
+        }
+        auto& ringStats = DynamicRingBuffer::Get().GetStats();
+        ImGui::Text("ring buffer: %.1f KB/frame (peak %.1f KB)", ringStats.usedBytes / 1024.0f, ringStats.peakBytes / 1024.0f);
+        ImGui::Text("fence stalls: %i frames, %.3f ms total", ringStats.stalledFrames, ringStats.totalStallMs);
+        if (GpuProfiler::Get().IsCapturing())
+        {
+            ImGui::Text("Capturing...");
+        }
+        else if (ImGui::Button("Capture 300 frames"))
+        {
+            GpuProfiler::Get().StartCapture(300);
+        }
+
+        ImGui::Separator();
+        ImGui::Text("Render passes");
+        auto& queueStats = renderQueue.GetStats();
+        for (int pass = 0; pass < (int)RenderPass::COUNT; pass++)
+        {
+            int draws = queueStats.draws[pass];
+            if (multiDraw && (RenderPass)pass != RenderPass::BLENDED && (depthPrepass || (RenderPass)pass != RenderPass::DEPTH_PREPASS))
+            {
+                draws += staticDraws.GetDrawCount(pass == (int)RenderPass::DEPTH_PREPASS ? RenderPass::OPAQUE : (RenderPass)pass);
+            }
+            ImGui::Text("%s: %i draws, %llu fragments", renderPassNames[pass], draws, (unsigned long long)GpuProfiler::Get().GetSamples(renderPassNames[pass]));
+        }
+        ImGui::Text("State changes (issued/skipped)");
+        ImGui::Text("programs: %i/%i", queueStats.programBinds, queueStats.programSkips);
+        ImGui::Text("materials: %i/%i", queueStats.materialBinds, queueStats.materialSkips);
+        ImGui::Text("vertex arrays: %i/%i", queueStats.vaoBinds, queueStats.vaoSkips);
+        auto& glStats = GLState::Get().GetStats();
+        ImGui::Text("gl calls (last frame): %i/%i", glStats.issued, glStats.skipped);
+
+        ImGui::Separator();
+        ImGui::Text("Shader compile times");
+        for (Shader* shader : {&objectShader, &alphaTestShader, &multiDrawShader, &multiDrawAlphaTestShader, &lightSourceShader, &depthShader, &cullShader, &hiZShader, &clusterShader,
+            &deferredShader, &deferredAlphaTestShader, &multiDrawDeferredShader, &multiDrawDeferredAlphaTestShader, &deferredLightingShader, &shadowShader, &shadowAlphaTestShader,
+            &lightmapShader, &lightmapAlphaTestShader, &bakedShader, &bakedAlphaTestShader, &ssaoShader})
+        {
+            ImGui::Text("%s: %.2f ms%s", shader->GetName().c_str(), shader->compileTimeMs, shaderReloader.IsCompiling(*shader) ? " (compiling...)" : "");
+        }
         
         ImGui::Separator();
         ImGui::Text("Keymaps");
@@ -269,94 +877,412 @@ int main()
         glClearColor(0.2f, 0.3f, 0.6f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); //clear color + depth buffer
 
-        objectShader.use();
-
         glm::mat4 view = camera.GetViewMatrix();
-        objectShader.setMat4("view", view);
         
         glm::mat4 projection;
-        projection = glm::perspective(glm::radians(85.0f), (float)viewWidth / viewHeight, 0.1f, 100.0f);
-        objectShader.setMat4("projection", projection);
-        
-        
-        // lighting
-        objectShader.setVec3("viewPos", camera.position);
-
-        // directional light
-        objectShader.setVec3("dirLight.direction", glm::vec3(-0.2f, -1.0f, -0.3f));
-        objectShader.setVec3("dirLight.ambient", glm::vec3(0.05f, 0.05f, 0.05f));
-        objectShader.setVec3("dirLight.diffuse", glm::vec3(0.4f, 0.4f, 0.4f));
-        objectShader.setVec3("dirLight.specular", glm::vec3(0.5f, 0.5f, 0.5f));
-
-        // point light
-        objectShader.setVec3("pointLights[0].position", pointLightPos[0]);
-        objectShader.setVec3("pointLights[0].ambient", glm::vec3(0.05f, 0.05f, 0.05f));
-        objectShader.setVec3("pointLights[0].diffuse", glm::vec3(0.8f, 0.8f, 0.8f));
-        objectShader.setVec3("pointLights[0].specular", glm::vec3(1.0f, 1.0f, 1.0f));
-        objectShader.setFloat("pointLights[0].constant", 1.0f);
-        objectShader.setFloat("pointLights[0].linear", 0.027f);
-        objectShader.setFloat("pointLights[0].quadratic", 0.0028f);
-
-        // spot light
-        objectShader.setVec3("spotLight.position", glm::vec3(0.0f, 1.0f, 4.0f));
-        objectShader.setVec3("spotLight.direction", glm::vec3(1.0f, 0.0f, 0.0f));
-        objectShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-        objectShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(17.5f)));
-        objectShader.setVec3("spotLight.ambient", glm::vec3(0.05f, 0.05f, 0.05f));
-        objectShader.setVec3("spotLight.diffuse", glm::vec3(1.0f, 1.0f, 1.0f));
-        objectShader.setVec3("spotLight.specular", glm::vec3(1.0f, 1.0f, 1.0f));
-        objectShader.setFloat("spotLight.constant", 1.0f);
-        objectShader.setFloat("spotLight.linear", 0.14f);
-        objectShader.setFloat("spotLight.quadratic", 0.07f);
+        projection = glm::perspective(glm::radians(85.0f), (float)viewWidth / viewHeight, nearPlane, farPlane);
+        lastViewProjection = projection * view;
 
+        // camera data goes into one uniform block for every shader instead of glUniform calls per program
+        auto frameAllocation = DynamicRingBuffer::Get().AllocateUniform(sizeof(FrameData));
+        if (frameAllocation.data)
+        {
+            GLint viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            FrameData frameData = {view, projection, camera.position, nearPlane, glm::vec4(viewport[0], viewport[1], viewport[2], viewport[3]), farPlane};
+            std::memcpy(frameAllocation.data, &frameData, sizeof(FrameData));
+            GLState::Get().BindBufferRange(GL_UNIFORM_BUFFER, FRAME_UBO_BINDING, frameAllocation.buffer, frameAllocation.offset, frameAllocation.size);
+        }
+
+        // every shader that lights surfaces needs the same per frame uniforms
+        for (Shader* shader : {&objectShader, &alphaTestShader, &multiDrawShader, &multiDrawAlphaTestShader, &deferredLightingShader})
+        {
+            shader->use();
+
+            // directional light
+            shader->setVec3("dirLight.direction", sunLight.direction);
+            shader->setVec3("dirLight.ambient", sunLight.ambient);
+            shader->setVec3("dirLight.diffuse", sunLight.diffuse);
+            shader->setVec3("dirLight.specular", sunLight.specular);
+
+            // spot light
+            shader->setVec3("spotLight.position", spotLight.position);
+            shader->setVec3("spotLight.direction", spotLight.direction);
+            shader->setFloat("spotLight.cutOff", glm::cos(glm::radians(spotLight.cutOff)));
+            shader->setFloat("spotLight.outerCutOff", glm::cos(glm::radians(spotLight.outerCutOff)));
+            shader->setVec3("spotLight.ambient", spotLight.ambient);
+            shader->setVec3("spotLight.diffuse", spotLight.diffuse);
+            shader->setVec3("spotLight.specular", spotLight.specular);
+            shader->setFloat("spotLight.constant", spotLight.constant);
+            shader->setFloat("spotLight.linear", spotLight.linear);
+            shader->setFloat("spotLight.quadratic", spotLight.quadratic);
+        }
+
+
+        // point lights bob up and down a bit so the clusters actually change every frame
+        pointLights.assign(basePointLights.begin(), basePointLights.begin() + pointLightCount);
+        if (animateLights)
+        {
+            for (int i = 1; i < pointLights.size(); i++)
+            {
+                pointLights[i].position.y += 0.5f * std::sin(currentFrame * 1.5f + i);
+            }
+        }
+        GpuProfiler::Get().Begin("light clustering");
+        clusteredLights.Build(clusterShader, pointLights);
+        GpuProfiler::Get().End("light clustering");
+        // a failed build leaves last frame's ranges bound, the draws use the clusters then
+        bool useLightLists = perMeshLightLists && lightLists.Build(sceneMeshCenters, sceneMeshExtents, pointLights, clusteredLights.GetLightCount(), spotLight, SpotLightRadius(spotLight));
         
-        glm::mat4 model = glm::mat4(1.0f);
-        // for (unsigned int x = 0; x < 16; x++)
-        // {
-        //     for (unsigned int y = 0; y < 16; y++)
-        //     {
-        //         for (unsigned int z = 0; z < 16; z++)
-        //         {
-        //             model = glm::mat4(1.0f);
-        //             model = glm::translate(model, glm::vec3(1.0f * x, -1.0f * y, -1.0f * z));
-                    
-        //             objectShader.setMat4("model", model);
-                    
-        //             glBindVertexArray(VAO);
-        //             glDrawArrays(GL_TRIANGLES, 0, 36);
-        //         }
-        //     }
-        // }
-        
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.025f, 0.025f, 0.025f));
-        objectShader.setMat4("model", model);
-        windfall.Draw(objectShader);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, -2.0f, 2.0f));
-        objectShader.setMat4("model", model);
-        goldOre.Draw(objectShader);
+        TransformBuffer::Get().Upload();
+
+        // every shadow map pass culls against its own frustum and draws the non blended scene meshes depth only,
+        // opaque casters first, then the alpha tested ones, so each program is only bound once.
+        // the camera's cull further down overwrites the culling results
+        auto drawShadowCasters = [&](const glm::mat4& lightViewProjection, bool staticOnly)
+        {
+            frustumCuller.Cull(Frustum(lightViewProjection));
+
+            int draws = 0;
+            for (Shader* shader : {&shadowShader, &shadowAlphaTestShader})
+            {
+                bool alphaTest = shader == &shadowAlphaTestShader;
+                shader->use();
+                shader->setMat4("lightViewProjection", lightViewProjection);
+                for (auto& sceneMesh : sceneMeshes)
+                {
+                    Mesh& mesh = *sceneMesh.mesh;
+                    RenderPass pass = RenderPassForAlpha(mesh.alphaMode);
+                    if (pass == RenderPass::BLENDED || (pass == RenderPass::CUTOUT) != alphaTest)
+                        continue;
+                    if (staticOnly && !sceneMesh.isStatic)
+                        continue;
+                    if (!frustumCuller.IsVisible(sceneMesh.cullIndex))
+                        continue;
+
+                    if (alphaTest)
+                    {
+                        shader->setInt("materialID", mesh.GetMaterialID());
+                    }
+                    const GeometryRange& geometry = mesh.GetGeometry();
+                    glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, geometry.indexCount, GL_UNSIGNED_INT,
+                        (void*)(geometry.firstIndex * sizeof(unsigned int)), 1, geometry.baseVertex, sceneMesh.objectIndex);
+                    draws++;
+                }
+            }
+            return draws;
+        };
+        if (shadows || localShadows)
+        {
+            MaterialManager::Get().Upload(); // the alpha tested casters look their material up by index
+            GLState::Get().BindTexture(0, GL_TEXTURE_2D_ARRAY, texArrayID);
+            GLState::Get().BindVertexArray(GeometryBuffer::Get().GetVAO());
+        }
+
+        if (shadows)
+        {
+            shadowMap.Update(view, glm::radians(85.0f), (float)viewWidth / viewHeight, nearPlane, shadowDistance, sunLight.direction, TransformBuffer::Get().GetVersion());
+
+            shadowMap.Begin();
+            for (int cascade = 0; cascade < CascadedShadowMap::CASCADE_COUNT; cascade++)
+            {
+                if (!shadowMap.NeedsRender(cascade))
+                    continue;
+
+                GpuProfiler::Get().Begin(shadowCascadeNames[cascade]);
+                shadowMap.BeginCascade(cascade);
+                shadowCasterDraws[cascade] = drawShadowCasters(shadowMap.GetViewProjection(cascade), shadowMap.IsCached(cascade));
+
+                GpuProfiler::Get().End(shadowCascadeNames[cascade]);
+            }
+            shadowMap.End();
+        }
+        shadowMap.BindForSampling(shadows);
+
+        if (localShadows)
+        {
+            GpuProfiler::Get().Begin("shadow atlas");
+            shadowAtlas.Update(camera.position, Frustum(projection * view), pointLights, spotShadowCaster, TransformBuffer::Get().GetVersion());
+
+            // tiles are cached, so they only get the static meshes too
+            shadowAtlasDraws = 0;
+            shadowAtlas.Begin();
+            for (auto& tile : shadowAtlas.GetRenderList())
+            {
+                shadowAtlas.BeginTile(tile);
+                shadowAtlasDraws += drawShadowCasters(tile.viewProjection, true);
+            }
+            shadowAtlas.End();
+            GpuProfiler::Get().End("shadow atlas");
+        }
+        shadowAtlas.BindForSampling(localShadows, clusteredLights.GetLightCount());
+        probes.Bind(irradianceProbes);
+        ssao.Bind(false);
+
+        bool culled = multiDraw && gpuCulling;
+        bool twoPhase = culled && hiZCulling;
+        if (culled)
+        {
+            GpuProfiler::Get().Begin("gpu culling");
+            staticDraws.Cull(cullShader, projection * view, twoPhase ? CullMode::HIZ_FIRST_PHASE : CullMode::FRUSTUM);
+            GpuProfiler::Get().End("gpu culling");
+        }
+
+        GpuProfiler::Get().Begin("scene");
+
+        // every mesh is submitted as a sort key, the queue orders them by pass/program/material/geometry/depth
+        // and skips state that is already bound. opaque meshes have no discard so early depth testing works for them,
+        // alpha tested ones go on top after
+        if (cpuCulling)
+        {
+            auto cullStart = std::chrono::steady_clock::now();
+            cpuVisibleCount = frustumCuller.Cull(Frustum(projection * view));
+            cpuCullMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - cullStart).count();
+        }
+        if (occlusionCulling)
+        {
+            occlusionCuller.Cull(projection * view);
+        }
+        // per mesh culling checks and sort key generation, shared by the serial and parallel build
+        std::atomic<int> candidates{0}, rejected{0};
+        bool useLightmaps = bakedLightmaps && !multiDraw && !deferred;
+        bool useVertexColors = vertexColorLighting && !multiDraw && !deferred;
+        if (useLightmaps)
+        {
+            lightmaps.Bind();
+        }
+        auto submitSceneMesh = [&](int index, auto& target)
+        {
+            SceneMesh& sceneMesh = sceneMeshes[index];
+            Mesh& mesh = *sceneMesh.mesh;
+            RenderPass pass = RenderPassForAlpha(mesh.alphaMode);
+            if (multiDraw && pass != RenderPass::BLENDED)
+                return; // already in staticDraws
+            if (cpuCulling && !frustumCuller.IsVisible(sceneMesh.cullIndex))
+                return;
+            if (occlusionCulling)
+            {
+                candidates++;
+                if (occlusionCuller.IsOccluded(sceneMesh.occludeeIndex))
+                {
+                    rejected++;
+                    return;
+                }
+            }
+
+            Shader* shader = passShaders[(int)pass];
+            if (useLightmaps && mesh.lightmapped)
+            {
+                shader = pass == RenderPass::OPAQUE ? &lightmapShader : &lightmapAlphaTestShader;
+            }
+            else if (useVertexColors && mesh.vertexColored)
+            {
+                shader = pass == RenderPass::OPAQUE ? &bakedShader : &bakedAlphaTestShader;
+            }
+            target.Submit(pass, *shader, mesh, sceneMesh.objectIndex, mesh.GetMaterialID(), useLightLists ? index : -1);
+
+            if (depthPrepass && pass == RenderPass::OPAQUE)
+            {
+                target.Submit(RenderPass::DEPTH_PREPASS, depthShader, mesh, sceneMesh.objectIndex, MaterialManager::NO_MATERIAL);
+            }
+        };
+
+        passShaders[(int)RenderPass::OPAQUE] = deferred ? &deferredShader : &objectShader;
+        passShaders[(int)RenderPass::CUTOUT] = deferred ? &deferredAlphaTestShader : &alphaTestShader;
+
+        auto buildStart = std::chrono::steady_clock::now();
+        renderQueue.Begin(view, farPlane);
+        if (parallelDrawList)
+        {
+            renderQueue.BuildParallel(sceneMeshes.size(), DRAW_LIST_BATCH_SIZE, [&](int index, DrawList& list) { submitSceneMesh(index, list); });
+        }
+        else
+        {
+            for (int i = 0; i < sceneMeshes.size(); i++)
+            {
+                submitSceneMesh(i, renderQueue);
+            }
+        }
+        drawListBuildMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+        occlusionCandidates = candidates;
+        occlusionRejected = rejected;
+        renderQueue.Sort();
+
+        // profile is off for passes that run a second time in the frame, the profiler keeps one query per name
+        auto beginPass = [&](RenderPass pass, bool profile = true)
+        {
+            if (profile)
+            {
+                GpuProfiler::Get().Begin(renderPassNames[(int)pass]);
+                if (pass != RenderPass::DEPTH_PREPASS)
+                    GpuProfiler::Get().BeginSamples(renderPassNames[(int)pass]);
+            }
+
+            if (pass == RenderPass::DEPTH_PREPASS)
+            {
+                GLState::Get().ColorMask(false);
+            }
+            if (pass == RenderPass::OPAQUE && depthPrepass)
+            {
+                // depth is already final, only shade the fragments that won
+                GLState::Get().DepthFunc(GL_EQUAL);
+                GLState::Get().DepthMask(false);
+            }
+            if (pass == RenderPass::BLENDED)
+            {
+                GLState::Get().SetEnabled(GL_BLEND, true);
+                GLState::Get().BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                GLState::Get().DepthMask(false);
+            }
+        };
+        auto endPass = [&](RenderPass pass, bool profile = true)
+        {
+            if (pass == RenderPass::DEPTH_PREPASS)
+            {
+                GLState::Get().ColorMask(true);
+            }
+            if (pass == RenderPass::OPAQUE && depthPrepass)
+            {
+                GLState::Get().DepthFunc(GL_LESS);
+                GLState::Get().DepthMask(true);
+            }
+            if (pass == RenderPass::BLENDED)
+            {
+                GLState::Get().SetEnabled(GL_BLEND, false);
+                GLState::Get().DepthMask(true);
+            }
+
+            if (profile)
+            {
+                if (pass != RenderPass::DEPTH_PREPASS)
+                    GpuProfiler::Get().EndSamples(renderPassNames[(int)pass]);
+                GpuProfiler::Get().End(renderPassNames[(int)pass]);
+            }
+        };
+        auto drawStaticDepth = [&](int phase)
+        {
+            if (!depthPrepass)
+                return;
+
+            bool profile = phase == 0;
+            beginPass(RenderPass::DEPTH_PREPASS, profile);
+            staticDraws.Draw(RenderPass::OPAQUE, depthShader, culled, phase);
+            endPass(RenderPass::DEPTH_PREPASS, profile);
+        };
+        auto drawStaticShaded = [&](int phase)
+        {
+            bool profile = phase == 0;
+            beginPass(RenderPass::OPAQUE, profile);
+            staticDraws.Draw(RenderPass::OPAQUE, deferred ? multiDrawDeferredShader : multiDrawShader, culled, phase);
+            endPass(RenderPass::OPAQUE, profile);
+
+            beginPass(RenderPass::CUTOUT, profile);
+            staticDraws.Draw(RenderPass::CUTOUT, deferred ? multiDrawDeferredAlphaTestShader : multiDrawAlphaTestShader, culled, phase);
+            endPass(RenderPass::CUTOUT, profile);
+        };
+
+        if (deferred)
+        {
+            GpuProfiler::Get().Begin("g-buffer");
+            gBuffer.Begin();
+        }
+        // with the pre-pass every phase's depth (and the render queue's) is drawn before anything is shaded,
+        // so the forward ao sees all of it. the hi-z pyramid is built from the pre-pass depth then, which has no cutouts
+        if (multiDraw)
+        {
+            drawStaticDepth(0);
+            if (!depthPrepass)
+                drawStaticShaded(0);
+
+            if (twoPhase)
+            {
+                // pyramid from the first phase's depth, then draw whatever it shows was wrongly skipped
+                GpuProfiler::Get().Begin("hi-z second phase");
+                hiZ.Build(hiZShader);
+                staticDraws.Cull(cullShader, projection * view, CullMode::HIZ_SECOND_PHASE, &hiZ);
+                drawStaticDepth(1);
+                if (!depthPrepass)
+                    drawStaticShaded(1);
+                GpuProfiler::Get().End("hi-z second phase");
+
+                if (hiZDebugView)
+                {
+                    hiZ.RenderDebugView(hiZShader, hiZDebugLevel, nearPlane, farPlane);
+                }
+            }
+        }
+        renderQueue.Execute(beginPass, endPass, RenderPass::DEPTH_PREPASS, RenderPass::DEPTH_PREPASS);
+
+        // forward ao from the finished pre-pass depth. ore instances and blended meshes arent in it, they get none
+        if (ssaoEnabled && !deferred && depthPrepass)
+        {
+            GpuProfiler::Get().Begin("ssao");
+            ssao.ComputeFromFramebuffer(ssaoShader, projection);
+            GpuProfiler::Get().End("ssao");
+        }
+
+        if (multiDraw && depthPrepass)
+        {
+            drawStaticShaded(0);
+            if (twoPhase)
+                drawStaticShaded(1);
+        }
+        renderQueue.Execute(beginPass, endPass, RenderPass::OPAQUE, RenderPass::CUTOUT);
+
+        if (oreStressTest)
+        {
+            GpuProfiler::Get().Begin("ore instances");
+            oreDrawCalls = oreInstances.Draw(RenderPass::OPAQUE, *passShaders[(int)RenderPass::OPAQUE]);
+            oreDrawCalls += oreInstances.Draw(RenderPass::CUTOUT, *passShaders[(int)RenderPass::CUTOUT]);
+            GpuProfiler::Get().End("ore instances");
+        }
+
+        if (deferred)
+        {
+            gBuffer.End();
+            GpuProfiler::Get().End("g-buffer");
+
+            if (ssaoEnabled)
+            {
+                GpuProfiler::Get().Begin("ssao");
+                ssao.ComputeFromTexture(ssaoShader, projection, gBuffer.GetDepthTexture());
+                GpuProfiler::Get().End("ssao");
+            }
+
+            // every light in one fullscreen pass, it writes the g-buffer's depth into the default framebuffer too
+            GpuProfiler::Get().Begin("deferred lighting");
+            deferredLightingShader.use();
+            deferredLightingShader.setMat4("inverseViewProjection", glm::inverse(projection * view));
+            gBuffer.BindTextures(deferredLightingShader);
+            GLState::Get().DepthFunc(GL_ALWAYS);
+            GLState::Get().BindVertexArray(fullscreenVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            GLState::Get().DepthFunc(GL_LESS);
+            GpuProfiler::Get().End("deferred lighting");
+        }
+
+        renderQueue.Execute(beginPass, endPass, RenderPass::BLENDED, RenderPass::BLENDED);
+
+        GpuProfiler::Get().End("scene");
+
+        if (ssaoEnabled)
+        {
+            ssao.FitToBudget(GpuProfiler::Get().GetMs("ssao"), msPerFrame);
+        }
         
         
-        glBindVertexArray(lightVAO);
+        GLState::Get().BindVertexArray(lightVAO);
         lightSourceShader.use();
-        lightSourceShader.setMat4("projection", projection);
-        lightSourceShader.setMat4("view", view);
         
         // drawing all light object cube thingies
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, pointLightPos[0]);
-        lightSourceShader.setMat4("model", model);
-
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, 36, 1, lightCubeObject);
         
 
         // imgui
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
+        DynamicRingBuffer::Get().EndFrame();
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
@@ -365,7 +1291,30 @@ int main()
     // glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     objectShader.deleteProgram();
+    alphaTestShader.deleteProgram();
+    multiDrawShader.deleteProgram();
+    multiDrawAlphaTestShader.deleteProgram();
     lightSourceShader.deleteProgram();
+    depthShader.deleteProgram();
+    shadowShader.deleteProgram();
+    shadowAlphaTestShader.deleteProgram();
+    cullShader.deleteProgram();
+    hiZShader.deleteProgram();
+    clusterShader.deleteProgram();
+    deferredShader.deleteProgram();
+    deferredAlphaTestShader.deleteProgram();
+    multiDrawDeferredShader.deleteProgram();
+    multiDrawDeferredAlphaTestShader.deleteProgram();
+    deferredLightingShader.deleteProgram();
+    lightmapShader.deleteProgram();
+    lightmapAlphaTestShader.deleteProgram();
+    bakedShader.deleteProgram();
+    bakedAlphaTestShader.deleteProgram();
+    lightmaps.Delete();
+    probes.Delete();
+    ssaoShader.deleteProgram();
+    ssao.Delete();
+    shaderReloader.Shutdown();
 
     // imgui
     ImGui_ImplOpenGL3_Shutdown();
@@ -402,10 +1351,7 @@ void update(GLFWwindow* window)
     {
         wireframe = !wireframe;
 
-        if (wireframe)
-            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        else
-            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        GLState::Get().PolygonMode(wireframe ? GL_LINE : GL_FILL);
     }
 
 
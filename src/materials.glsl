@@ -0,0 +1,33 @@
+#pragma once
+
+// matches Material in materials.hpp
+struct Material
+{
+    int diffuseStartLayer;
+    int diffuseLayerCount;
+    int specularStartLayer;
+    int specularLayerCount;
+    int emissionStartLayer;
+    int emissionLayerCount;
+
+    float emissionStrength;
+    float shininess;
+};
+
+#if defined(MULTI_DRAW) || defined(MATERIAL_BUFFER)
+// the multi draw variant looks the material up per draw, see IndirectDrawList in indirect_draw.hpp.
+// MATERIAL_BUFFER shaders only want the buffer, they get the index some other way
+layout (std430, binding = 1) readonly buffer Materials
+{
+    Material materials[];
+};
+#endif
+
+#ifdef MULTI_DRAW
+layout (std430, binding = 2) readonly buffer DrawMaterials
+{
+    uint drawMaterials[];
+};
+#elif !defined(MATERIAL_BUFFER)
+uniform Material material;
+#endif
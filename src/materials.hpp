@@ -0,0 +1,114 @@
+#pragma once
+
+#include "../lib/glad.h"
+
+#include "shader.hpp"
+#include "gl_state.hpp"
+
+#include <vector>
+
+
+// ssbo binding point of the material records, has to match materials.glsl
+const GLuint MATERIAL_SSBO_BINDING = 1;
+
+// which texture array layers a mesh samples and how it is lit.
+// matches the std430 layout of the Material struct in materials.glsl, so the whole list can be uploaded as is
+struct Material
+{
+    int diffuseStartLayer = 0;
+    int diffuseLayerCount = 0;
+    int specularStartLayer = 0;
+    int specularLayerCount = 0;
+    int emissionStartLayer = 0;
+    int emissionLayerCount = 0;
+    float emissionStrength = 1.0f;
+    float shininess = 128.0f;
+
+    bool operator==(const Material& other) const
+    {
+        return diffuseStartLayer == other.diffuseStartLayer && diffuseLayerCount == other.diffuseLayerCount &&
+            specularStartLayer == other.specularStartLayer && specularLayerCount == other.specularLayerCount &&
+            emissionStartLayer == other.emissionStartLayer && emissionLayerCount == other.emissionLayerCount &&
+            emissionStrength == other.emissionStrength && shininess == other.shininess;
+    }
+};
+static_assert(sizeof(Material) == 32, "Material has to match the std430 layout in materials.glsl");
+
+
+// singleton
+// deduplicates materials so meshes that sample the same layers share an id, the render queue sorts by it
+class MaterialManager
+{
+public:
+    static MaterialManager& Get()
+    {
+        static MaterialManager instance;
+        return instance;
+    }
+
+    // id 0 is reserved for "no material" (depth only draws)
+    static const unsigned int NO_MATERIAL = 0;
+
+    unsigned int Register(const Material& material)
+    {
+        for (unsigned int i = 1; i < materials.size(); i++)
+        {
+            if (materials[i] == material)
+                return i;
+        }
+        materials.push_back(material);
+        return materials.size() - 1;
+    }
+
+    const Material& GetMaterial(unsigned int id) const
+    {
+        return materials[id];
+    }
+
+    unsigned int GetCount() const
+    {
+        return materials.size();
+    }
+
+    // material uniforms live in the program, so this has to be redone whenever the program changes
+    void Bind(Shader& shader, unsigned int id) const
+    {
+        const Material& material = materials[id];
+        shader.setInt("material.diffuseStartLayer", material.diffuseStartLayer);
+        shader.setInt("material.diffuseLayerCount", material.diffuseLayerCount);
+        shader.setInt("material.specularStartLayer", material.specularStartLayer);
+        shader.setInt("material.specularLayerCount", material.specularLayerCount);
+        shader.setInt("material.emissionStartLayer", material.emissionStartLayer);
+        shader.setInt("material.emissionLayerCount", material.emissionLayerCount);
+        shader.setFloat("material.emissionStrength", material.emissionStrength);
+        shader.setFloat("material.shininess", material.shininess);
+    }
+
+    // uploads every material for the multi draw path, which looks them up per draw instead of through uniforms.
+    // materials only get registered while loading so this only does anything the first time
+    void Upload()
+    {
+        if (ssbo == 0)
+        {
+            glGenBuffers(1, &ssbo);
+        }
+        GLState::Get().BindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_SSBO_BINDING, ssbo);
+
+        if (uploadedCount == materials.size())
+            return;
+
+        GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(Material), materials.data(), GL_STATIC_DRAW);
+        GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        uploadedCount = materials.size();
+    }
+
+private:
+    // private constructor so other instances cant be made
+    MaterialManager() : materials(1), ssbo(0), uploadedCount(0) {}
+
+    std::vector<Material> materials;
+
+    GLuint ssbo;
+    size_t uploadedCount;
+};
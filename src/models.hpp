@@ -11,18 +11,16 @@
 #include <assimp/postprocess.h>
 
 #include "shader.hpp"
+#include "gl_state.hpp"
 #include "textures.hpp"
+#include "materials.hpp"
+#include "geometry.hpp"
+#include "lightmap_file.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 
-struct Vertex
-{
-    glm::vec3 position;
-    glm::vec3 normal;
-    glm::vec2 texCoords;
-};
-
 enum class TextureType
 {
     DIFFUSE,
@@ -45,102 +43,147 @@ public:
     std::vector<unsigned int> indices;
     std::vector<Texture> textures;
 
+    // render bucket, the most transparent of the mesh's textures since the shader alpha tests all of them
+    AlphaMode alphaMode = AlphaMode::OPAQUE;
+
+    // has lightmap coords from a bake, drawn with the LIGHTMAP shaders when lightmaps are on
+    bool lightmapped = false;
+
+    // has imported vertex colors with the lighting baked in, drawn with the BAKED shaders when they are on
+    bool vertexColored = false;
 
-    Mesh(std::vector<Vertex>& _vertices, std::vector<unsigned int>& _indices, std::vector<Texture>& _textures)
+
+    Mesh(std::vector<Vertex>& _vertices, std::vector<unsigned int>& _indices, std::vector<Texture>& _textures, bool _lightmapped = false, bool _vertexColored = false)
     {
         vertices = _vertices;
         indices = _indices;
         textures = _textures;
+        lightmapped = _lightmapped;
+        vertexColored = _vertexColored;
+
+        for (auto& texture : textures)
+        {
+            alphaMode = std::max(alphaMode, TextureManager::Get().GetAlphaMode(texture.layer));
+        }
 
+        SetupMaterial();
         SetupMesh();
     }
 
-    void Draw(Shader &shader)
+    // objectIndex picks the record in the TransformBuffer the vertex shader uses
+    void Draw(Shader &shader, unsigned int objectIndex)
+    {
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D_ARRAY, TextureManager::Get().GetTexArrayID());
+
+        MaterialManager::Get().Bind(shader, materialID);
+
+        GLState::Get().BindVertexArray(GeometryBuffer::Get().GetVAO());
+        glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, geometry.indexCount, GL_UNSIGNED_INT,
+            (void*)(geometry.firstIndex * sizeof(unsigned int)), 1, geometry.baseVertex, objectIndex);
+    }
+
+    // every mesh shares the GeometryBuffer vao
+    GLuint GetVAO() const
+    {
+        return GeometryBuffer::Get().GetVAO();
+    }
+
+    const GeometryRange& GetGeometry() const
     {
-        GLuint texArrayID = TextureManager::Get().GetTexArrayID();
+        return geometry;
+    }
 
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D_ARRAY, texArrayID);
+    unsigned int GetMaterialID() const
+    {
+        return materialID;
+    }
 
-        int numDiffuse = 0;
-        int numSpecular = 0;
-        int numEmission = 0;
+    // what the cpu bakers use as its albedo, its diffuse textures' average colors added up like the shader does
+    glm::vec3 GetAlbedo() const
+    {
+        glm::vec3 albedo(0.0f);
+        int diffuseCount = 0;
+        for (auto& texture : textures)
+        {
+            if (texture.type == TextureType::DIFFUSE)
+            {
+                albedo += TextureManager::Get().GetAverageColor(texture.layer);
+                diffuseCount++;
+            }
+        }
+        return diffuseCount > 0 ? glm::min(albedo, glm::vec3(1.0f)) : glm::vec3(1.0f);
+    }
+
+    // model space bounds, for culling
+    const Bounds& GetBounds() const
+    {
+        return bounds;
+    }
+
+    // center of the mesh's bounding box in model space, used for depth sorting
+    glm::vec3 GetCenter() const
+    {
+        return bounds.GetCenter();
+    }
+
+    // radius of the bounding sphere around GetCenter()
+    float GetRadius() const
+    {
+        return bounds.radius;
+    }
+
+private:
+    GeometryRange geometry;
+
+    unsigned int materialID;
+    Bounds bounds;
+
+    // works out which layers of the texture array each texture type starts at
+    void SetupMaterial()
+    {
+        Material material;
         for (int i = 0; i < textures.size(); i++)
         {
-            unsigned int curLayer = textures[i].layer;
+            int curLayer = textures[i].layer;
 
             switch (textures[i].type)
             {
                 case TextureType::DIFFUSE:
                 {
-                    if (numDiffuse == 0)
+                    if (material.diffuseLayerCount == 0)
                     {
-                        shader.setInt("material.diffuseStartLayer", curLayer); 
+                        material.diffuseStartLayer = curLayer;
                     }
-                    numDiffuse++;
+                    material.diffuseLayerCount++;
                     break;
                 }
                 case TextureType::SPECULAR:
                 {
-                    if (numSpecular == 0)
+                    if (material.specularLayerCount == 0)
                     {
-                        shader.setInt("material.specularStartLayer", curLayer); 
+                        material.specularStartLayer = curLayer;
                     }
-                    numSpecular++;
+                    material.specularLayerCount++;
                     break;
                 }
                 case TextureType::EMISSION:
                 {
-                    if (numEmission == 0)
+                    if (material.emissionLayerCount == 0)
                     {
-                        shader.setInt("material.emissionStartLayer", curLayer); 
+                        material.emissionStartLayer = curLayer;
                     }
-                    numEmission++;
+                    material.emissionLayerCount++;
                     break;
                 }
             }
         }
-
-
-        shader.setInt("material.diffuseLayerCount", numDiffuse);
-        shader.setInt("material.specularLayerCount", numSpecular);
-        shader.setInt("material.emissionLayerCount", numEmission);
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, (unsigned int)indices.size(), GL_UNSIGNED_INT, 0);
-
-        glBindVertexArray(0);
+        materialID = MaterialManager::Get().Register(material);
     }
 
-private:
-    // render buffers
-    unsigned int VAO, VBO, EBO; // vertex array object, vertex buffer object, element buffer object
-
     void SetupMesh()
     {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-
-        // vertex position attribute
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normal attribute
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-        // vertex texure coord attributre
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texCoords));
-
-        glBindVertexArray(0);
+        geometry = GeometryBuffer::Get().Add(vertices, indices);
+        bounds = Bounds::FromVertices(vertices);
     }
 };
 
@@ -148,30 +191,42 @@ private:
 class Model
 {
 public:
-    Model(std::string path)
+    // lightmap is what lightmap_baker wrote for this model, its meshes get the baked vertices and lightmap coords.
+    // importVertexColors keeps the first color set of meshes that have one (the windfall models bake their lighting into it)
+    Model(std::string path, const LightmapFile* _lightmap = nullptr, bool _importVertexColors = false)
     {
+        lightmap = _lightmap;
+        importVertexColors = _importVertexColors;
         LoadModel(path);
     }
 
-    void Draw(Shader &shader)
+    void Draw(Shader &shader, unsigned int objectIndex)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
         {
-            meshes[i].Draw(shader);
+            meshes[i].Draw(shader, objectIndex);
         }
     }
 
+    std::vector<Mesh>& GetMeshes()
+    {
+        return meshes;
+    }
+
 private:
     std::vector<Mesh> meshes;
     std::string directory;
 
     std::vector<Texture> textures_loaded;
 
+    const LightmapFile* lightmap = nullptr;
+    bool importVertexColors = false;
+
 
     void LoadModel(std::string path)
     {
         Assimp::Importer importer;
-        const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_OptimizeMeshes /* | aiProcess_GenNormals */);
+        const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_OptimizeMeshes | aiProcess_GenSmoothNormals); // only fills in missing normals, the windfall dae files have none
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
         {
             std::cout << "(Assimp): Error: " << importer.GetErrorString() << std::endl;
@@ -202,6 +257,7 @@ private:
         std::vector<Vertex> vertices;
         std::vector<unsigned int> indices;
         std::vector<Texture> textures;
+        bool vertexColored = importVertexColors && mesh->mColors[0] != nullptr;
 
         // initializing vertices
         for (unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -231,6 +287,12 @@ private:
                 vertex.texCoords = glm::vec2(0.0f, 0.0f);
             }
 
+            if (vertexColored)
+            {
+                const aiColor4D& color = mesh->mColors[0][i];
+                vertex.color = glm::u8vec4(glm::clamp(glm::vec4(color.r, color.g, color.b, color.a), 0.0f, 1.0f) * 255.0f + 0.5f);
+            }
+
             vertices.push_back(vertex);
         }
 
@@ -255,7 +317,34 @@ private:
             textures.insert(textures.end(), specularMaps.begin(), specularMaps.end()); // likewise as before
         }
 
-        return Mesh(vertices, indices, textures);
+        bool lightmapped = ApplyLightmap(vertices, indices);
+        return Mesh(vertices, indices, textures, lightmapped, vertexColored);
+    }
+
+    // swaps in the bake's vertices (split along its chart seams) and indices for the mesh being loaded
+    bool ApplyLightmap(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+    {
+        if (!lightmap || lightmap->meshes.empty())
+            return false;
+
+        unsigned int meshIndex = meshes.size();
+        if (meshIndex >= lightmap->meshes.size() || lightmap->meshes[meshIndex].sourceVertexCount != vertices.size())
+        {
+            std::cout << "(Model): Error: lightmap doesnt match mesh " << meshIndex << ", rebake it" << std::endl;
+            lightmap = nullptr; // the rest of the meshes wont line up either
+            return false;
+        }
+
+        const LightmapMesh& bakedMesh = lightmap->meshes[meshIndex];
+        std::vector<Vertex> bakedVertices(bakedMesh.sourceVertices.size());
+        for (unsigned int i = 0; i < bakedVertices.size(); i++)
+        {
+            bakedVertices[i] = vertices[bakedMesh.sourceVertices[i]];
+            bakedVertices[i].lightmapCoord = bakedMesh.coords[i];
+        }
+        vertices = std::move(bakedVertices);
+        indices.assign(bakedMesh.indices.begin(), bakedMesh.indices.end());
+        return true;
     }
 
     std::vector<Texture> LoadMaterialTextures(aiMaterial *mat, aiTextureType type, TextureType internalType)
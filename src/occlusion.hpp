@@ -0,0 +1,362 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include "geometry.hpp"
+#include "job_system.hpp"
+
+#include <xmmintrin.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+
+// cpu occlusion culling against a low resolution software depth buffer, nothing here touches gl.
+//
+// occluders are the large triangles of big opaque meshes, rasterized every frame into a tiled depth buffer
+// with one tile per job so the workers never write to the same memory. each tile also keeps its farthest depth,
+// occludees (world space boxes) are first tested against that and only go down to pixels where it isnt enough.
+// dropping triangles only ever makes the occluders smaller, so the result stays conservative
+class OcclusionCuller
+{
+public:
+    static const int WIDTH = 320;
+    static const int HEIGHT = 192;
+    static const int TILE_SIZE = 32;
+    static const int TILES_X = WIDTH / TILE_SIZE;
+    static const int TILES_Y = HEIGHT / TILE_SIZE;
+
+    struct Stats
+    {
+        int occluderTriangles = 0; // after near plane rejection
+        int occludees = 0;
+        int occluded = 0;
+        float rasterMs = 0.0f;
+        float testMs = 0.0f;
+    };
+
+    OcclusionCuller() : depth(WIDTH * HEIGHT, 1.0f), tileMaxDepth(TILES_X * TILES_Y, 1.0f) {}
+
+    // keeps the triangles of the mesh with a world space area of at least minArea as occluders.
+    // only meant for opaque meshes, cutouts have holes
+    void AddOccluder(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const glm::mat4& model, float minArea)
+    {
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            glm::vec3 a = glm::vec3(model * glm::vec4(vertices[indices[i + 0]].position, 1.0f));
+            glm::vec3 b = glm::vec3(model * glm::vec4(vertices[indices[i + 1]].position, 1.0f));
+            glm::vec3 c = glm::vec3(model * glm::vec4(vertices[indices[i + 2]].position, 1.0f));
+            if (glm::length(glm::cross(b - a, c - a)) * 0.5f < minArea)
+                continue;
+
+            occluderVertices.push_back(a);
+            occluderVertices.push_back(b);
+            occluderVertices.push_back(c);
+        }
+    }
+
+    // returns the index to check IsOccluded with
+    unsigned int AddOccludee(const Bounds& bounds, const glm::mat4& model)
+    {
+        // world box around the transformed local box
+        glm::vec3 center = glm::vec3(model * glm::vec4(bounds.GetCenter(), 1.0f));
+        glm::vec3 extents = (bounds.max - bounds.min) * 0.5f;
+        glm::vec3 worldExtents = glm::abs(glm::vec3(model[0])) * extents.x + glm::abs(glm::vec3(model[1])) * extents.y + glm::abs(glm::vec3(model[2])) * extents.z;
+
+        occludeeMin.push_back(center - worldExtents);
+        occludeeMax.push_back(center + worldExtents);
+        occluded.push_back(0);
+        return occludeeMin.size() - 1;
+    }
+
+    // rasterizes the occluders and tests every occludee
+    void Cull(const glm::mat4& viewProjection)
+    {
+        auto start = std::chrono::steady_clock::now();
+        SetupTriangles(viewProjection);
+        RasterizeTiles();
+        auto rasterEnd = std::chrono::steady_clock::now();
+        TestOccludees(viewProjection);
+        auto testEnd = std::chrono::steady_clock::now();
+
+        stats.occludees = occludeeMin.size();
+        stats.occluded = 0;
+        for (auto isOccluded : occluded)
+        {
+            stats.occluded += isOccluded;
+        }
+        stats.rasterMs = std::chrono::duration<float, std::milli>(rasterEnd - start).count();
+        stats.testMs = std::chrono::duration<float, std::milli>(testEnd - rasterEnd).count();
+    }
+
+    // result of the last Cull
+    bool IsOccluded(unsigned int index) const
+    {
+        return occluded[index];
+    }
+
+    const Stats& GetStats() const
+    {
+        return stats;
+    }
+
+    // row major depth in [0, 1], row 0 at the bottom like gl. for debugging
+    float GetDepth(int x, int y) const
+    {
+        int tile = (y / TILE_SIZE) * TILES_X + x / TILE_SIZE;
+        return depth[tile * TILE_SIZE * TILE_SIZE + (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE];
+    }
+
+private:
+    // a screen space triangle ready for rasterizing, edge functions are normalized to be >= 0 inside
+    struct Triangle
+    {
+        float edgeA[3], edgeB[3], edgeC[3]; // e(x, y) = A * x + B * y + C
+        float depthA, depthB, depthC; // depth plane, z(x, y) = A * x + B * y + C
+        int minX, minY, maxX, maxY; // pixel bounds, clamped to the screen
+    };
+
+    std::vector<glm::vec3> occluderVertices; // world space, 3 per triangle
+    std::vector<glm::vec3> occludeeMin, occludeeMax;
+    std::vector<uint8_t> occluded;
+
+    std::vector<Triangle> triangles;
+    std::vector<uint8_t> triangleValid;
+    std::vector<int> tileBins[TILES_X * TILES_Y];
+
+    // tiled, each tile is TILE_SIZE * TILE_SIZE floats in row major order so a tile is one contiguous block
+    std::vector<float> depth;
+    std::vector<float> tileMaxDepth;
+
+    Stats stats;
+
+
+    // projects the occluders in parallel then bins them into tiles
+    void SetupTriangles(const glm::mat4& viewProjection)
+    {
+        int triangleCount = occluderVertices.size() / 3;
+        triangles.resize(triangleCount);
+        triangleValid.assign(triangleCount, 0);
+
+        JobSystem::Get().ParallelFor(triangleCount, 1024, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                triangleValid[i] = SetupTriangle(viewProjection, &occluderVertices[i * 3], triangles[i]);
+            }
+        });
+
+        stats.occluderTriangles = 0;
+        for (auto& bin : tileBins)
+        {
+            bin.clear();
+        }
+        for (int i = 0; i < triangleCount; i++)
+        {
+            if (!triangleValid[i])
+                continue;
+            stats.occluderTriangles++;
+
+            const Triangle& triangle = triangles[i];
+            for (int tileY = triangle.minY / TILE_SIZE; tileY <= triangle.maxY / TILE_SIZE; tileY++)
+            {
+                for (int tileX = triangle.minX / TILE_SIZE; tileX <= triangle.maxX / TILE_SIZE; tileX++)
+                {
+                    tileBins[tileY * TILES_X + tileX].push_back(i);
+                }
+            }
+        }
+    }
+
+    static bool SetupTriangle(const glm::mat4& viewProjection, const glm::vec3* worldVertices, Triangle& triangle)
+    {
+        glm::vec3 screen[3];
+        for (int v = 0; v < 3; v++)
+        {
+            glm::vec4 clip = viewProjection * glm::vec4(worldVertices[v], 1.0f);
+
+            // clipping against the near plane isnt worth it here, dropping the triangle is conservative
+            if (clip.w < 1e-4f || clip.z < -clip.w)
+                return false;
+
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            screen[v] = glm::vec3((ndc.x * 0.5f + 0.5f) * WIDTH, (ndc.y * 0.5f + 0.5f) * HEIGHT, ndc.z * 0.5f + 0.5f);
+        }
+
+        float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+        if (std::fabs(area) < 1e-6f)
+            return false;
+
+        // pixel centers the triangle can touch
+        float minX = std::min({screen[0].x, screen[1].x, screen[2].x});
+        float maxX = std::max({screen[0].x, screen[1].x, screen[2].x});
+        float minY = std::min({screen[0].y, screen[1].y, screen[2].y});
+        float maxY = std::max({screen[0].y, screen[1].y, screen[2].y});
+        triangle.minX = std::max(0, (int)std::ceil(minX - 0.5f));
+        triangle.maxX = std::min(WIDTH - 1, (int)std::floor(maxX - 0.5f));
+        triangle.minY = std::max(0, (int)std::ceil(minY - 0.5f));
+        triangle.maxY = std::min(HEIGHT - 1, (int)std::floor(maxY - 0.5f));
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+            return false;
+
+        // both windings are rasterized, the sign flip makes inside positive either way
+        float sign = area > 0.0f ? 1.0f : -1.0f;
+        for (int e = 0; e < 3; e++)
+        {
+            const glm::vec3& p0 = screen[e];
+            const glm::vec3& p1 = screen[(e + 1) % 3];
+            triangle.edgeA[e] = sign * (p0.y - p1.y);
+            triangle.edgeB[e] = sign * (p1.x - p0.x);
+            triangle.edgeC[e] = sign * (p0.x * p1.y - p0.y * p1.x);
+        }
+
+        // screen space depth is affine, solve the plane through the 3 vertices
+        float invArea = 1.0f / area;
+        float dz1 = screen[1].z - screen[0].z, dz2 = screen[2].z - screen[0].z;
+        float dx1 = screen[1].x - screen[0].x, dx2 = screen[2].x - screen[0].x;
+        float dy1 = screen[1].y - screen[0].y, dy2 = screen[2].y - screen[0].y;
+        triangle.depthA = (dz1 * dy2 - dz2 * dy1) * invArea;
+        triangle.depthB = (dz2 * dx1 - dz1 * dx2) * invArea;
+        triangle.depthC = screen[0].z - triangle.depthA * screen[0].x - triangle.depthB * screen[0].y;
+        return true;
+    }
+
+    void RasterizeTiles()
+    {
+        JobSystem::Get().ParallelFor(TILES_X * TILES_Y, 1, [&](int begin, int end)
+        {
+            for (int tile = begin; tile < end; tile++)
+            {
+                RasterizeTile(tile);
+            }
+        });
+    }
+
+    // 4 pixels of a row at a time
+    void RasterizeTile(int tile)
+    {
+        float* tileDepth = &depth[tile * TILE_SIZE * TILE_SIZE];
+        std::fill(tileDepth, tileDepth + TILE_SIZE * TILE_SIZE, 1.0f);
+
+        int tileMinX = (tile % TILES_X) * TILE_SIZE;
+        int tileMinY = (tile / TILES_X) * TILE_SIZE;
+        const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 zero = _mm_setzero_ps();
+
+        for (int triangleIndex : tileBins[tile])
+        {
+            const Triangle& triangle = triangles[triangleIndex];
+            int minX = std::max(triangle.minX, tileMinX) & ~3;
+            int maxX = std::min(triangle.maxX, tileMinX + TILE_SIZE - 1);
+            int minY = std::max(triangle.minY, tileMinY);
+            int maxY = std::min(triangle.maxY, tileMinY + TILE_SIZE - 1);
+
+            __m128 edgeA[3], edgeB[3], edgeC[3];
+            for (int e = 0; e < 3; e++)
+            {
+                edgeA[e] = _mm_set1_ps(triangle.edgeA[e]);
+                edgeB[e] = _mm_set1_ps(triangle.edgeB[e]);
+                edgeC[e] = _mm_set1_ps(triangle.edgeC[e]);
+            }
+            __m128 depthA = _mm_set1_ps(triangle.depthA), depthB = _mm_set1_ps(triangle.depthB), depthC = _mm_set1_ps(triangle.depthC);
+
+            for (int y = minY; y <= maxY; y++)
+            {
+                __m128 pixelY = _mm_set1_ps(y + 0.5f);
+                float* row = tileDepth + (y - tileMinY) * TILE_SIZE - tileMinX;
+
+                for (int x = minX; x <= maxX; x += 4)
+                {
+                    __m128 pixelX = _mm_add_ps(_mm_set1_ps((float)x), laneOffsets);
+
+                    __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], pixelX), _mm_mul_ps(edgeB[0], pixelY)), edgeC[0]), zero);
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], pixelX), _mm_mul_ps(edgeB[1], pixelY)), edgeC[1]), zero));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], pixelX), _mm_mul_ps(edgeB[2], pixelY)), edgeC[2]), zero));
+                    if (_mm_movemask_ps(inside) == 0)
+                        continue;
+
+                    __m128 triangleDepth = _mm_add_ps(_mm_add_ps(_mm_mul_ps(depthA, pixelX), _mm_mul_ps(depthB, pixelY)), depthC);
+                    __m128 oldDepth = _mm_loadu_ps(row + x);
+                    __m128 newDepth = _mm_min_ps(oldDepth, triangleDepth);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, newDepth), _mm_andnot_ps(inside, oldDepth)));
+                }
+            }
+        }
+
+        tileMaxDepth[tile] = *std::max_element(tileDepth, tileDepth + TILE_SIZE * TILE_SIZE);
+    }
+
+    void TestOccludees(const glm::mat4& viewProjection)
+    {
+        JobSystem::Get().ParallelFor(occludeeMin.size(), 256, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                occluded[i] = IsBoxOccluded(viewProjection, occludeeMin[i], occludeeMax[i]);
+            }
+        });
+    }
+
+    bool IsBoxOccluded(const glm::mat4& viewProjection, const glm::vec3& boxMin, const glm::vec3& boxMax) const
+    {
+        // screen rect and nearest depth of the 8 corners
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+        float nearestDepth = FLT_MAX;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 position(corner & 1 ? boxMax.x : boxMin.x, corner & 2 ? boxMax.y : boxMin.y, corner & 4 ? boxMax.z : boxMin.z);
+            glm::vec4 clip = viewProjection * glm::vec4(position, 1.0f);
+
+            // crosses the near plane, could cover the whole screen
+            if (clip.w < 1e-4f || clip.z < -clip.w)
+                return false;
+
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            minX = std::min(minX, (ndc.x * 0.5f + 0.5f) * WIDTH);
+            maxX = std::max(maxX, (ndc.x * 0.5f + 0.5f) * WIDTH);
+            minY = std::min(minY, (ndc.y * 0.5f + 0.5f) * HEIGHT);
+            maxY = std::max(maxY, (ndc.y * 0.5f + 0.5f) * HEIGHT);
+            nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+        }
+
+        // every pixel center the box could reach, widened by one so boxes thinner than a pixel still get tested
+        int pixelMinX = std::max(0, (int)std::floor(minX - 0.5f));
+        int pixelMaxX = std::min(WIDTH - 1, (int)std::ceil(maxX - 0.5f));
+        int pixelMinY = std::max(0, (int)std::floor(minY - 0.5f));
+        int pixelMaxY = std::min(HEIGHT - 1, (int)std::ceil(maxY - 0.5f));
+        if (pixelMinX > pixelMaxX || pixelMinY > pixelMaxY)
+            return false; // off screen, the frustum culler deals with these
+
+        // small bias so a mesh is never hidden by its own occluder triangles
+        nearestDepth -= 1e-5f;
+
+        for (int tileY = pixelMinY / TILE_SIZE; tileY <= pixelMaxY / TILE_SIZE; tileY++)
+        {
+            for (int tileX = pixelMinX / TILE_SIZE; tileX <= pixelMaxX / TILE_SIZE; tileX++)
+            {
+                int tile = tileY * TILES_X + tileX;
+                if (tileMaxDepth[tile] < nearestDepth)
+                    continue; // everything in this tile is in front of the box
+
+                const float* tileDepth = &depth[tile * TILE_SIZE * TILE_SIZE];
+                int x0 = std::max(pixelMinX, tileX * TILE_SIZE) - tileX * TILE_SIZE;
+                int x1 = std::min(pixelMaxX, tileX * TILE_SIZE + TILE_SIZE - 1) - tileX * TILE_SIZE;
+                int y0 = std::max(pixelMinY, tileY * TILE_SIZE) - tileY * TILE_SIZE;
+                int y1 = std::min(pixelMaxY, tileY * TILE_SIZE + TILE_SIZE - 1) - tileY * TILE_SIZE;
+                for (int y = y0; y <= y1; y++)
+                {
+                    for (int x = x0; x <= x1; x++)
+                    {
+                        if (tileDepth[y * TILE_SIZE + x] >= nearestDepth)
+                            return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+// the irradiance probe grid baked by IrradianceProbes in probes.hpp
+layout (std140, binding = 2) uniform ProbeUniforms
+{
+    vec4 probeGridMin;         // w = enabled
+    vec4 probeInverseCellSize; // w = normal offset in world units
+    ivec4 probeCounts;
+};
+
+// every probe's 9 rgb coefficients in 7 texels, texel t of all probes is a block of probeCounts.x texels along x
+layout(binding = 11) uniform sampler3D irradianceProbes; // IrradianceProbes::TEXTURE_UNIT
+
+bool probesEnabled()
+{
+    return probeGridMin.w > 0.5;
+}
+
+// irradiance / pi arriving around the normal, blended from the 8 probes around the point.
+// multiplied with the albedo it replaces the lights' ambient terms
+vec3 getProbeIrradiance(vec3 fragPos, vec3 normal)
+{
+    // pushed along the normal so surfaces dont only see the probes behind them
+    vec3 probe = (fragPos + normal * probeInverseCellSize.w - probeGridMin.xyz) * probeInverseCellSize.xyz;
+    // clamped to the edge probes' texel centers so the filtering never reaches into the next block
+    probe = clamp(probe, vec3(0.0), vec3(probeCounts.xyz - 1));
+
+    vec3 size = vec3(probeCounts.x * 7, probeCounts.y, probeCounts.z);
+    vec3 uvw = (probe + 0.5) / size;
+    float blockWidth = float(probeCounts.x) / size.x;
+
+    vec4 t[7];
+    for (int i = 0; i < 7; i++)
+    {
+        t[i] = texture(irradianceProbes, uvw + vec3(i * blockWidth, 0.0, 0.0));
+    }
+
+    // same basis order and constants as IrradianceProbes::EvaluateBasis
+    vec3 n = normal;
+    vec3 result = t[0].xyz * 0.282095
+        + vec3(t[0].w, t[1].xy) * 0.488603 * n.y
+        + vec3(t[1].zw, t[2].x) * 0.488603 * n.z
+        + t[2].yzw * 0.488603 * n.x
+        + t[3].xyz * 1.092548 * n.x * n.y
+        + vec3(t[3].w, t[4].xy) * 1.092548 * n.y * n.z
+        + vec3(t[4].zw, t[5].x) * 0.315392 * (3.0 * n.z * n.z - 1.0)
+        + t[5].yzw * 1.092548 * n.x * n.z
+        + t[6].xyz * 0.546274 * (n.x * n.x - n.y * n.y);
+    return max(result, vec3(0.0));
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+#include "../lib/glad.h"
+#include "glm/glm.hpp"
+
+#include "gl_state.hpp"
+#include "ring_buffer.hpp"
+#include "job_system.hpp"
+#include "bake_scene.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+
+// ubo binding of the grid, has to match probes.glsl
+const GLuint PROBE_UBO_BINDING = 2;
+
+// a grid of L2 spherical harmonic irradiance probes over the static scene, baked on the cpu by casting rays into a BakeScene.
+// the coefficients go into one 3d texture, probes.glsl blends the 8 around a fragment with trilinear filtering
+// and that replaces the lights' flat ambient terms
+class IrradianceProbes
+{
+public:
+    static const GLuint TEXTURE_UNIT = 11; // has to match probes.glsl
+    static const int MAX_PROBES_PER_AXIS = 32;
+    static const int TEXELS_PER_PROBE = 7; // 9 rgb coefficients in 7 rgba texels, side by side along x (see probes.glsl)
+
+    float probeSpacing = 3.0f;  // world units, the grid gets fewer probes if an axis would have more than the max
+    int raysPerProbe = 256;
+    float insideThreshold = 0.25f; // probes seeing more backfaces than this are inside geometry, they get their neighbours' light
+    glm::vec3 skyRadiance = glm::vec3(0.1f, 0.11f, 0.13f); // what rays leaving the scene see
+
+    struct Stats
+    {
+        glm::ivec3 counts = glm::ivec3(0);
+        int insideProbes = 0;
+        float bakeMs = 0.0f;
+    };
+
+    // scene has to be built, min/max is the part of the world the grid covers
+    void Bake(const BakeScene& scene, glm::vec3 boundsMin, glm::vec3 boundsMax)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        // keeps the outer probes off the floor and out of the outer walls, fragments past them use the edge probes
+        glm::vec3 inset = glm::min(glm::vec3(0.5f * probeSpacing), (boundsMax - boundsMin) * 0.25f);
+        boundsMin += inset;
+        boundsMax -= inset;
+
+        glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(0.001f));
+        counts = glm::clamp(glm::ivec3(glm::ceil(extent / probeSpacing)) + 1, glm::ivec3(2), glm::ivec3(MAX_PROBES_PER_AXIS));
+        gridMin = boundsMin;
+        cellSize = extent / glm::vec3(counts - 1);
+
+        int probeCount = counts.x * counts.y * counts.z;
+        std::vector<glm::vec3> coefficients(probeCount * 9, glm::vec3(0.0f));
+        std::vector<uint8_t> inside(probeCount, 0);
+
+        JobSystem::Get().ParallelFor(probeCount, 4, [&](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                glm::ivec3 probe(i % counts.x, (i / counts.x) % counts.y, i / (counts.x * counts.y));
+                glm::vec3 position = gridMin + glm::vec3(probe) * cellSize;
+                inside[i] = BakeProbe(scene, position, i, &coefficients[i * 9]);
+            }
+        });
+
+        // probes stuck in walls would pull black into everything next to them
+        stats.insideProbes = FillInsideProbes(coefficients, inside);
+        Upload(coefficients);
+
+        stats.counts = counts;
+        stats.bakeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // every frame before drawing, the shaders fall back to the lights' ambient terms when it is disabled
+    void Bind(bool enabled)
+    {
+        auto allocation = DynamicRingBuffer::Get().AllocateUniform(sizeof(ProbeData));
+        if (!allocation.data)
+            return;
+
+        ProbeData data = {};
+        data.gridMin = glm::vec4(gridMin, enabled && texture != 0 ? 1.0f : 0.0f);
+        data.inverseCellSize = glm::vec4(1.0f / cellSize, 0.25f * std::min({cellSize.x, cellSize.y, cellSize.z}));
+        data.counts = glm::ivec4(counts, 0);
+        std::memcpy(allocation.data, &data, sizeof(ProbeData));
+        GLState::Get().BindBufferRange(GL_UNIFORM_BUFFER, PROBE_UBO_BINDING, allocation.buffer, allocation.offset, allocation.size);
+
+        if (texture != 0)
+        {
+            GLState::Get().BindTexture(TEXTURE_UNIT, GL_TEXTURE_3D, texture);
+        }
+    }
+
+    const Stats& GetStats() const
+    {
+        return stats;
+    }
+
+    void Delete()
+    {
+        if (texture != 0)
+        {
+            glDeleteTextures(1, &texture);
+            texture = 0;
+        }
+    }
+
+private:
+    // matches ProbeUniforms in probes.glsl (std140)
+    struct ProbeData
+    {
+        glm::vec4 gridMin;         // w = enabled
+        glm::vec4 inverseCellSize; // w = how far fragments are pushed along their normal before looking up the probes
+        glm::ivec4 counts;
+    };
+
+    GLuint texture = 0;
+    glm::ivec3 counts = glm::ivec3(2);
+    glm::vec3 gridMin = glm::vec3(0.0f);
+    glm::vec3 cellSize = glm::vec3(1.0f);
+    Stats stats;
+
+    // projects the radiance arriving from every direction onto the sh basis, then convolves it with the cosine lobe
+    // so evaluating the coefficients with a normal gives the irradiance / pi (what the albedo gets multiplied with).
+    // returns whether the probe is inside geometry
+    bool BakeProbe(const BakeScene& scene, const glm::vec3& position, uint32_t seed, glm::vec3* coefficients) const
+    {
+        BakeRandom random(seed);
+        int backfaces = 0;
+        for (int r = 0; r < raysPerProbe; r++)
+        {
+            glm::vec3 direction = UniformSampleSphere(random);
+
+            glm::vec3 radiance = skyRadiance;
+            TriangleBVH::Hit hit;
+            if (scene.bvh.Intersect(position, direction, FLT_MAX, hit))
+            {
+                bool backface;
+                glm::vec3 normal = scene.HitNormal(hit, direction, &backface);
+                if (backface)
+                {
+                    backfaces++;
+                    radiance = glm::vec3(0.0f);
+                }
+                else
+                {
+                    radiance = scene.albedos[hit.triangle] * scene.DirectLight(position + direction * hit.t, normal);
+                }
+            }
+
+            float basis[9];
+            EvaluateBasis(direction, basis);
+            for (int c = 0; c < 9; c++)
+            {
+                coefficients[c] += radiance * basis[c];
+            }
+        }
+
+        // 4 pi / rays for the monte carlo estimate, times the cosine lobe's band factors (pi, 2pi/3, pi/4) over pi
+        const float bandFactors[3] = {1.0f, 2.0f / 3.0f, 0.25f};
+        float weight = 4.0f * 3.14159265f / raysPerProbe;
+        for (int c = 0; c < 9; c++)
+        {
+            coefficients[c] *= weight * bandFactors[c == 0 ? 0 : (c < 4 ? 1 : 2)];
+        }
+        return backfaces > raysPerProbe * insideThreshold;
+    }
+
+    // real sh basis up to band 2, the same order and constants as probes.glsl
+    static void EvaluateBasis(const glm::vec3& n, float basis[9])
+    {
+        basis[0] = 0.282095f;
+        basis[1] = 0.488603f * n.y;
+        basis[2] = 0.488603f * n.z;
+        basis[3] = 0.488603f * n.x;
+        basis[4] = 1.092548f * n.x * n.y;
+        basis[5] = 1.092548f * n.y * n.z;
+        basis[6] = 0.315392f * (3.0f * n.z * n.z - 1.0f);
+        basis[7] = 1.092548f * n.x * n.z;
+        basis[8] = 0.546274f * (n.x * n.x - n.y * n.y);
+    }
+
+    // inside probes take the average of their outside neighbours, a few passes so it spreads into thick walls
+    int FillInsideProbes(std::vector<glm::vec3>& coefficients, std::vector<uint8_t> inside) const
+    {
+        int insideCount = std::count(inside.begin(), inside.end(), 1);
+        for (int pass = 0; pass < 3; pass++)
+        {
+            std::vector<uint8_t> filled = inside;
+            for (int i = 0; i < inside.size(); i++)
+            {
+                if (!inside[i])
+                    continue;
+
+                glm::ivec3 probe(i % counts.x, (i / counts.x) % counts.y, i / (counts.x * counts.y));
+                glm::vec3 sum[9] = {};
+                int neighbours = 0;
+                for (glm::ivec3 offset : {glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0), glm::ivec3(0, 1, 0), glm::ivec3(0, -1, 0), glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1)})
+                {
+                    glm::ivec3 neighbour = probe + offset;
+                    if (glm::any(glm::lessThan(neighbour, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(neighbour, counts)))
+                        continue;
+                    int n = (neighbour.z * counts.y + neighbour.y) * counts.x + neighbour.x;
+                    if (inside[n])
+                        continue;
+                    for (int c = 0; c < 9; c++)
+                    {
+                        sum[c] += coefficients[n * 9 + c];
+                    }
+                    neighbours++;
+                }
+                if (neighbours == 0)
+                    continue;
+
+                for (int c = 0; c < 9; c++)
+                {
+                    coefficients[i * 9 + c] = sum[c] / (float)neighbours;
+                }
+                filled[i] = 0;
+            }
+            inside = filled;
+        }
+        return insideCount;
+    }
+
+    void Upload(const std::vector<glm::vec3>& coefficients)
+    {
+        int width = counts.x * TEXELS_PER_PROBE;
+        std::vector<glm::vec4> texels(width * counts.y * counts.z, glm::vec4(0.0f));
+        for (int i = 0; i < counts.x * counts.y * counts.z; i++)
+        {
+            glm::ivec3 probe(i % counts.x, (i / counts.x) % counts.y, i / (counts.x * counts.y));
+
+            // the 27 floats one after the other, spread over 7 texels that are counts.x apart
+            float packed[TEXELS_PER_PROBE * 4] = {};
+            std::memcpy(packed, &coefficients[i * 9], 9 * sizeof(glm::vec3));
+            for (int t = 0; t < TEXELS_PER_PROBE; t++)
+            {
+                int x = t * counts.x + probe.x;
+                texels[(probe.z * counts.y + probe.y) * width + x] = glm::vec4(packed[t * 4], packed[t * 4 + 1], packed[t * 4 + 2], packed[t * 4 + 3]);
+            }
+        }
+
+        if (texture == 0)
+        {
+            glGenTextures(1, &texture);
+        }
+        GLState::Get().BindTexture(TEXTURE_UNIT, GL_TEXTURE_3D, texture);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, width, counts.y, counts.z, 0, GL_RGBA, GL_FLOAT, texels.data());
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    }
+};
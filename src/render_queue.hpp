@@ -0,0 +1,354 @@
+#pragma once
+
+#include "../lib/glad.h"
+#include "glm/glm.hpp"
+
+#include "shader.hpp"
+#include "gl_state.hpp"
+#include "materials.hpp"
+#include "models.hpp"
+#include "textures.hpp"
+#include "transforms.hpp"
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+
+// passes run in this order, the pass is the top of the sort key
+enum class RenderPass
+{
+    DEPTH_PREPASS,
+    OPAQUE,
+    CUTOUT,
+    BLENDED,
+    COUNT
+};
+
+const char* const renderPassNames[] = {"depth prepass", "opaque", "cutout", "blended"};
+
+inline RenderPass RenderPassForAlpha(AlphaMode alphaMode)
+{
+    switch (alphaMode)
+    {
+        case AlphaMode::CUTOUT: return RenderPass::CUTOUT;
+        case AlphaMode::BLENDED: return RenderPass::BLENDED;
+        default: return RenderPass::OPAQUE;
+    }
+}
+
+
+// one submitted draw, the key is finished (program bits added) once it reaches the queue
+struct RenderItem
+{
+    uint64_t key;
+    Mesh* mesh;
+    Shader* shader;
+    unsigned int objectIndex;
+    unsigned int materialID;
+    int lightList; // LightLists index for the lightList uniform, -1 = clustered lights
+};
+
+class RenderQueue;
+
+// draws built on a worker thread, see RenderQueue::BuildParallel
+class DrawList
+{
+public:
+    void Submit(RenderPass pass, Shader& shader, Mesh& mesh, unsigned int objectIndex, unsigned int materialID, int lightList = -1);
+
+private:
+    friend class RenderQueue;
+
+    const RenderQueue* queue = nullptr;
+    std::vector<RenderItem> items;
+};
+
+
+// draws are submitted as 64 bit sort keys, radix sorted once per frame and then executed in order,
+// only issuing the gl calls whose state actually changes between neighbouring draws.
+//
+// key layout, most significant first:
+//   pass 3 | program 5 | material 16 | geometry 16 | depth 24
+// blended draws need back to front order more than anything else, so they use
+//   pass 3 | depth 24 (inverted) | program 5 | material 16 | geometry 16
+class RenderQueue
+{
+public:
+    struct Stats
+    {
+        int draws[(int)RenderPass::COUNT] = {};
+        int programBinds = 0, programSkips = 0;
+        int materialBinds = 0, materialSkips = 0;
+        int vaoBinds = 0, vaoSkips = 0;
+    };
+
+    // view matrix and far plane for the depth part of the keys, call before submitting
+    void Begin(const glm::mat4& _view, float _farPlane)
+    {
+        view = _view;
+        farPlane = _farPlane;
+        items.clear();
+        programs.clear();
+    }
+
+    void Submit(RenderPass pass, Shader& shader, Mesh& mesh, unsigned int objectIndex, unsigned int materialID, int lightList = -1)
+    {
+        RenderItem item = MakeItem(pass, shader, mesh, objectIndex, materialID, lightList);
+        AddProgramBits(item);
+        items.push_back(item);
+    }
+
+    // calls build(i, list) for every i in [0, count) on the job system, each batch submits into its own DrawList.
+    // the lists are merged in batch order on this thread afterwards, so the queue ends up exactly like a serial build.
+    // build can only read shared state (and the TransformBuffer has to stay untouched until it returns)
+    void BuildParallel(int count, int batchSize, const std::function<void(int index, DrawList& list)>& build)
+    {
+        int batchCount = (count + batchSize - 1) / batchSize;
+        if ((int)lists.size() < batchCount)
+            lists.resize(batchCount);
+        for (int i = 0; i < batchCount; i++)
+        {
+            lists[i].queue = this;
+            lists[i].items.clear();
+        }
+
+        JobSystem::Get().ParallelFor(count, batchSize, [&](int begin, int end)
+        {
+            DrawList& list = lists[begin / batchSize];
+            for (int i = begin; i < end; i++)
+            {
+                build(i, list);
+            }
+        });
+
+        // programs are numbered in the order they show up, which has to happen on one thread
+        for (int i = 0; i < batchCount; i++)
+        {
+            for (RenderItem& item : lists[i].items)
+            {
+                AddProgramBits(item);
+                items.push_back(item);
+            }
+        }
+    }
+
+    // lsd radix sort on the keys, 8 bits per pass. digits that are the same for every key are skipped
+    void Sort()
+    {
+        stats = Stats();
+        sorted.resize(items.size());
+        scratch.resize(items.size());
+        for (uint32_t i = 0; i < items.size(); i++)
+        {
+            sorted[i] = {items[i].key, i};
+        }
+
+        for (int shift = 0; shift < 64; shift += 8)
+        {
+            uint32_t counts[256] = {};
+            for (auto& entry : sorted)
+            {
+                counts[(entry.key >> shift) & 0xFF]++;
+            }
+
+            if (!sorted.empty() && counts[(sorted[0].key >> shift) & 0xFF] == sorted.size())
+                continue;
+
+            uint32_t offsets[256];
+            uint32_t total = 0;
+            for (int i = 0; i < 256; i++)
+            {
+                offsets[i] = total;
+                total += counts[i];
+            }
+            for (auto& entry : sorted)
+            {
+                scratch[offsets[(entry.key >> shift) & 0xFF]++] = entry;
+            }
+            sorted.swap(scratch);
+        }
+    }
+
+    // beginPass/endPass are called on pass changes to set up depth/blend state, profiling etc.
+    // only draws the passes in [firstPass, lastPass], so a frame can run the queue in pieces (the deferred path
+    // draws the blended pass after lighting)
+    void Execute(const std::function<void(RenderPass)>& beginPass, const std::function<void(RenderPass)>& endPass,
+        RenderPass firstPass = RenderPass::DEPTH_PREPASS, RenderPass lastPass = RenderPass::BLENDED)
+    {
+        // the tex array is the only texture, bind it once instead of per draw
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D_ARRAY, TextureManager::Get().GetTexArrayID());
+
+        int curPass = -1;
+        Shader* curShader = nullptr;
+        unsigned int curMaterial = MaterialManager::NO_MATERIAL;
+        int curLightList = -1;
+        int curLightListLocation = -1; // -1 for programs without the uniform (depth only, lightmapped, baked)
+        GLuint curVAO = 0;
+        std::vector<Shader*> listShaders; // programs left with a light list, reset at the end for draws outside the queue
+
+        for (auto& entry : sorted)
+        {
+            RenderItem& item = items[entry.index];
+            int pass = (int)(entry.key >> 61);
+            if (pass < (int)firstPass || pass > (int)lastPass)
+                continue;
+
+            if (pass != curPass)
+            {
+                if (curPass != -1)
+                    endPass((RenderPass)curPass);
+                beginPass((RenderPass)pass);
+                curPass = pass;
+            }
+
+            if (item.shader != curShader)
+            {
+                item.shader->use();
+                curShader = item.shader;
+                curMaterial = MaterialManager::NO_MATERIAL; // material uniforms belong to the program
+                curLightList = UNKNOWN_LIGHT_LIST;
+                curLightListLocation = curShader->getUniformLocation("lightList"); // cached in the shader, no gl lookup per draw
+                stats.programBinds++;
+            }
+            else
+            {
+                stats.programSkips++;
+            }
+
+            if (item.materialID != MaterialManager::NO_MATERIAL)
+            {
+                if (item.materialID != curMaterial)
+                {
+                    MaterialManager::Get().Bind(*curShader, item.materialID);
+                    curMaterial = item.materialID;
+                    stats.materialBinds++;
+                }
+                else
+                {
+                    stats.materialSkips++;
+                }
+            }
+
+            if (curLightListLocation != -1 && item.lightList != curLightList)
+            {
+                glUniform1i(curLightListLocation, item.lightList);
+                if (item.lightList >= 0 && std::find(listShaders.begin(), listShaders.end(), curShader) == listShaders.end())
+                    listShaders.push_back(curShader);
+                curLightList = item.lightList;
+            }
+
+            GLuint vao = item.mesh->GetVAO();
+            if (vao != curVAO)
+            {
+                GLState::Get().BindVertexArray(vao);
+                curVAO = vao;
+                stats.vaoBinds++;
+            }
+            else
+            {
+                stats.vaoSkips++;
+            }
+
+            const GeometryRange& geometry = item.mesh->GetGeometry();
+            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, geometry.indexCount, GL_UNSIGNED_INT,
+                (void*)(geometry.firstIndex * sizeof(unsigned int)), 1, geometry.baseVertex, item.objectIndex);
+            stats.draws[pass]++;
+        }
+
+        if (curPass != -1)
+            endPass((RenderPass)curPass);
+
+        for (Shader* shader : listShaders)
+        {
+            shader->use();
+            glUniform1i(shader->getUniformLocation("lightList"), -1);
+        }
+    }
+
+    const Stats& GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    friend class DrawList;
+
+    static const uint64_t DEPTH_MASK = (1ull << 24) - 1;
+    static const int UNKNOWN_LIGHT_LIST = -2; // what the program's lightList uniform is set to isnt known
+
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    std::vector<RenderItem> items;
+    std::vector<SortEntry> sorted;
+    std::vector<SortEntry> scratch;
+    std::vector<Shader*> programs; // program bits of the key index into this
+    std::vector<DrawList> lists; // one per BuildParallel batch, kept so their memory is reused
+
+    glm::mat4 view = glm::mat4(1.0f);
+    float farPlane = 100.0f;
+
+    Stats stats;
+
+    unsigned int GetProgramIndex(Shader& shader)
+    {
+        for (unsigned int i = 0; i < programs.size(); i++)
+        {
+            if (programs[i] == &shader)
+                return i;
+        }
+        programs.push_back(&shader);
+        return (programs.size() - 1) & 0x1F;
+    }
+
+    // everything but the program bits, only reads so worker threads can call it
+    RenderItem MakeItem(RenderPass pass, Shader& shader, Mesh& mesh, unsigned int objectIndex, unsigned int materialID, int lightList) const
+    {
+        // view space depth of the mesh center, quantized over [0, far]
+        glm::vec4 viewPos = view * TransformBuffer::Get().GetModel(objectIndex) * glm::vec4(mesh.GetCenter(), 1.0f);
+        float depth = glm::clamp(-viewPos.z / farPlane, 0.0f, 1.0f);
+        uint64_t depthBits = (uint64_t)(depth * DEPTH_MASK);
+
+        uint64_t passBits = (uint64_t)pass;
+        uint64_t materialBits = materialID & 0xFFFF;
+        uint64_t geometryBits = mesh.GetVAO() & 0xFFFF;
+
+        uint64_t key;
+        if (pass == RenderPass::BLENDED)
+        {
+            key = passBits << 61 | (DEPTH_MASK - depthBits) << 37 | materialBits << 16 | geometryBits;
+        }
+        else
+        {
+            // front to back within the same state
+            key = passBits << 61 | materialBits << 40 | geometryBits << 24 | depthBits;
+        }
+
+        RenderItem item;
+        item.key = key;
+        item.mesh = &mesh;
+        item.shader = &shader;
+        item.objectIndex = objectIndex;
+        item.materialID = materialID;
+        item.lightList = lightList;
+        return item;
+    }
+
+    void AddProgramBits(RenderItem& item)
+    {
+        uint64_t programBits = GetProgramIndex(*item.shader);
+        bool blended = (item.key >> 61) == (uint64_t)RenderPass::BLENDED;
+        item.key |= programBits << (blended ? 32 : 56);
+    }
+};
+
+inline void DrawList::Submit(RenderPass pass, Shader& shader, Mesh& mesh, unsigned int objectIndex, unsigned int materialID, int lightList)
+{
+    items.push_back(queue->MakeItem(pass, shader, mesh, objectIndex, materialID, lightList));
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "../lib/glad.h"
+
+#include "gl_state.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+
+
+// singleton
+// one persistently mapped buffer for everything uploaded per frame (uniform blocks, instance data, draw commands).
+// it is split into a region per frame in flight, allocations bump a pointer through the current region and the
+// region is fenced at the end of the frame so the cpu never writes over data the gpu might still read.
+// memory is coherent so writes just need to happen before the draw that uses them
+class DynamicRingBuffer
+{
+public:
+    static DynamicRingBuffer& Get()
+    {
+        static DynamicRingBuffer instance;
+        return instance;
+    }
+
+    static const int FRAMES_IN_FLIGHT = 3;
+    static const GLsizeiptr FRAME_SIZE = 4 * 1024 * 1024;
+
+    struct Allocation
+    {
+        void* data = nullptr; // null if the frame ran out of space
+        GLuint buffer = 0;
+        GLintptr offset = 0;
+        GLsizeiptr size = 0;
+    };
+
+    struct Stats
+    {
+        float stallMs = 0.0f; // time spent waiting on the fence this frame
+        int stalledFrames = 0; // since startup
+        float totalStallMs = 0.0f;
+        GLsizeiptr usedBytes = 0; // last finished frame
+        GLsizeiptr peakBytes = 0;
+    };
+
+    // call once at the start of every frame before allocating, waits if the gpu is still reading this region
+    void BeginFrame()
+    {
+        if (buffer == 0 && !createFailed)
+            Create();
+        if (buffer == 0)
+            return;
+
+        frame = (frame + 1) % FRAMES_IN_FLIGHT;
+        offset = 0;
+        stats.stallMs = 0.0f;
+
+        GLsync& fence = fences[frame];
+        if (!fence)
+            return;
+
+        // the common case, the gpu finished with it a while ago
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+        {
+            auto waitStart = std::chrono::steady_clock::now();
+            while (result == GL_TIMEOUT_EXPIRED)
+            {
+                result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+            }
+            stats.stallMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+            stats.stalledFrames++;
+            stats.totalStallMs += stats.stallMs;
+        }
+        if (result == GL_WAIT_FAILED)
+        {
+            std::cout << "(Ring Buffer): Error: waiting on frame fence failed" << std::endl;
+        }
+
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    // call once after the last draw of the frame
+    void EndFrame()
+    {
+        if (buffer == 0)
+            return;
+
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        stats.usedBytes = offset;
+        stats.peakBytes = std::max(stats.peakBytes, offset);
+    }
+
+    // size bytes from the current frame's region, offset aligned to alignment (has to be a power of two)
+    Allocation Allocate(GLsizeiptr size, GLsizeiptr alignment)
+    {
+        Allocation allocation;
+        GLsizeiptr aligned = (offset + alignment - 1) & ~(alignment - 1);
+        if (buffer == 0 || aligned + size > FRAME_SIZE)
+        {
+            std::cout << "(Ring Buffer): Error: out of space for this frame (" << size << " bytes requested)" << std::endl;
+            return allocation;
+        }
+
+        allocation.buffer = buffer;
+        allocation.offset = frame * FRAME_SIZE + aligned;
+        allocation.size = size;
+        allocation.data = mapped + allocation.offset;
+        offset = aligned + size;
+        return allocation;
+    }
+
+    Allocation AllocateUniform(GLsizeiptr size)
+    {
+        return Allocate(size, uniformAlignment);
+    }
+
+    Allocation AllocateStorage(GLsizeiptr size)
+    {
+        return Allocate(size, storageAlignment);
+    }
+
+    // indirect commands only need to be 4 byte aligned
+    Allocation AllocateIndirect(GLsizeiptr size)
+    {
+        return Allocate(size, sizeof(GLuint));
+    }
+
+    const Stats& GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    // private constructor so other instances cant be made
+    DynamicRingBuffer() {}
+
+    GLuint buffer = 0;
+    bool createFailed = false;
+    char* mapped = nullptr;
+    GLsync fences[FRAMES_IN_FLIGHT] = {};
+    int frame = 0;
+    GLsizeiptr offset = 0;
+
+    GLsizeiptr uniformAlignment = 256;
+    GLsizeiptr storageAlignment = 256;
+
+    Stats stats;
+
+    void Create()
+    {
+        GLint alignment;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        uniformAlignment = std::max(alignment, 4);
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        storageAlignment = std::max(alignment, 4);
+
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer);
+        GLState::Get().BindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, FRAMES_IN_FLIGHT * FRAME_SIZE, NULL, flags);
+        mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, FRAMES_IN_FLIGHT * FRAME_SIZE, flags);
+
+        if (!mapped)
+        {
+            std::cout << "(Ring Buffer): Error: failed to map the buffer" << std::endl;
+            glDeleteBuffers(1, &buffer);
+            GLState::Get().Invalidate();
+            buffer = 0;
+            createFailed = true;
+        }
+    }
+};
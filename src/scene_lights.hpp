@@ -0,0 +1,118 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+// plain light data, no gl in here so the offline tools can use it too
+
+// matches PointLight in lighting.glsl (std430)
+struct PointLight
+{
+    glm::vec3 position;
+    float radius;
+
+    glm::vec3 ambient;
+    float constant;
+    glm::vec3 diffuse;
+    float linear;
+    glm::vec3 specular;
+    float quadratic;
+};
+static_assert(sizeof(PointLight) == 64, "PointLight has to match the std430 layout in lighting.glsl");
+
+// matches DirLight in lighting.glsl
+struct DirLight
+{
+    glm::vec3 direction;
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+};
+
+// matches SpotLight in lighting.glsl, except the cut offs are angles in degrees here instead of cosines
+struct SpotLight
+{
+    glm::vec3 position;
+    glm::vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    glm::vec3 ambient;
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+// distance where the brightest channel of the light is attenuated below cutoff
+inline float PointLightRadius(const PointLight& light, float cutoff = 5.0f / 256.0f)
+{
+    float brightest = std::max({light.diffuse.r, light.diffuse.g, light.diffuse.b, light.specular.r, light.specular.g, light.specular.b});
+    // constant + linear * d + quadratic * d^2 = brightest / cutoff
+    float c = light.constant - brightest / cutoff;
+    if (c >= 0.0f)
+        return 0.0f;
+    if (light.quadratic <= 0.0f)
+        return light.linear > 0.0f ? -c / light.linear : 1e30f;
+    return (-light.linear + std::sqrt(light.linear * light.linear - 4.0f * light.quadratic * c)) / (2.0f * light.quadratic);
+}
+
+// same for a spot light, the cone only makes it darker
+inline float SpotLightRadius(const SpotLight& light, float cutoff = 5.0f / 256.0f)
+{
+    PointLight attenuation = {};
+    attenuation.diffuse = light.diffuse;
+    attenuation.specular = light.specular;
+    attenuation.constant = light.constant;
+    attenuation.linear = light.linear;
+    attenuation.quadratic = light.quadratic;
+    return PointLightRadius(attenuation, cutoff);
+}
+
+
+// the lights of the scene that never move. main.cpp draws them and lightmap_baker bakes them,
+// so a bake only matches what is drawn while these stay the same
+inline DirLight SceneSunLight()
+{
+    DirLight light;
+    light.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+    light.ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+    light.diffuse = glm::vec3(0.4f, 0.4f, 0.4f);
+    light.specular = glm::vec3(0.5f, 0.5f, 0.5f);
+    return light;
+}
+
+inline SpotLight SceneSpotLight()
+{
+    SpotLight light;
+    light.position = glm::vec3(0.0f, 1.0f, 4.0f);
+    light.direction = glm::vec3(1.0f, 0.0f, 0.0f);
+    light.cutOff = 12.5f;
+    light.outerCutOff = 17.5f;
+    light.ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+    light.diffuse = glm::vec3(1.0f, 1.0f, 1.0f);
+    light.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    light.constant = 1.0f;
+    light.linear = 0.14f;
+    light.quadratic = 0.07f;
+    return light;
+}
+
+// the point light with the cube drawn at it
+inline PointLight SceneLamp()
+{
+    PointLight light;
+    light.position = glm::vec3(0.7f, 5.0f, 2.0f);
+    light.ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+    light.diffuse = glm::vec3(0.8f, 0.8f, 0.8f);
+    light.specular = glm::vec3(1.0f, 1.0f, 1.0f);
+    light.constant = 1.0f;
+    light.linear = 0.027f;
+    light.quadratic = 0.0028f;
+    light.radius = PointLightRadius(light);
+    return light;
+}
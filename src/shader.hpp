@@ -2,10 +2,25 @@
 
 #include "../lib/glad.h"
 
+#include "gl_state.hpp"
+
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+
+
+// directory the glsl files are loaded (and watched for hot reload) from, set by cmake
+#ifndef SHADER_DIR
+#define SHADER_DIR "../src/"
+#endif
+
 
 class Shader
 {
@@ -13,70 +28,156 @@ public:
     // the shader program ID
     unsigned int shaderProgramID;
 
+    // source paths, kept so the program can be rebuilt when the files change.
+    // compute programs only have computePath
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::string computePath;
+
+    // #defines inserted after the #version line, used to build variants of the same glsl files
+    std::vector<std::string> defines;
+
+    // every file the program was built from (both stages plus everything they #include),
+    // the hot reloader uses this to only rebuild programs that depend on a changed file
+    std::vector<std::string> dependencies;
+
+    // how long the last successful compile + link of this program took
+    float compileTimeMs = 0.0f;
+
+    // preprocessed code of one stage. files[i] is the path of source string number i in the #line directives
+    struct Source
+    {
+        std::string code;
+        std::vector<std::string> files;
+    };
+
+    struct Stage
+    {
+        GLenum type;
+        std::string name; // for compile error logs
+        std::string path;
+    };
+
     // constructor reads and builds the shader
-    Shader(const char* vertexPath, const char* fragmentPath)
+    Shader(const char* _vertexPath, const char* _fragmentPath, const std::vector<std::string>& _defines = {})
+    {
+        vertexPath = _vertexPath;
+        fragmentPath = _fragmentPath;
+        defines = _defines;
+
+        Build();
+    }
+
+    // compute programs only have a single stage, a factory so it cant be mixed up with the vertex/fragment constructor
+    static Shader Compute(const char* _computePath, const std::vector<std::string>& _defines = {})
+    {
+        Shader shader;
+        shader.computePath = _computePath;
+        shader.defines = _defines;
+
+        shader.Build();
+        return shader;
+    }
+
+    bool IsCompute() const
+    {
+        return !computePath.empty();
+    }
+
+    std::vector<Stage> GetStages() const
     {
-        // 1) retrieve vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vertexShaderFile;
-        std::ifstream fragmentShaderFile;
+        if (IsCompute())
+            return {{GL_COMPUTE_SHADER, "COMPUTE", computePath}};
+
+        return {{GL_VERTEX_SHADER, "VERTEX", vertexPath}, {GL_FRAGMENT_SHADER, "FRAGMENT", fragmentPath}};
+    }
+
+    static std::string ReadShaderFile(const std::string& path)
+    {
+        std::ifstream shaderFile;
         // ensure ifstream objects can throw exceptions:
-        vertexShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fragmentShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        shaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
         try
         {
-            // open files
-            vertexShaderFile.open(vertexPath);
-            fragmentShaderFile.open(fragmentPath);
-            std::stringstream vertexShaderStream, fragmentShaderStream;
-            // read file's buffer contents into streams
-            vertexShaderStream << vertexShaderFile.rdbuf();
-            fragmentShaderStream << fragmentShaderFile.rdbuf();
-            // close file handlers
-            vertexShaderFile.close();
-            fragmentShaderFile.close();
-            // convert stream into string
-            vertexCode = vertexShaderStream.str();
-            fragmentCode = fragmentShaderStream.str();
+            shaderFile.open(path);
+            std::stringstream shaderStream;
+            // read file's buffer contents into stream
+            shaderStream << shaderFile.rdbuf();
+            shaderFile.close();
+            return shaderStream.str();
         }
-        catch(std::ifstream::failure e)
+        catch(std::ifstream::failure& e)
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << path << std::endl;
         }
-        const char* vertexShaderCode = vertexCode.c_str();
-        const char* fragmentShaderCode = fragmentCode.c_str();
+        return "";
+    }
 
-        // 2) compile shaders
-        unsigned int vertex, fragment;
+    // reads a stage and expands its #include "..." directives (paths relative to the including file).
+    // a file containing #pragma once is only pasted in once, so shared headers can include each other freely.
+    // #line directives map every line back to its own file so compile errors point at the right place,
+    // and the program's defines are inserted after the #version line
+    Source LoadSource(const std::string& path) const
+    {
+        Source source;
+        std::vector<std::string> onceFiles;
+        ExpandIncludes(path, source, onceFiles, 0);
+        return source;
+    }
 
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vertexShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
+    static std::vector<std::string> CollectDependencies(const std::vector<Source>& sources)
+    {
+        std::vector<std::string> files;
+        for (auto& source : sources)
+        {
+            for (auto& file : source.files)
+            {
+                if (std::find(files.begin(), files.end(), file) == files.end())
+                    files.push_back(file);
+            }
+        }
+        return files;
+    }
 
-        // fragment shader'
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fragmentShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+    // fragment (or compute) file name plus defines, for logs and the info panel
+    std::string GetName() const
+    {
+        const std::string& path = IsCompute() ? computePath : fragmentPath;
+        std::string name = path.substr(path.find_last_of('/') + 1);
+        for (auto& define : defines)
+        {
+            name += " " + define;
+        }
+        return name;
+    }
 
-        // shader program
-        shaderProgramID = glCreateProgram();
-        glAttachShader(shaderProgramID, vertex);
-        glAttachShader(shaderProgramID, fragment);
-        glLinkProgram(shaderProgramID);
-        checkCompileErrors(shaderProgramID, "PROGRAM");
+    // compile and link dont check their status, so with parallel shader compile the driver can keep 
+    // working in the background until the status is actually queried
+    static unsigned int CompileStage(GLenum type, const std::string& code)
+    {
+        const char* shaderCode = code.c_str();
 
-        // delete shaders once they are linked into shader program and just take up space :D
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        unsigned int shader = glCreateShader(type);
+        glShaderSource(shader, 1, &shaderCode, NULL);
+        glCompileShader(shader);
+        return shader;
     }
+
+    static unsigned int LinkProgram(const std::vector<unsigned int>& stages)
+    {
+        unsigned int program = glCreateProgram();
+        for (unsigned int stage : stages)
+        {
+            glAttachShader(program, stage);
+        }
+        glLinkProgram(program);
+        return program;
+    }
+
     // use/activate the shader program
     void use()
     {
-        glUseProgram(shaderProgramID);
+        GLState::Get().UseProgram(shaderProgramID);
     }
 
     // delete shader program
@@ -84,6 +185,25 @@ public:
     {
         glDeleteProgram(shaderProgramID);
     }
+    // location of a uniform the program might not have (-1 then), for per draw uniforms set on the hot path.
+    // cached per program, the cache is dropped when hot reload swaps a new program in
+    int getUniformLocation(const std::string &name) const
+    {
+        if (cachedProgramID != shaderProgramID)
+        {
+            uniformLocations.clear();
+            cachedProgramID = shaderProgramID;
+        }
+
+        auto it = uniformLocations.find(name);
+        if (it != uniformLocations.end())
+            return it->second;
+
+        int loc = glGetUniformLocation(shaderProgramID, name.c_str());
+        uniformLocations[name] = loc;
+        return loc;
+    }
+
     // utility uniform functions
     void setBool(const std::string &name, bool value) const
     {
@@ -120,9 +240,14 @@ public:
     {
         glUniform3f(glGetUniformLocation(shaderProgramID, name.c_str()), value.x, value.y, value.z);
     }
+    void setVec4(const std::string &name, glm::vec4 value) const
+    {
+        glUniform4f(glGetUniformLocation(shaderProgramID, name.c_str()), value.x, value.y, value.z, value.w);
+    }
 
-private:
-    void checkCompileErrors(unsigned int shader, std::string type)
+    // prints the info log and returns false if compiling/linking failed.
+    // with the stage's source files the log's source string numbers are replaced with file names
+    static bool checkCompileErrors(unsigned int shader, std::string type, const std::vector<std::string>& files = {})
     {
         int success;
         char infoLog[1024];
@@ -132,7 +257,7 @@ private:
             if (!success)
             {
                 glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "Error: shader compilation error of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+                std::cout << "Error: shader compilation error of type: " << type << "\n" << MapInfoLogFiles(infoLog, files) << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
         else
@@ -144,5 +269,153 @@ private:
                 std::cout << "Error: program linking error of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success;
+    }
+
+private:
+    Shader() : shaderProgramID(0) {}
+
+    mutable std::unordered_map<std::string, int> uniformLocations;
+    mutable unsigned int cachedProgramID = 0;
+
+    void Build()
+    {
+        auto compileStart = std::chrono::steady_clock::now();
+
+        // 1) retrieve the source code of every stage, with includes expanded
+        std::vector<Stage> stages = GetStages();
+        std::vector<Source> sources;
+        for (auto& stage : stages)
+        {
+            sources.push_back(LoadSource(stage.path));
+        }
+        dependencies = CollectDependencies(sources);
+
+        // 2) compile shaders
+        std::vector<unsigned int> stageIDs;
+        for (int i = 0; i < stages.size(); i++)
+        {
+            stageIDs.push_back(CompileStage(stages[i].type, sources[i].code));
+            checkCompileErrors(stageIDs[i], stages[i].name, sources[i].files);
+        }
+
+        // shader program
+        shaderProgramID = LinkProgram(stageIDs);
+        checkCompileErrors(shaderProgramID, "PROGRAM");
+
+        // delete shaders once they are linked into shader program and just take up space :D
+        for (unsigned int stage : stageIDs)
+        {
+            glDeleteShader(stage);
+        }
+
+        compileTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - compileStart).count();
+    }
+
+    void ExpandIncludes(const std::string& path, Source& source, std::vector<std::string>& onceFiles, int depth) const
+    {
+        if (depth > 32)
+        {
+            std::cout << "(Shader): Error: include depth limit reached at " << path << ", recursive include?" << std::endl;
+            return;
+        }
+
+        int fileIndex = source.files.size();
+        source.files.push_back(path);
+
+        std::string directory = path.substr(0, path.find_last_of('/') + 1);
+        std::istringstream stream(ReadShaderFile(path));
+        std::string line;
+        int lineNumber = 0;
+
+        if (depth > 0)
+        {
+            source.code += "#line 1 " + std::to_string(fileIndex) + "\n";
+        }
+
+        while (std::getline(stream, line))
+        {
+            lineNumber++;
+            std::string directive = line.substr(std::min(line.size(), line.find_first_not_of(" \t")));
+
+            if (depth == 0 && directive.rfind("#version", 0) == 0)
+            {
+                // #version has to stay first, defines go straight after it
+                source.code += line + "\n";
+                for (auto& define : defines)
+                {
+                    source.code += "#define " + define + "\n";
+                }
+                source.code += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+            }
+            else if (directive.rfind("#pragma once", 0) == 0)
+            {
+                onceFiles.push_back(path);
+                source.code += "\n";
+            }
+            else if (directive.rfind("#include", 0) == 0)
+            {
+                size_t nameStart = directive.find('"');
+                size_t nameEnd = directive.find('"', nameStart + 1);
+                if (nameStart == std::string::npos || nameEnd == std::string::npos)
+                {
+                    std::cout << "(Shader): Error: malformed include in " << path << " line " << lineNumber << std::endl;
+                    source.code += "\n";
+                    continue;
+                }
+
+                // normalized so "../" includes compare equal to the paths inotify reports
+                std::string includePath = std::filesystem::path(directory + directive.substr(nameStart + 1, nameEnd - nameStart - 1)).lexically_normal().string();
+                if (std::find(onceFiles.begin(), onceFiles.end(), includePath) != onceFiles.end())
+                {
+                    source.code += "\n";
+                    continue;
+                }
+
+                ExpandIncludes(includePath, source, onceFiles, depth + 1);
+                source.code += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileIndex) + "\n";
+            }
+            else
+            {
+                source.code += line + "\n";
+            }
+        }
+    }
+
+    // drivers print errors as "0(12) : error" (nvidia), "0:12(3): error" (mesa) or "ERROR: 0:12: ..." (amd),
+    // where the first number is the source string number set by #line
+    static std::string MapInfoLogFiles(const std::string& infoLog, const std::vector<std::string>& files)
+    {
+        if (files.empty())
+            return infoLog;
+
+        std::istringstream stream(infoLog);
+        std::string line;
+        std::string mapped;
+        while (std::getline(stream, line))
+        {
+            size_t numberStart = 0;
+            for (const char* prefix : {"ERROR: ", "WARNING: "})
+            {
+                if (line.rfind(prefix, 0) == 0)
+                    numberStart = std::string(prefix).size();
+            }
+
+            size_t numberEnd = numberStart;
+            while (numberEnd < line.size() && std::isdigit((unsigned char)line[numberEnd]))
+                numberEnd++;
+
+            if (numberEnd > numberStart && numberEnd < line.size() && (line[numberEnd] == ':' || line[numberEnd] == '('))
+            {
+                int fileIndex = std::stoi(line.substr(numberStart, numberEnd - numberStart));
+                if (fileIndex < files.size())
+                {
+                    std::string fileName = files[fileIndex].substr(files[fileIndex].find_last_of('/') + 1);
+                    line = line.substr(0, numberStart) + fileName + line.substr(numberEnd);
+                }
+            }
+            mapped += line + "\n";
+        }
+        return mapped;
     }
 };
\ No newline at end of file
@@ -0,0 +1,399 @@
+#pragma once
+
+#include "../lib/glad.h"
+#include <GLFW/glfw3.h>
+
+#include "shader.hpp"
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <iostream>
+
+
+// GL_KHR_parallel_shader_compile isnt part of our glad build (core 4.6, no extensions) so its bits are declared here
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+
+// watches the glsl files of registered shaders with inotify and rebuilds their programs in the background when they change.
+// with GL_KHR_parallel_shader_compile the driver compiles on its own threads and completion is polled once per frame,
+// otherwise programs are built on a worker thread that owns a hidden context shared with the main window.
+// either way the old program stays in use until the new one has linked successfully.
+class ShaderHotReloader
+{
+public:
+    ShaderHotReloader(GLFWwindow* mainWindow)
+    {
+        inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFD == -1)
+        {
+            std::cout << "(Shader Reload): Error: inotify_init1 failed, shaders will not be hot reloaded" << std::endl;
+        }
+
+        if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+        {
+            parallelCompile = true;
+
+            auto maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+            if (maxShaderCompilerThreads)
+            {
+                maxShaderCompilerThreads(0xFFFFFFFF); // let the driver decide how many threads to use
+            }
+        }
+        else
+        {
+            // has to be created on the main thread, it only gets made current on the worker
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+            workerContext = glfwCreateWindow(1, 1, "shader compile context", NULL, mainWindow);
+            glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+            if (workerContext)
+            {
+                worker = std::thread(&ShaderHotReloader::WorkerLoop, this);
+            }
+            else
+            {
+                std::cout << "(Shader Reload): Error: failed to create shared compile context, shaders will not be hot reloaded" << std::endl;
+            }
+        }
+    }
+
+    ~ShaderHotReloader()
+    {
+        Shutdown();
+    }
+
+    // register a shader for reloading, onReload is called after a new program has been swapped in
+    // so uniforms that are only set once at startup can be set again
+    void Watch(Shader& shader, std::function<void(Shader&)> onReload = nullptr)
+    {
+        if (inotifyFD == -1)
+            return;
+
+        for (auto& file : shader.dependencies)
+        {
+            WatchFile(file);
+        }
+
+        WatchedProgram program;
+        program.shader = &shader;
+        program.onReload = onReload;
+        programs.push_back(program);
+
+        RebuildDependencyGraph();
+    }
+
+    // called once per frame from the render loop, never waits on the driver or the worker
+    void Poll()
+    {
+        if (inotifyFD == -1)
+            return;
+
+        ReadFileEvents();
+
+        for (int i = 0; i < programs.size(); i++)
+        {
+            if (programs[i].dirty && !programs[i].compiling)
+            {
+                StartCompile(i);
+            }
+        }
+
+        if (parallelCompile)
+        {
+            for (int i = 0; i < (int)pending.size(); i++)
+            {
+                int done = 0;
+                glGetProgramiv(pending[i].program, GL_COMPLETION_STATUS_KHR, &done);
+                if (!done)
+                    continue;
+
+                PendingCompile job = pending[i];
+                pending.erase(pending.begin() + i);
+                i--;
+
+                FinishCompile(job, CheckAndDeleteStages(job));
+            }
+        }
+        else
+        {
+            std::deque<PendingCompile> done;
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                done.swap(finished);
+            }
+            for (auto& job : done)
+            {
+                FinishCompile(job, job.success);
+            }
+        }
+    }
+
+    bool IsCompiling(const Shader& shader) const
+    {
+        for (auto& program : programs)
+        {
+            if (program.shader == &shader)
+                return program.compiling;
+        }
+        return false;
+    }
+
+    // stops the worker and destroys its context, has to happen before glfwTerminate
+    void Shutdown()
+    {
+        if (worker.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                stopWorker = true;
+            }
+            queueCondition.notify_one();
+            worker.join();
+        }
+        if (workerContext)
+        {
+            glfwDestroyWindow(workerContext);
+            workerContext = nullptr;
+        }
+        if (inotifyFD != -1)
+        {
+            close(inotifyFD);
+            inotifyFD = -1;
+        }
+    }
+
+private:
+    struct WatchedProgram
+    {
+        Shader* shader;
+        std::function<void(Shader&)> onReload;
+        bool dirty = false;
+        bool compiling = false;
+    };
+
+    struct PendingCompile
+    {
+        int programIndex;
+        std::vector<Shader::Stage> stages;
+        std::vector<Shader::Source> sources; // one per stage
+        std::vector<unsigned int> stageIDs;
+        unsigned int program = 0;
+        bool success = false;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    int inotifyFD = -1;
+    std::unordered_map<int, std::string> watchDirs; // inotify watch descriptor -> directory
+    std::vector<WatchedProgram> programs;
+    std::unordered_map<std::string, std::vector<int>> fileDependents; // glsl file -> indices of programs built from it
+
+    bool parallelCompile = false;
+    std::vector<PendingCompile> pending; // parallel compile jobs the driver is still working on
+
+    // fallback worker
+    GLFWwindow* workerContext = nullptr;
+    std::thread worker;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::deque<PendingCompile> queued;
+    std::deque<PendingCompile> finished;
+    bool stopWorker = false;
+
+
+    // editors either write the file in place or write a temp file and rename it over, so both are watched.
+    // watching the directory instead of the file also survives the rename
+    void WatchFile(const std::string& path)
+    {
+        std::string dir = path.substr(0, path.find_last_of('/'));
+        for (auto& [wd, watchedDir] : watchDirs)
+        {
+            if (watchedDir == dir)
+                return;
+        }
+
+        int wd = inotify_add_watch(inotifyFD, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd == -1)
+        {
+            std::cout << "(Shader Reload): Error: could not watch directory " << dir << std::endl;
+            return;
+        }
+        watchDirs[wd] = dir;
+    }
+
+    // inverse of every program's dependency list
+    void RebuildDependencyGraph()
+    {
+        fileDependents.clear();
+        for (int i = 0; i < programs.size(); i++)
+        {
+            for (auto& file : programs[i].shader->dependencies)
+            {
+                fileDependents[file].push_back(i);
+            }
+        }
+    }
+
+    void ReadFileEvents()
+    {
+        alignas(inotify_event) char buffer[4096];
+        while (true)
+        {
+            ssize_t length = read(inotifyFD, buffer, sizeof(buffer));
+            if (length <= 0)
+                break; // EAGAIN, nothing left to read
+
+            for (char* ptr = buffer; ptr < buffer + length; ptr += sizeof(inotify_event) + ((inotify_event*)ptr)->len)
+            {
+                inotify_event* event = (inotify_event*)ptr;
+                if (event->len == 0 || !watchDirs.count(event->wd))
+                    continue;
+
+                // only the programs that actually include the changed file get rebuilt
+                std::string path = watchDirs[event->wd] + "/" + event->name;
+                auto dependents = fileDependents.find(path);
+                if (dependents == fileDependents.end())
+                    continue;
+
+                for (int programIndex : dependents->second)
+                {
+                    programs[programIndex].dirty = true;
+                }
+            }
+        }
+    }
+
+    void StartCompile(int programIndex)
+    {
+        WatchedProgram& watched = programs[programIndex];
+        watched.dirty = false;
+        watched.compiling = true;
+
+        PendingCompile job;
+        job.programIndex = programIndex;
+        job.start = std::chrono::steady_clock::now();
+        job.stages = watched.shader->GetStages();
+        for (auto& stage : job.stages)
+        {
+            job.sources.push_back(watched.shader->LoadSource(stage.path));
+        }
+
+        // includes may have been added or removed since the last build
+        watched.shader->dependencies = Shader::CollectDependencies(job.sources);
+        for (auto& file : watched.shader->dependencies)
+        {
+            WatchFile(file);
+        }
+        RebuildDependencyGraph();
+
+        if (parallelCompile)
+        {
+            // these return straight away, the driver finishes them on its own threads
+            CompileAndLink(job);
+            pending.push_back(job);
+        }
+        else
+        {
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                queued.push_back(job);
+            }
+            queueCondition.notify_one();
+        }
+    }
+
+    static void CompileAndLink(PendingCompile& job)
+    {
+        for (int i = 0; i < job.stages.size(); i++)
+        {
+            job.stageIDs.push_back(Shader::CompileStage(job.stages[i].type, job.sources[i].code));
+        }
+        job.program = Shader::LinkProgram(job.stageIDs);
+    }
+
+    // queries the status, which waits for the driver if it hasnt finished yet
+    static bool CheckAndDeleteStages(PendingCompile& job)
+    {
+        bool success = true;
+        for (int i = 0; i < job.stages.size(); i++)
+        {
+            success &= Shader::checkCompileErrors(job.stageIDs[i], job.stages[i].name, job.sources[i].files);
+            glDeleteShader(job.stageIDs[i]);
+        }
+        success &= Shader::checkCompileErrors(job.program, "PROGRAM");
+        return success;
+    }
+
+    void FinishCompile(PendingCompile& job, bool success)
+    {
+        WatchedProgram& watched = programs[job.programIndex];
+        Shader& shader = *watched.shader;
+        watched.compiling = false;
+
+        float compileMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - job.start).count();
+        std::string name = shader.GetName();
+
+        if (!success)
+        {
+            glDeleteProgram(job.program);
+            std::cout << "(Shader Reload): Error: " << name << " failed to build, keeping the old program" << std::endl;
+            return;
+        }
+
+        // deleting the old program is deferred by gl if it is still bound
+        glDeleteProgram(shader.shaderProgramID);
+        shader.shaderProgramID = job.program;
+        shader.compileTimeMs = compileMs;
+
+        if (watched.onReload)
+        {
+            shader.use();
+            watched.onReload(shader);
+        }
+
+        std::cout << "(Shader Reload): Rebuilt " << name << " in " << compileMs << " ms" << std::endl;
+    }
+
+    void WorkerLoop()
+    {
+        glfwMakeContextCurrent(workerContext);
+
+        while (true)
+        {
+            PendingCompile job;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCondition.wait(lock, [this] { return stopWorker || !queued.empty(); });
+                if (stopWorker)
+                    break;
+
+                job = queued.front();
+                queued.pop_front();
+            }
+
+            CompileAndLink(job);
+
+            // blocking is fine here, this thread does nothing else
+            job.success = CheckAndDeleteStages(job);
+
+            glFinish(); // program has to be complete before the main context starts using it
+
+            std::lock_guard<std::mutex> lock(queueMutex);
+            finished.push_back(job);
+        }
+
+        glfwMakeContextCurrent(NULL);
+    }
+};
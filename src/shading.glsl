@@ -0,0 +1,77 @@
+#pragma once
+
+// every light applied to one surface, shared by the forward fragment shader and the deferred lighting pass
+// so both paths light things exactly the same
+#include "lighting.glsl"
+#include "lights.glsl"
+#include "frame.glsl"
+#include "shadows.glsl"
+#include "probes.glsl"
+#include "ssao.glsl"
+
+uniform DirLight dirLight;
+uniform SpotLight spotLight;
+uniform int lightList = -1; // index into lightLists, set per draw by the render queue. -1 = use the clusters
+
+vec3 shadeSurface(Surface surface, vec3 norm, vec3 fragPos, vec2 fragCoord)
+{
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+    float viewDepth = -(view * vec4(fragPos, 1.0)).z;
+
+    // screen space occlusion only darkens the indirect light, direct light has its shadows
+    float occlusion = getAmbientOcclusion(fragCoord, viewDepth);
+    surface.ambient *= occlusion;
+
+    // baked indirect light, it replaces the lights' ambient terms
+    vec3 result = vec3(0.0);
+    if (probesEnabled())
+    {
+        result += surface.diffuse * getProbeIrradiance(fragPos, norm) * occlusion;
+        surface.ambient = 0.0;
+    }
+
+    // directional lights
+    float shadow = getDirectionalShadow(fragPos, norm, viewDepth);
+    result += calcDirLight(dirLight, surface, norm, viewDir, shadow);
+
+    // point lights, the draw's own list if it has one, otherwise the ones assigned to this fragment's cluster.
+    // a clipped list is missing lights, those draws use the clusters too so a list never lights less than them
+    bool spotLightReaches = true;
+    uint lightCount;
+    if (lightList >= 0 && lightLists[lightList].clipped == 0u)
+    {
+        LightList list = lightLists[lightList];
+        lightCount = list.count;
+        spotLightReaches = list.spotLight != 0u;
+        for (uint i = 0; i < lightCount; i++)
+        {
+            uint lightIndex = lightListIndices[uint(lightList) * MAX_LIGHTS_PER_LIST + i];
+            PointLight light = pointLights[lightIndex];
+            float lightShadow = getPointLightShadow(lightIndex, light.position, fragPos, norm);
+            result += calcPointLight(light, surface, norm, fragPos, viewDir, lightShadow);
+        }
+    }
+    else
+    {
+        uint cluster = getClusterIndex(fragCoord, viewDepth);
+        lightCount = min(clusterLightCounts[cluster], uint(MAX_LIGHTS_PER_CLUSTER));
+        for (uint i = 0; i < lightCount; i++)
+        {
+            uint lightIndex = clusterLightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + i];
+            PointLight light = pointLights[lightIndex];
+            float lightShadow = getPointLightShadow(lightIndex, light.position, fragPos, norm);
+            result += calcPointLight(light, surface, norm, fragPos, viewDir, lightShadow);
+        }
+    }
+
+    if (spotLightReaches)
+    {
+        result += calcSpotLight(spotLight, surface, norm, fragPos, viewDir, getSpotLightShadow(spotLight.position, fragPos, norm));
+    }
+
+    // emission
+    result += surface.emission;
+
+    return result;
+}
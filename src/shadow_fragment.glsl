@@ -0,0 +1,32 @@
+#version 460 core
+
+// depth only. the ALPHA_TEST variant discards like fragment.glsl, so cutout meshes cast the shadow of their texture.
+// it has no per draw material uniforms, the material is looked up by index from the materials ssbo
+#ifdef ALPHA_TEST
+#define MATERIAL_BUFFER
+#include "materials.glsl"
+
+in vec2 texCoord;
+
+uniform sampler2DArray texArray;
+uniform ivec2 subTexRes[100]; // size should be same as tex array
+uniform int materialID;
+
+void main()
+{
+    Material mat = materials[materialID];
+    if (mat.diffuseLayerCount == 0)
+        return;
+
+    int layer = mat.diffuseStartLayer;
+    vec2 scale = vec2(subTexRes[layer]) / vec2(4096, 4096); // denominator is the max res of the texture array
+    if (texture(texArray, vec3(texCoord * scale, float(layer))).a < 0.5)
+    {
+        discard;
+    }
+}
+#else
+void main()
+{
+}
+#endif
@@ -0,0 +1,19 @@
+#version 460 core
+
+// renders a mesh into one cascade of the directional light's shadow map, see CascadedShadowMap in shadows.hpp
+layout (location = 0) in vec3 inPos;
+layout (location = 2) in vec2 inTexCoord;
+
+#include "transforms.glsl"
+
+uniform mat4 lightViewProjection;
+
+out vec2 texCoord;
+
+void main()
+{
+    ObjectTransform object = getObjectTransform();
+
+    gl_Position = lightViewProjection * object.model * vec4(inPos, 1.0);
+    texCoord = inTexCoord;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+// cascaded shadow maps of the directional light, see CascadedShadowMap in shadows.hpp
+#define CASCADE_COUNT 4
+
+layout (std140, binding = 1) uniform ShadowUniforms
+{
+    mat4 cascadeViewProjections[CASCADE_COUNT];
+    vec4 cascadeSplits;     // far view depth of every cascade
+    vec4 cascadeTexelSizes; // world size of one texel
+    int shadowsEnabled;
+};
+
+layout (binding = 8) uniform sampler2DArrayShadow shadowMap;
+
+// 1 = lit, 0 = fully in shadow
+float getDirectionalShadow(vec3 fragPos, vec3 normal, float viewDepth)
+{
+    if (shadowsEnabled == 0 || viewDepth > cascadeSplits[CASCADE_COUNT - 1])
+        return 1.0;
+
+    int cascade = 0;
+    while (cascade < CASCADE_COUNT - 1 && viewDepth > cascadeSplits[cascade])
+    {
+        cascade++;
+    }
+
+    // pushing the lookup out along the normal by about a texel gets rid of most of the acne on its own
+    vec3 offsetPos = fragPos + normal * cascadeTexelSizes[cascade] * 1.5;
+    vec3 shadowCoord = (cascadeViewProjections[cascade] * vec4(offsetPos, 1.0)).xyz * 0.5 + 0.5; // orthographic, w is 1
+
+    // 3x3 pcf on top of the hardware's 2x2 compare
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0;
+    for (int x = -1; x <= 1; x++)
+    {
+        for (int y = -1; y <= 1; y++)
+        {
+            lit += texture(shadowMap, vec4(shadowCoord.xy + vec2(x, y) * texelSize, float(cascade), shadowCoord.z));
+        }
+    }
+    return lit / 9.0;
+}
+
+
+// shadow atlas of the point and spot lights, see ShadowAtlas in shadows.hpp
+struct ShadowTile
+{
+    mat4 viewProjection;
+    vec4 rect;   // atlas uv offset in xy, size in zw, zero size = not rendered yet
+    vec4 params; // x = world size of a texel one unit away from the light
+};
+layout (std430, binding = 12) readonly buffer PointLightShadows
+{
+    int pointLightShadows[]; // first of the light's 6 tiles, -1 = no shadow
+};
+layout (std430, binding = 13) readonly buffer ShadowTiles
+{
+    int spotLightShadow; // -1 = no shadow
+    ShadowTile shadowTiles[];
+};
+
+layout (binding = 9) uniform sampler2DShadow shadowAtlas;
+
+float sampleShadowTile(ShadowTile tile, vec3 fragPos, vec3 normal, float lightDistance)
+{
+    if (tile.rect.z == 0.0)
+        return 1.0;
+
+    vec3 offsetPos = fragPos + normal * tile.params.x * lightDistance * 1.5;
+    vec4 clipPos = tile.viewProjection * vec4(offsetPos, 1.0);
+    vec3 shadowCoord = clipPos.xyz / clipPos.w * 0.5 + 0.5;
+    if (shadowCoord.z > 1.0)
+        return 1.0;
+
+    // neighbouring tiles belong to other lights, so the lookup stays a texel inside this one
+    vec2 texelSize = 1.0 / vec2(textureSize(shadowAtlas, 0));
+    vec2 uv = clamp(tile.rect.xy + shadowCoord.xy * tile.rect.zw, tile.rect.xy + texelSize, tile.rect.xy + tile.rect.zw - texelSize);
+    return texture(shadowAtlas, vec3(uv, shadowCoord.z));
+}
+
+float getPointLightShadow(uint lightIndex, vec3 lightPos, vec3 fragPos, vec3 normal)
+{
+    int firstTile = pointLightShadows[lightIndex];
+    if (firstTile < 0)
+        return 1.0;
+
+    // cube face by the major axis, same order as ShadowAtlas: +x, -x, +y, -y, +z, -z
+    vec3 toFrag = fragPos - lightPos;
+    vec3 absToFrag = abs(toFrag);
+    int face;
+    if (absToFrag.x >= absToFrag.y && absToFrag.x >= absToFrag.z)
+        face = toFrag.x > 0.0 ? 0 : 1;
+    else if (absToFrag.y >= absToFrag.z)
+        face = toFrag.y > 0.0 ? 2 : 3;
+    else
+        face = toFrag.z > 0.0 ? 4 : 5;
+
+    return sampleShadowTile(shadowTiles[firstTile + face], fragPos, normal, length(toFrag));
+}
+
+float getSpotLightShadow(vec3 lightPos, vec3 fragPos, vec3 normal)
+{
+    if (spotLightShadow < 0)
+        return 1.0;
+    return sampleShadowTile(shadowTiles[spotLightShadow], fragPos, normal, length(fragPos - lightPos));
+}
@@ -0,0 +1,703 @@
+#pragma once
+
+#include "../lib/glad.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include "gl_state.hpp"
+#include "ring_buffer.hpp"
+#include "frustum.hpp"
+#include "lights.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+
+// uniform block binding, has to match shadows.glsl
+const GLuint SHADOW_UBO_BINDING = 1;
+
+// matches ShadowUniforms in shadows.glsl (std140)
+struct ShadowData
+{
+    glm::mat4 cascadeViewProjections[4];
+    glm::vec4 cascadeSplits;     // far view depth of every cascade
+    glm::vec4 cascadeTexelSizes; // world size of one shadow map texel, for the normal offset
+    int enabled;
+    int pad[3];
+};
+static_assert(sizeof(ShadowData) == 304, "ShadowData has to match the std140 layout of ShadowUniforms");
+
+
+// cascaded shadow maps for the directional light, one layer of a depth texture array per cascade.
+// every cascade is fitted to a bounding sphere of its slice of the camera frustum, so its size doesnt change when
+// the camera turns, and the sphere's center is snapped to whole texels in light space so edges dont shimmer when it moves.
+// the far cascades only ever get static geometry and are cached: they are fitted with some margin and only re-rendered
+// when the light changes, the static geometry changes or the camera leaves the margin
+class CascadedShadowMap
+{
+public:
+    static const int CASCADE_COUNT = 4; // has to match shadows.glsl
+    static const int RESOLUTION = 2048;
+    static const int FIRST_CACHED_CASCADE = 2;
+    static const GLuint TEXTURE_UNIT = 8; // g-buffer targets use the ones before
+
+    float splitLambda = 0.75f;  // 0 = linear splits, 1 = logarithmic
+    float cacheMargin = 1.25f;  // cached cascades cover this much more than they need
+    float casterDistance = 50.0f; // how far towards the light casters outside a cascade's sphere are still rendered
+
+    struct Stats
+    {
+        int renderedCascades = 0;
+        int cachedCascades = 0;
+    };
+
+    // fits every cascade to the camera, call once per frame before NeedsRender.
+    // staticVersion has to change whenever static geometry moved (TransformBuffer::GetVersion)
+    void Update(const glm::mat4& view, float fovY, float aspect, float nearPlane, float shadowDistance, glm::vec3 lightDirection, unsigned int staticVersion)
+    {
+        if (texture == 0)
+        {
+            Create();
+        }
+
+        lightDirection = glm::normalize(lightDirection);
+        bool lightChanged = lightDirection != lastLightDirection;
+        bool geometryChanged = staticVersion != lastStaticVersion;
+        lastLightDirection = lightDirection;
+        lastStaticVersion = staticVersion;
+
+        glm::vec3 up = std::abs(lightDirection.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+
+        glm::mat4 inverseView = glm::inverse(view);
+        float tanHalfY = std::tan(fovY * 0.5f);
+        float tanHalfX = tanHalfY * aspect;
+
+        stats = Stats();
+        float sliceNear = nearPlane;
+        for (int i = 0; i < CASCADE_COUNT; i++)
+        {
+            // practical split scheme, a blend of logarithmic and linear
+            float t = (float)(i + 1) / CASCADE_COUNT;
+            float logSplit = nearPlane * std::pow(shadowDistance / nearPlane, t);
+            float linearSplit = nearPlane + (shadowDistance - nearPlane) * t;
+            float sliceFar = splitLambda * logSplit + (1.0f - splitLambda) * linearSplit;
+
+            // bounding sphere of the slice's 8 corners. its radius only depends on the slice, not the camera rotation
+            glm::vec3 corners[8];
+            glm::vec3 center(0.0f);
+            for (int c = 0; c < 8; c++)
+            {
+                float depth = c < 4 ? sliceNear : sliceFar;
+                glm::vec3 viewCorner((c & 1 ? 1.0f : -1.0f) * tanHalfX * depth, (c & 2 ? 1.0f : -1.0f) * tanHalfY * depth, -depth);
+                corners[c] = glm::vec3(inverseView * glm::vec4(viewCorner, 1.0f));
+                center += corners[c] / 8.0f;
+            }
+            float radius = 0.0f;
+            for (auto& corner : corners)
+            {
+                radius = std::max(radius, glm::length(corner - center));
+            }
+            radius = std::ceil(radius * 16.0f) / 16.0f; // float noise would change the texel size every frame
+
+            Cascade& cascade = cascades[i];
+            cascade.splitFar = sliceFar;
+            sliceNear = sliceFar;
+
+            bool cached = i >= FIRST_CACHED_CASCADE;
+            if (cached && cascade.valid && !lightChanged && !geometryChanged && glm::length(center - cascade.center) + radius <= cascade.radius)
+            {
+                cascade.needsRender = false;
+                stats.cachedCascades++;
+                continue;
+            }
+
+            Fit(cascade, lightView, center, cached ? radius * cacheMargin : radius);
+            cascade.valid = true;
+            cascade.needsRender = true;
+            stats.renderedCascades++;
+        }
+    }
+
+    bool NeedsRender(int cascade) const
+    {
+        return cascades[cascade].needsRender;
+    }
+
+    // cached cascades should only get static geometry
+    bool IsCached(int cascade) const
+    {
+        return cascade >= FIRST_CACHED_CASCADE;
+    }
+
+    const glm::mat4& GetViewProjection(int cascade) const
+    {
+        return cascades[cascade].viewProjection;
+    }
+
+    // binds the framebuffer, call before the first BeginCascade of the frame
+    void Begin()
+    {
+        glGetIntegerv(GL_VIEWPORT, savedViewport);
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, RESOLUTION, RESOLUTION);
+
+        // slope scaled bias against acne, depth clamp keeps casters between the light and the near plane
+        GLState::Get().SetEnabled(GL_POLYGON_OFFSET_FILL, true);
+        glPolygonOffset(2.0f, 4.0f);
+        GLState::Get().SetEnabled(GL_DEPTH_CLAMP, true);
+    }
+
+    // points the framebuffer at the cascade's layer and clears it
+    void BeginCascade(int cascade)
+    {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, cascade);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    void End()
+    {
+        GLState::Get().SetEnabled(GL_POLYGON_OFFSET_FILL, false);
+        GLState::Get().SetEnabled(GL_DEPTH_CLAMP, false);
+
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+    }
+
+    // writes the cascades into the ShadowUniforms block and binds the shadow map for sampling
+    void BindForSampling(bool enabled)
+    {
+        if (texture == 0)
+        {
+            Create();
+        }
+
+        auto allocation = DynamicRingBuffer::Get().AllocateUniform(sizeof(ShadowData));
+        if (!allocation.data)
+            return;
+
+        ShadowData data = {};
+        for (int i = 0; i < CASCADE_COUNT; i++)
+        {
+            data.cascadeViewProjections[i] = cascades[i].viewProjection;
+            data.cascadeSplits[i] = cascades[i].splitFar;
+            data.cascadeTexelSizes[i] = cascades[i].texelSize;
+        }
+        data.enabled = enabled && cascades[0].valid;
+        std::memcpy(allocation.data, &data, sizeof(ShadowData));
+        GLState::Get().BindBufferRange(GL_UNIFORM_BUFFER, SHADOW_UBO_BINDING, allocation.buffer, allocation.offset, allocation.size);
+
+        GLState::Get().BindTexture(TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, texture);
+    }
+
+    const Stats& GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    struct Cascade
+    {
+        glm::mat4 viewProjection = glm::mat4(1.0f);
+        glm::vec3 center = glm::vec3(0.0f); // world space sphere the cascade covers
+        float radius = 0.0f;
+        float splitFar = 0.0f;
+        float texelSize = 0.0f;
+        bool valid = false;
+        bool needsRender = false;
+    };
+
+    Cascade cascades[CASCADE_COUNT];
+    glm::vec3 lastLightDirection = glm::vec3(0.0f);
+    unsigned int lastStaticVersion = 0;
+    Stats stats;
+
+    GLuint framebuffer = 0;
+    GLuint texture = 0;
+    GLint savedViewport[4];
+
+    void Fit(Cascade& cascade, const glm::mat4& lightView, glm::vec3 center, float radius)
+    {
+        // snap the center to whole texels in light space, so the cascade only ever moves by full texels
+        float texelSize = 2.0f * radius / RESOLUTION;
+        glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+        lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+        lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+
+        // lookAt looks down -z, the near plane is pulled back towards the light so casters outside the sphere still land in the map
+        glm::mat4 lightProjection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius, lightCenter.y + radius,
+            -lightCenter.z - radius - casterDistance, -lightCenter.z + radius);
+
+        cascade.viewProjection = lightProjection * lightView;
+        cascade.center = glm::vec3(glm::inverse(lightView) * glm::vec4(lightCenter, 1.0f));
+        cascade.radius = radius;
+        cascade.texelSize = texelSize;
+    }
+
+    void Create()
+    {
+        glGenTextures(1, &texture);
+        GLState::Get().BindTexture(TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY, texture);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, RESOLUTION, RESOLUTION, CASCADE_COUNT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        float border[] = {1.0f, 1.0f, 1.0f, 1.0f}; // outside the map is lit
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+        // hardware pcf through sampler2DArrayShadow
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+        glGenFramebuffers(1, &framebuffer);
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "(CascadedShadowMap): Error: framebuffer is not complete" << std::endl;
+        }
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
+
+
+// ssbo bindings of the atlas, have to match shadows.glsl
+const GLuint POINT_LIGHT_SHADOW_SSBO_BINDING = 12;
+const GLuint SHADOW_TILE_SSBO_BINDING = 13;
+
+// matches ShadowTile in shadows.glsl (std430)
+struct ShadowTileData
+{
+    glm::mat4 viewProjection;
+    glm::vec4 rect;   // atlas uv offset in xy, size in zw, zero size = nothing rendered yet
+    glm::vec4 params; // x = world size of a texel one unit away from the light
+};
+static_assert(sizeof(ShadowTileData) == 96, "ShadowTileData has to match the std430 layout of ShadowTile");
+
+// the spot light as far as shadows are concerned
+struct SpotShadowCaster
+{
+    glm::vec3 position;
+    glm::vec3 direction;
+    float radius;
+    float outerAngle; // radians, half of the cone
+};
+
+
+// one depth atlas for every shadow of the point and spot lights. lights get tiles by how big they are on screen:
+// the atlas is split into one region per tile size and each region has a free list of slots.
+// point lights take 6 slots of the same size (one per cube face), spot lights 1.
+// tiles stay cached until their light moves or the static geometry changes, and only tileBudget of them are re-rendered
+// per frame, most important first. a stale tile keeps the matrix it was rendered with, so it stays correct for where
+// the light was until it gets its turn
+class ShadowAtlas
+{
+public:
+    static const int SIZE = 4096;
+    static const int LEVEL_COUNT = 4;
+    static constexpr int TILE_SIZES[LEVEL_COUNT] = {512, 256, 128, 64};
+    static constexpr int LEVEL_HEIGHTS[LEVEL_COUNT] = {2048, 1024, 512, 512}; // stacked from the bottom of the atlas
+    static const int MAX_SHADOWED_LIGHTS = 64;
+    static const GLuint TEXTURE_UNIT = 9; // cascaded shadow map uses the one before
+
+    int tileBudget = 24;
+    float nearPlane = 0.05f;
+
+    struct TileRender
+    {
+        glm::mat4 viewProjection;
+        int x, y, size;
+    };
+
+    struct Stats
+    {
+        int shadowedLights = 0;
+        int renderedTiles = 0;
+        int cachedTiles = 0;
+        int staleTiles = 0; // over budget this frame
+        int usedSlots[LEVEL_COUNT] = {};
+        int slotCounts[LEVEL_COUNT] = {};
+    };
+
+    ShadowAtlas()
+    {
+        for (int level = 0; level < LEVEL_COUNT; level++)
+        {
+            int count = (SIZE / TILE_SIZES[level]) * (LEVEL_HEIGHTS[level] / TILE_SIZES[level]);
+            // popped from the back, so slot 0 goes first
+            for (int slot = count - 1; slot >= 0; slot--)
+            {
+                freeSlots[level].push_back(slot);
+            }
+        }
+    }
+
+    // picks the lights that get shadows, (re)allocates their tiles and fills the render list for this frame
+    void Update(glm::vec3 cameraPosition, const Frustum& cameraFrustum, const std::vector<PointLight>& pointLights, const SpotShadowCaster& spotLight, unsigned int staticVersion)
+    {
+        if (texture == 0)
+        {
+            Create();
+        }
+
+        bool geometryChanged = staticVersion != lastStaticVersion;
+        lastStaticVersion = staticVersion;
+
+        // a bit wider than the cone so the pcf at its edge stays inside the tile
+        spotLightAngle = std::min(spotLight.outerAngle + glm::radians(5.0f), glm::radians(85.0f));
+
+        // importance is roughly how much of the screen the light's sphere covers, 1 when the camera is inside it
+        candidates.clear();
+        auto addCandidate = [&](int key, glm::vec3 position, float radius)
+        {
+            if (radius <= 0.0f || !cameraFrustum.IntersectsSphere(position, radius))
+                return;
+            float importance = radius / std::max(glm::length(position - cameraPosition), radius);
+            candidates.push_back({key, importance});
+        };
+        for (int i = 0; i < pointLights.size(); i++)
+        {
+            addCandidate(i, pointLights[i].position, pointLights[i].radius);
+        }
+        addCandidate(SPOT_LIGHT_KEY, spotLight.position, spotLight.radius);
+
+        int keep = std::min((int)candidates.size(), MAX_SHADOWED_LIGHTS);
+        std::partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end(),
+            [](const Candidate& a, const Candidate& b) { return a.importance > b.importance; });
+        candidates.resize(keep);
+
+        // let go of lights that dropped out or whose tile size is off by more than one level, the rest keep their tiles
+        for (auto& [key, light] : lights)
+        {
+            light.importance = -1.0f;
+        }
+        for (auto& candidate : candidates)
+        {
+            auto it = lights.find(candidate.key);
+            if (it != lights.end() && std::abs(it->second.level - LevelForImportance(candidate.importance)) <= 1)
+            {
+                it->second.importance = candidate.importance;
+            }
+        }
+        for (auto it = lights.begin(); it != lights.end();)
+        {
+            if (it->second.importance < 0.0f)
+            {
+                Release(it->second);
+                it = lights.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        // new lights, most important first. they go one size smaller when their size is full
+        for (auto& candidate : candidates)
+        {
+            if (lights.count(candidate.key))
+                continue;
+
+            ShadowedLight light;
+            light.key = candidate.key;
+            light.importance = candidate.importance;
+            light.faceCount = candidate.key == SPOT_LIGHT_KEY ? 1 : 6;
+            for (int level = LevelForImportance(candidate.importance); level < LEVEL_COUNT; level++)
+            {
+                if (freeSlots[level].size() >= light.faceCount)
+                {
+                    light.level = level;
+                    for (int face = 0; face < light.faceCount; face++)
+                    {
+                        light.faces[face].slot = freeSlots[level].back();
+                        freeSlots[level].pop_back();
+                    }
+                    lights[light.key] = light;
+                    break;
+                }
+            }
+        }
+
+        // work out which faces are out of date
+        pending.clear();
+        for (auto& [key, light] : lights)
+        {
+            glm::vec3 position = key == SPOT_LIGHT_KEY ? spotLight.position : pointLights[key].position;
+            glm::vec3 direction = key == SPOT_LIGHT_KEY ? spotLight.direction : glm::vec3(0.0f);
+            float radius = key == SPOT_LIGHT_KEY ? spotLight.radius : pointLights[key].radius;
+            if (geometryChanged || position != light.position || direction != light.direction || radius != light.radius)
+            {
+                for (int face = 0; face < light.faceCount; face++)
+                {
+                    light.faces[face].upToDate = false;
+                }
+                light.position = position;
+                light.direction = direction;
+                light.radius = radius;
+            }
+
+            for (int face = 0; face < light.faceCount; face++)
+            {
+                if (!light.faces[face].upToDate)
+                {
+                    pending.push_back({&light, face});
+                }
+            }
+        }
+
+        // empty tiles first since they have no shadow at all yet, then by importance
+        std::sort(pending.begin(), pending.end(), [](const PendingFace& a, const PendingFace& b)
+        {
+            bool aEmpty = !a.light->faces[a.face].rendered;
+            bool bEmpty = !b.light->faces[b.face].rendered;
+            if (aEmpty != bEmpty)
+                return aEmpty;
+            return a.light->importance > b.light->importance;
+        });
+
+        renderList.clear();
+        int renderCount = std::min((int)pending.size(), tileBudget);
+        for (int i = 0; i < renderCount; i++)
+        {
+            ShadowedLight& light = *pending[i].light;
+            Face& face = light.faces[pending[i].face];
+            face.viewProjection = FaceViewProjection(light, pending[i].face);
+            face.rendered = true;
+            face.upToDate = true;
+
+            int tileSize = TILE_SIZES[light.level];
+            glm::ivec2 origin = SlotOrigin(light.level, face.slot);
+            renderList.push_back({face.viewProjection, origin.x, origin.y, tileSize});
+        }
+
+        stats = Stats();
+        stats.shadowedLights = lights.size();
+        stats.renderedTiles = renderCount;
+        stats.staleTiles = pending.size() - renderCount;
+        for (auto& [key, light] : lights)
+        {
+            stats.usedSlots[light.level] += light.faceCount;
+        }
+        for (int level = 0; level < LEVEL_COUNT; level++)
+        {
+            stats.slotCounts[level] = stats.usedSlots[level] + freeSlots[level].size();
+            stats.cachedTiles += stats.usedSlots[level];
+        }
+        stats.cachedTiles -= pending.size();
+    }
+
+    // tiles to render this frame, already within the budget
+    const std::vector<TileRender>& GetRenderList() const
+    {
+        return renderList;
+    }
+
+    void Begin()
+    {
+        glGetIntegerv(GL_VIEWPORT, savedViewport);
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+        GLState::Get().SetEnabled(GL_POLYGON_OFFSET_FILL, true);
+        glPolygonOffset(2.0f, 4.0f);
+        GLState::Get().SetEnabled(GL_SCISSOR_TEST, true); // so the clear only hits the tile
+    }
+
+    void BeginTile(const TileRender& tile)
+    {
+        glViewport(tile.x, tile.y, tile.size, tile.size);
+        glScissor(tile.x, tile.y, tile.size, tile.size);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    void End()
+    {
+        GLState::Get().SetEnabled(GL_POLYGON_OFFSET_FILL, false);
+        GLState::Get().SetEnabled(GL_SCISSOR_TEST, false);
+
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+    }
+
+    // uploads every shadowed light's tiles and binds the atlas for sampling. pointLightCount has to match
+    // the lights the clusters were built from, the shader looks up one entry per point light
+    void BindForSampling(bool enabled, int pointLightCount)
+    {
+        if (texture == 0)
+        {
+            Create();
+        }
+
+        // first tile of every point light, -1 = no shadow
+        auto lightAllocation = DynamicRingBuffer::Get().AllocateStorage(std::max(pointLightCount, 1) * sizeof(GLint));
+        // spot light's tile in front of the tiles, padded to the tiles' alignment
+        size_t tileCount = enabled ? stats.usedSlots[0] + stats.usedSlots[1] + stats.usedSlots[2] + stats.usedSlots[3] : 0;
+        auto tileAllocation = DynamicRingBuffer::Get().AllocateStorage(16 + std::max<size_t>(tileCount, 1) * sizeof(ShadowTileData));
+        if (!lightAllocation.data || !tileAllocation.data)
+            return;
+
+        GLint* firstTiles = (GLint*)lightAllocation.data;
+        std::fill(firstTiles, firstTiles + std::max(pointLightCount, 1), -1);
+        GLint* spotTile = (GLint*)tileAllocation.data;
+        *spotTile = -1;
+        ShadowTileData* tiles = (ShadowTileData*)((char*)tileAllocation.data + 16);
+
+        int tileIndex = 0;
+        for (auto& [key, light] : lights)
+        {
+            if (!enabled)
+                break;
+            if (key == SPOT_LIGHT_KEY)
+                *spotTile = tileIndex;
+            else if (key < pointLightCount)
+                firstTiles[key] = tileIndex;
+
+            int tileSize = TILE_SIZES[light.level];
+            float texelScale = key == SPOT_LIGHT_KEY ? 2.0f * std::tan(spotLightAngle) / tileSize : 2.0f / tileSize;
+            for (int face = 0; face < light.faceCount; face++)
+            {
+                ShadowTileData& tile = tiles[tileIndex++];
+                tile.viewProjection = light.faces[face].viewProjection;
+                tile.params = glm::vec4(texelScale, 0.0f, 0.0f, 0.0f);
+                if (light.faces[face].rendered)
+                {
+                    glm::ivec2 origin = SlotOrigin(light.level, light.faces[face].slot);
+                    tile.rect = glm::vec4(origin.x, origin.y, tileSize, tileSize) / (float)SIZE;
+                }
+                else
+                {
+                    tile.rect = glm::vec4(0.0f);
+                }
+            }
+        }
+
+        GLState::Get().BindBufferRange(GL_SHADER_STORAGE_BUFFER, POINT_LIGHT_SHADOW_SSBO_BINDING, lightAllocation.buffer, lightAllocation.offset, lightAllocation.size);
+        GLState::Get().BindBufferRange(GL_SHADER_STORAGE_BUFFER, SHADOW_TILE_SSBO_BINDING, tileAllocation.buffer, tileAllocation.offset, tileAllocation.size);
+        GLState::Get().BindTexture(TEXTURE_UNIT, GL_TEXTURE_2D, texture);
+    }
+
+    const Stats& GetStats() const
+    {
+        return stats;
+    }
+
+private:
+    static const int SPOT_LIGHT_KEY = -1; // point lights are keyed by their index
+
+    struct Face
+    {
+        int slot = -1;
+        glm::mat4 viewProjection = glm::mat4(1.0f); // what the tile was last rendered with
+        bool rendered = false;
+        bool upToDate = false;
+    };
+
+    struct ShadowedLight
+    {
+        int key = 0;
+        int level = 0;
+        int faceCount = 0;
+        float importance = 0.0f;
+        Face faces[6];
+
+        // what the faces were last marked up to date for
+        glm::vec3 position = glm::vec3(0.0f);
+        glm::vec3 direction = glm::vec3(0.0f);
+        float radius = -1.0f;
+    };
+
+    struct Candidate
+    {
+        int key;
+        float importance;
+    };
+
+    struct PendingFace
+    {
+        ShadowedLight* light;
+        int face;
+    };
+
+    std::unordered_map<int, ShadowedLight> lights;
+    std::vector<int> freeSlots[LEVEL_COUNT];
+    std::vector<Candidate> candidates;
+    std::vector<PendingFace> pending;
+    std::vector<TileRender> renderList;
+    unsigned int lastStaticVersion = 0;
+    float spotLightAngle = 0.0f;
+    Stats stats;
+
+    GLuint framebuffer = 0;
+    GLuint texture = 0;
+    GLint savedViewport[4];
+
+    static int LevelForImportance(float importance)
+    {
+        if (importance >= 0.5f) return 0;
+        if (importance >= 0.2f) return 1;
+        if (importance >= 0.08f) return 2;
+        return 3;
+    }
+
+    static glm::ivec2 SlotOrigin(int level, int slot)
+    {
+        int y = 0;
+        for (int i = 0; i < level; i++)
+        {
+            y += LEVEL_HEIGHTS[i];
+        }
+        int tilesPerRow = SIZE / TILE_SIZES[level];
+        return glm::ivec2((slot % tilesPerRow) * TILE_SIZES[level], y + (slot / tilesPerRow) * TILE_SIZES[level]);
+    }
+
+    void Release(const ShadowedLight& light)
+    {
+        for (int face = 0; face < light.faceCount; face++)
+        {
+            freeSlots[light.level].push_back(light.faces[face].slot);
+        }
+    }
+
+    // point light faces are in the cube map order shadows.glsl picks them in: +x, -x, +y, -y, +z, -z
+    glm::mat4 FaceViewProjection(const ShadowedLight& light, int face) const
+    {
+        if (light.key == SPOT_LIGHT_KEY)
+        {
+            glm::vec3 up = std::abs(light.direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            return glm::perspective(2.0f * spotLightAngle, 1.0f, nearPlane, light.radius) * glm::lookAt(light.position, light.position + light.direction, up);
+        }
+
+        static const glm::vec3 directions[6] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+        static const glm::vec3 ups[6] = {{0, -1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}, {0, -1, 0}, {0, -1, 0}};
+        return glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, light.radius) * glm::lookAt(light.position, light.position + directions[face], ups[face]);
+    }
+
+    void Create()
+    {
+        glGenTextures(1, &texture);
+        GLState::Get().BindTexture(TEXTURE_UNIT, GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, SIZE, SIZE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+        glGenFramebuffers(1, &framebuffer);
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cout << "(ShadowAtlas): Error: framebuffer is not complete" << std::endl;
+        }
+        GLState::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+// half resolution ambient occlusion from SSAO in ssao.hpp
+#include "frame.glsl"
+
+layout (std140, binding = 3) uniform SsaoUniforms
+{
+    vec4 ssaoParams; // x = enabled, y = power
+};
+
+layout(binding = 12) uniform sampler2D ssaoTexture; // SSAO::TEXTURE_UNIT, r = occlusion, g = view depth (0 for the sky)
+
+#define SSAO_DEPTH_TOLERANCE 0.1
+
+// 1 = nothing occluded. the 4 half res texels around the fragment, weighted bilinearly and by how close their depth
+// is to the fragment's so occlusion doesnt bleed over edges. fragments none of them belong to (blended surfaces,
+// things drawn after the ao was computed) get no occlusion at all
+float getAmbientOcclusion(vec2 fragCoord, float viewDepth)
+{
+    if (ssaoParams.x < 0.5)
+        return 1.0;
+
+    // texel i was taken at the full res pixel 2i
+    ivec2 size = textureSize(ssaoTexture, 0);
+    vec2 position = (fragCoord - viewport.xy - 0.5) * 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+
+    float occlusion = 0.0;
+    float weightSum = 0.0;
+    for (int y = 0; y < 2; y++)
+    {
+        for (int x = 0; x < 2; x++)
+        {
+            vec2 s = texelFetch(ssaoTexture, clamp(base + ivec2(x, y), ivec2(0), size - 1), 0).rg;
+            float bilinear = (x == 0 ? 1.0 - f.x : f.x) * (y == 0 ? 1.0 - f.y : f.y);
+            float depthWeight = max(0.0, 1.0 - abs(s.g - viewDepth) / (SSAO_DEPTH_TOLERANCE * viewDepth));
+            // a little weight past the bilinear one so a matching texel still counts when it is the only one
+            float weight = depthWeight * (bilinear + 0.001);
+            occlusion += s.r * weight;
+            weightSum += weight;
+        }
+    }
+
+    if (weightSum <= 0.0)
+        return 1.0;
+    return pow(occlusion / weightSum, ssaoParams.y);
+}
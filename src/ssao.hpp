@@ -0,0 +1,226 @@
+#pragma once
+
+#include "../lib/glad.h"
+#include "glm/glm.hpp"
+
+#include "shader.hpp"
+#include "gl_state.hpp"
+#include "ring_buffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <string>
+
+
+// ubo binding of the ao settings, has to match ssao.glsl
+const GLuint SSAO_UBO_BINDING = 3;
+
+// screen space ambient occlusion at half resolution. ssao_compute.glsl rebuilds view space positions and normals
+// from the depth buffer, checks how much of the hemisphere around every half res texel is behind nearby depth,
+// then blurs that twice (horizontal/vertical) with weights that drop across depth edges.
+// ssao.glsl upsamples it per fragment the same depth aware way and it scales the ambient and probe light
+class SSAO
+{
+public:
+    static const GLuint TEXTURE_UNIT = 12; // has to match ssao.glsl
+    static const GLuint DEPTH_UNIT = 2; // scratch unit the depth is sampled from while computing, hi-z uses it the same way
+    static const int MAX_SAMPLES = 32; // has to match ssao_compute.glsl
+    static const int MIN_SAMPLES = 4;
+
+    float radius = 0.5f; // world units
+    float power = 1.5f;  // contrast of the final occlusion
+    int sampleCount = 16;
+
+    // the pass should cost at most this much of the frame, FitToBudget trades samples for time to stay under it
+    float budgetFraction = 0.1f;
+    bool fitToBudget = true;
+
+    // hemisphere kernel, random directions with more of them close to the center. any prefix of it is usable
+    // so the sample count can change without rebuilding it. call again after the shader is rebuilt
+    static void InitShader(Shader& ssaoShader)
+    {
+        std::mt19937 rng(1337);
+        std::uniform_real_distribution<float> random(0.0f, 1.0f);
+
+        ssaoShader.use();
+        for (int i = 0; i < MAX_SAMPLES; i++)
+        {
+            glm::vec3 sample(random(rng) * 2.0f - 1.0f, random(rng) * 2.0f - 1.0f, random(rng));
+            sample = glm::normalize(sample + glm::vec3(0.0f, 0.0f, 0.001f));
+            float scale = random(rng);
+            sample *= 0.1f + 0.9f * scale * scale;
+            ssaoShader.setVec3("kernel[" + std::to_string(i) + "]", sample);
+        }
+    }
+
+    // forward path, after the depth pre-pass. the default framebuffer's depth cant be sampled so it is copied out first
+    void ComputeFromFramebuffer(Shader& ssaoShader, const glm::mat4& projection)
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        Resize(viewport[2], viewport[3]);
+
+        GLState::Get().BindTexture(DEPTH_UNIT, GL_TEXTURE_2D, depthCopy);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1], width, height);
+
+        Compute(ssaoShader, projection, depthCopy, 0, 0);
+    }
+
+    // deferred path, the g-buffer's depth covers the default framebuffer up to the end of the viewport
+    void ComputeFromTexture(Shader& ssaoShader, const glm::mat4& projection, GLuint depthTexture)
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        Resize(viewport[2], viewport[3]);
+
+        Compute(ssaoShader, projection, depthTexture, viewport[0], viewport[1]);
+    }
+
+    // every frame before drawing, disabled until a Compute this frame enables it again
+    void Bind(bool enabled)
+    {
+        auto allocation = DynamicRingBuffer::Get().AllocateUniform(sizeof(SsaoData));
+        if (!allocation.data)
+            return;
+
+        SsaoData data = {glm::vec4(enabled && aoTexture != 0 ? 1.0f : 0.0f, power, 0.0f, 0.0f)};
+        std::memcpy(allocation.data, &data, sizeof(SsaoData));
+        GLState::Get().BindBufferRange(GL_UNIFORM_BUFFER, SSAO_UBO_BINDING, allocation.buffer, allocation.offset, allocation.size);
+
+        if (aoTexture != 0)
+        {
+            GLState::Get().BindTexture(TEXTURE_UNIT, GL_TEXTURE_2D, aoTexture);
+        }
+    }
+
+    // once a frame with the pass' averaged gpu time. steps the sample count down while it is over the budget
+    // and back up while it is well under, only every few frames since the timings lag behind
+    void FitToBudget(float ssaoMs, float frameMs)
+    {
+        if (!fitToBudget || ssaoMs <= 0.0f || frameMs <= 0.0f)
+            return;
+        if (++framesSinceFit < FIT_INTERVAL)
+            return;
+        framesSinceFit = 0;
+
+        float budgetMs = budgetFraction * frameMs;
+        if (ssaoMs > budgetMs)
+        {
+            sampleCount = std::max(MIN_SAMPLES, sampleCount - 2);
+        }
+        else if (ssaoMs < 0.6f * budgetMs)
+        {
+            sampleCount = std::min(MAX_SAMPLES, sampleCount + 2);
+        }
+    }
+
+    int GetWidth() const
+    {
+        return halfWidth;
+    }
+
+    int GetHeight() const
+    {
+        return halfHeight;
+    }
+
+    void Delete()
+    {
+        GLuint textures[] = {depthCopy, aoTexture, blurTexture};
+        glDeleteTextures(3, textures);
+        depthCopy = aoTexture = blurTexture = 0;
+        GLState::Get().Invalidate();
+    }
+
+private:
+    // matches SsaoUniforms in ssao.glsl (std140)
+    struct SsaoData
+    {
+        glm::vec4 params; // x = enabled, y = power
+    };
+
+    static const int FIT_INTERVAL = 30;
+
+    GLuint depthCopy = 0;
+    GLuint aoTexture = 0;   // r = occlusion, g = linear view depth (0 for the sky), the blur's result ends up in here too
+    GLuint blurTexture = 0; // between the two blur passes
+    int width = 0, height = 0;
+    int halfWidth = 0, halfHeight = 0;
+    int framesSinceFit = 0;
+
+    void Compute(Shader& ssaoShader, const glm::mat4& projection, GLuint depthTexture, int offsetX, int offsetY)
+    {
+        sampleCount = std::clamp(sampleCount, MIN_SAMPLES, MAX_SAMPLES);
+
+        ssaoShader.use();
+        ssaoShader.setInt("depthTexture", DEPTH_UNIT);
+        GLState::Get().BindTexture(DEPTH_UNIT, GL_TEXTURE_2D, depthTexture);
+        ssaoShader.setIVec2("depthOffset", offsetX, offsetY);
+        ssaoShader.setIVec2("depthSize", width, height);
+        ssaoShader.setMat4("projection", projection);
+        ssaoShader.setMat4("inverseProjection", glm::inverse(projection));
+        ssaoShader.setInt("sampleCount", sampleCount);
+        ssaoShader.setFloat("radius", radius);
+
+        ssaoShader.setInt("mode", 0);
+        glBindImageTexture(1, aoTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+        Dispatch();
+
+        // separable blur, ao -> blur -> ao
+        ssaoShader.setInt("mode", 1);
+        GLuint passes[2][2] = {{aoTexture, blurTexture}, {blurTexture, aoTexture}};
+        for (int pass = 0; pass < 2; pass++)
+        {
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+            ssaoShader.setIVec2("direction", pass == 0 ? 1 : 0, pass == 0 ? 0 : 1);
+            glBindImageTexture(0, passes[pass][0], 0, GL_FALSE, 0, GL_READ_ONLY, GL_RG16F);
+            glBindImageTexture(1, passes[pass][1], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+            Dispatch();
+        }
+
+        // the lighting shaders sample it next
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+        Bind(true);
+    }
+
+    void Dispatch()
+    {
+        glDispatchCompute((halfWidth + 7) / 8, (halfHeight + 7) / 8, 1);
+    }
+
+    void Resize(int _width, int _height)
+    {
+        if (_width == width && _height == height)
+            return;
+
+        width = _width;
+        height = _height;
+        halfWidth = std::max(1, (width + 1) / 2);
+        halfHeight = std::max(1, (height + 1) / 2);
+
+        // immutable storage cant be resized, so the textures are recreated
+        GLuint textures[] = {depthCopy, aoTexture, blurTexture};
+        glDeleteTextures(3, textures);
+        GLState::Get().Invalidate();
+
+        glGenTextures(1, &depthCopy);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, depthCopy);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        for (GLuint* texture : {&aoTexture, &blurTexture})
+        {
+            glGenTextures(1, texture);
+            GLState::Get().BindTexture(0, GL_TEXTURE_2D, *texture);
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG16F, halfWidth, halfHeight);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D, 0);
+    }
+};
@@ -0,0 +1,137 @@
+#version 460 core
+
+// half resolution ambient occlusion, see SSAO in ssao.hpp.
+// every texel looks at the full res pixel under its top left corner, so the upsample in ssao.glsl knows where it was taken
+layout (local_size_x = 8, local_size_y = 8) in;
+
+#define MODE_OCCLUSION 0
+#define MODE_BLUR 1
+uniform int mode;
+
+#define MAX_SAMPLES 32 // has to match SSAO::MAX_SAMPLES
+#define BLUR_RADIUS 4
+#define DEPTH_TOLERANCE 0.05 // relative view depth difference where the blur stops mixing texels
+
+uniform sampler2D depthTexture; // MODE_OCCLUSION
+layout (rg16f, binding = 0) uniform readonly image2D source; // MODE_BLUR
+layout (rg16f, binding = 1) uniform writeonly image2D destination; // r = occlusion, g = view depth (0 for the sky)
+
+uniform ivec2 depthOffset; // where the viewport starts in depthTexture
+uniform ivec2 depthSize;   // viewport size in full res pixels
+uniform mat4 projection;
+uniform mat4 inverseProjection;
+
+uniform vec3 kernel[MAX_SAMPLES];
+uniform int sampleCount;
+uniform float radius;
+
+uniform ivec2 direction; // MODE_BLUR
+
+float fetchDepth(ivec2 pixel)
+{
+    return texelFetch(depthTexture, clamp(pixel, ivec2(0), depthSize - 1) + depthOffset, 0).r;
+}
+
+vec3 viewPosition(vec2 uv, float depth)
+{
+    vec4 position = inverseProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return position.xyz / position.w;
+}
+
+vec3 pixelPosition(ivec2 pixel)
+{
+    return viewPosition((vec2(pixel) + 0.5) / vec2(depthSize), fetchDepth(pixel));
+}
+
+void computeOcclusion(ivec2 texel)
+{
+    ivec2 pixel = texel * 2;
+    float depth = fetchDepth(pixel);
+    if (depth >= 1.0)
+    {
+        imageStore(destination, texel, vec4(1.0, 0.0, 0.0, 0.0));
+        return;
+    }
+    vec3 position = viewPosition((vec2(pixel) + 0.5) / vec2(depthSize), depth);
+
+    // normal from the neighbours, whichever side is closer in depth so it doesnt bend around edges
+    vec3 right = pixelPosition(pixel + ivec2(1, 0)) - position;
+    vec3 left = position - pixelPosition(pixel - ivec2(1, 0));
+    vec3 up = pixelPosition(pixel + ivec2(0, 1)) - position;
+    vec3 down = position - pixelPosition(pixel - ivec2(0, 1));
+    vec3 dx = abs(right.z) < abs(left.z) ? right : left;
+    vec3 dy = abs(up.z) < abs(down.z) ? up : down;
+    vec3 normal = normalize(cross(dx, dy));
+    if (dot(normal, position) > 0.0)
+        normal = -normal;
+
+    // the kernel spun around the normal by a per texel angle (interleaved gradient noise), the blur hides the pattern
+    float angle = 6.2831853 * fract(52.9829189 * fract(dot(vec2(texel), vec2(0.06711056, 0.00583715))));
+    vec3 randomDirection = vec3(cos(angle), sin(angle), 0.0);
+    vec3 tangent = randomDirection - normal * dot(randomDirection, normal);
+    if (dot(tangent, tangent) < 0.0001)
+        tangent = vec3(0.0, 1.0, 0.0) - normal * normal.y;
+    tangent = normalize(tangent);
+    mat3 tbn = mat3(tangent, cross(normal, tangent), normal);
+
+    float occlusion = 0.0;
+    int samples = min(sampleCount, MAX_SAMPLES);
+    for (int i = 0; i < samples; i++)
+    {
+        vec3 samplePosition = position + tbn * kernel[i] * radius;
+        vec4 clip = projection * vec4(samplePosition, 1.0);
+        vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+        if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0))))
+            continue;
+
+        float sceneZ = viewPosition(uv, fetchDepth(ivec2(uv * vec2(depthSize)))).z;
+        // things far in front of the sample (a pillar in front of a wall) shouldnt darken it
+        float range = smoothstep(0.0, 1.0, radius / abs(position.z - sceneZ));
+        occlusion += (sceneZ >= samplePosition.z + 0.02 * radius ? 1.0 : 0.0) * range;
+    }
+
+    imageStore(destination, texel, vec4(1.0 - occlusion / float(max(samples, 1)), -position.z, 0.0, 0.0));
+}
+
+void blur(ivec2 texel, ivec2 size)
+{
+    vec2 center = imageLoad(source, texel).rg;
+    if (center.g <= 0.0)
+    {
+        imageStore(destination, texel, vec4(center, 0.0, 0.0));
+        return;
+    }
+
+    float sum = center.r;
+    float weightSum = 1.0;
+    for (int i = -BLUR_RADIUS; i <= BLUR_RADIUS; i++)
+    {
+        if (i == 0)
+            continue;
+
+        vec2 s = imageLoad(source, clamp(texel + direction * i, ivec2(0), size - 1)).rg;
+        float gaussian = exp(-float(i * i) / (2.0 * 2.5 * 2.5));
+        float depthWeight = max(0.0, 1.0 - abs(s.g - center.g) / (DEPTH_TOLERANCE * center.g));
+        float weight = gaussian * depthWeight;
+        sum += s.r * weight;
+        weightSum += weight;
+    }
+    imageStore(destination, texel, vec4(sum / weightSum, center.g, 0.0, 0.0));
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(destination);
+    if (texel.x >= size.x || texel.y >= size.y)
+        return;
+
+    if (mode == MODE_OCCLUSION)
+    {
+        computeOcclusion(texel);
+    }
+    else
+    {
+        blur(texel, size);
+    }
+}
@@ -6,10 +6,20 @@
 #include "../lib/stb_image.h"
 
 #include "shader.hpp"
+#include "gl_state.hpp"
 
 #include <iostream>
 
 
+// how a texture uses its alpha channel, decides which render bucket meshes using it go into
+enum class AlphaMode
+{
+    OPAQUE,  // alpha is 1 everywhere, no alpha test needed
+    CUTOUT,  // alpha is (almost) only fully on or off, alpha tested
+    BLENDED  // lots of partial alpha, alpha tested and blended
+};
+
+
 // singleton
 class TextureManager
 {
@@ -30,6 +40,21 @@ public:
         return subTexRes;
     }
 
+    AlphaMode GetAlphaMode(int layer) const
+    {
+        if (layer < 0 || layer >= layerAlphaModes.size())
+            return AlphaMode::OPAQUE;
+        return layerAlphaModes[layer];
+    }
+
+    // mean rgb of a layer's texture, what the cpu bakers use as the albedo
+    glm::vec3 GetAverageColor(int layer) const
+    {
+        if (layer < 0 || layer >= layerAverageColors.size())
+            return glm::vec3(1.0f);
+        return layerAverageColors[layer];
+    }
+
     void GenerateTextureArray(int _texWidth, int _texHeight, int _maxTextures)
     {
         maxTexLayers = _maxTextures;
@@ -39,8 +64,7 @@ public:
         mipLevels = (int)std::floor(std::log2(maxTexWidth)) + 1;
 
         glGenTextures(1, &texArrayID);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D_ARRAY, texArrayID);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D_ARRAY, texArrayID);
     
         glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, mipLevels - 1);
         glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
@@ -86,9 +110,10 @@ public:
         }
 
         subTexRes.push_back(glm::vec2(width, height));
+        layerAlphaModes.push_back(ClassifyAlpha(data, width * height));
+        layerAverageColors.push_back(AverageColor(data, width * height));
         
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D_ARRAY, texArrayID);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D_ARRAY, texArrayID);
 
         glTexSubImage3D(GL_TEXTURE_2D_ARRAY,
             0, 
@@ -103,14 +128,14 @@ public:
         int texLayerUsed = nextTexLayer; // set to the current layer used for the texture just initalized
         nextTexLayer++;
 
-        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
 
         return texLayerUsed; // return the layer just used in order to be used in shaders
     }
 
     void GenerateMipmaps()
     {
-        glBindTexture(GL_TEXTURE_2D_ARRAY, texArrayID);
+        GLState::Get().BindTexture(0, GL_TEXTURE_2D_ARRAY, texArrayID);
 
         glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
     }
@@ -124,11 +149,46 @@ public:
     }
 
 private:
+    // data is rgba8, checked once at load so the renderer knows which meshes can skip the alpha test
+    static AlphaMode ClassifyAlpha(const unsigned char* data, int pixelCount)
+    {
+        int transparent = 0;
+        int partial = 0;
+        for (int i = 0; i < pixelCount; i++)
+        {
+            unsigned char alpha = data[i * 4 + 3];
+            if (alpha < 255)
+                transparent++;
+            if (alpha > 16 && alpha < 240)
+                partial++;
+        }
+
+        if (transparent == 0)
+            return AlphaMode::OPAQUE;
+
+        // antialiased cutout edges have a few partial pixels, real translucency has a lot
+        if (partial > pixelCount / 20)
+            return AlphaMode::BLENDED;
+        return AlphaMode::CUTOUT;
+    }
+
+    static glm::vec3 AverageColor(const unsigned char* data, int pixelCount)
+    {
+        glm::dvec3 sum(0.0);
+        for (int i = 0; i < pixelCount; i++)
+        {
+            sum += glm::dvec3(data[i * 4], data[i * 4 + 1], data[i * 4 + 2]);
+        }
+        return glm::vec3(sum / (255.0 * std::max(pixelCount, 1)));
+    }
+
     // private constructor so other instances cant be made
     TextureManager() : texArrayID(0), maxTexWidth(0), maxTexHeight(0), maxTexLayers(0), nextTexLayer(0), mipLevels(0) {}
 
     GLuint texArrayID;
     std::vector<glm::vec2> subTexRes;
+    std::vector<AlphaMode> layerAlphaModes;
+    std::vector<glm::vec3> layerAverageColors;
     int maxTexWidth;
     int maxTexHeight;
 
@@ -0,0 +1,21 @@
+#pragma once
+
+// per object transforms, normal matrix is precomputed on the cpu (see transforms.hpp).
+// draws pass the object index through their base instance
+struct ObjectTransform
+{
+    mat4 model;
+    mat3 normalMatrix;
+};
+layout (std430, binding = 0) readonly buffer ObjectTransforms
+{
+    ObjectTransform objectTransforms[];
+};
+
+// compute shaders index objectTransforms directly, they have no draw parameters
+#ifndef COMPUTE_SHADER
+ObjectTransform getObjectTransform()
+{
+    return objectTransforms[gl_BaseInstance + gl_InstanceID];
+}
+#endif
\ No newline at end of file
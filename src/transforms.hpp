@@ -0,0 +1,214 @@
+#pragma once
+
+#include "../lib/glad.h"
+#include "glm/glm.hpp"
+
+#include "gl_state.hpp"
+
+#include <xmmintrin.h>
+
+#include <algorithm>
+#include <vector>
+
+
+// ssbo binding point of the object transforms, has to match vertex.glsl
+const GLuint TRANSFORM_SSBO_BINDING = 0;
+
+// one record per object, matches the std430 layout of ObjectTransform in the shaders
+struct ObjectTransform
+{
+    glm::mat4 model;
+    glm::vec4 normalMatrix[3]; // mat3 in glsl, std430 pads every column to a vec4
+};
+
+
+// writes transpose(inverse(mat3(model))) of 'count' matrices into out, 4 matrices at a time with sse.
+// for a 3x3 matrix with columns a, b, c the inverse transpose is [b x c, c x a, a x b] / det
+inline void ComputeNormalMatrices(const glm::mat4* models, ObjectTransform* out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        // transpose so each register holds the same element of 4 different matrices
+        __m128 cols[3][4]; // [column][component], lanes are matrices
+        for (int c = 0; c < 3; c++)
+        {
+            __m128 m0 = _mm_loadu_ps(&models[i + 0][c][0]);
+            __m128 m1 = _mm_loadu_ps(&models[i + 1][c][0]);
+            __m128 m2 = _mm_loadu_ps(&models[i + 2][c][0]);
+            __m128 m3 = _mm_loadu_ps(&models[i + 3][c][0]);
+            _MM_TRANSPOSE4_PS(m0, m1, m2, m3);
+            cols[c][0] = m0;
+            cols[c][1] = m1;
+            cols[c][2] = m2;
+            cols[c][3] = m3;
+        }
+
+        auto cross = [](const __m128* u, const __m128* v, __m128* result)
+        {
+            result[0] = _mm_sub_ps(_mm_mul_ps(u[1], v[2]), _mm_mul_ps(u[2], v[1]));
+            result[1] = _mm_sub_ps(_mm_mul_ps(u[2], v[0]), _mm_mul_ps(u[0], v[2]));
+            result[2] = _mm_sub_ps(_mm_mul_ps(u[0], v[1]), _mm_mul_ps(u[1], v[0]));
+        };
+
+        __m128 cofactors[3][4];
+        cross(cols[1], cols[2], cofactors[0]);
+        cross(cols[2], cols[0], cofactors[1]);
+        cross(cols[0], cols[1], cofactors[2]);
+
+        __m128 det = _mm_add_ps(_mm_add_ps(
+            _mm_mul_ps(cols[0][0], cofactors[0][0]),
+            _mm_mul_ps(cols[0][1], cofactors[0][1])),
+            _mm_mul_ps(cols[0][2], cofactors[0][2]));
+
+        // degenerate (zero scale) matrices get a det of 1 instead of producing infs
+        __m128 one = _mm_set1_ps(1.0f);
+        __m128 isZero = _mm_cmpeq_ps(det, _mm_setzero_ps());
+        det = _mm_or_ps(_mm_and_ps(isZero, one), _mm_andnot_ps(isZero, det));
+        __m128 invDet = _mm_div_ps(one, det);
+
+        for (int c = 0; c < 3; c++)
+        {
+            __m128 x = _mm_mul_ps(cofactors[c][0], invDet);
+            __m128 y = _mm_mul_ps(cofactors[c][1], invDet);
+            __m128 z = _mm_mul_ps(cofactors[c][2], invDet);
+            __m128 w = _mm_setzero_ps();
+            _MM_TRANSPOSE4_PS(x, y, z, w); // back to one column per matrix
+
+            _mm_storeu_ps(&out[i + 0].normalMatrix[c][0], x);
+            _mm_storeu_ps(&out[i + 1].normalMatrix[c][0], y);
+            _mm_storeu_ps(&out[i + 2].normalMatrix[c][0], z);
+            _mm_storeu_ps(&out[i + 3].normalMatrix[c][0], w);
+        }
+    }
+
+    // leftovers, the same cofactor formula and zero det guard as above so every index behaves the same
+    for (; i < count; i++)
+    {
+        glm::mat3 model = glm::mat3(models[i]);
+        glm::vec3 cofactors[3] = {glm::cross(model[1], model[2]), glm::cross(model[2], model[0]), glm::cross(model[0], model[1])};
+        float det = glm::dot(model[0], cofactors[0]);
+        float invDet = 1.0f / (det == 0.0f ? 1.0f : det);
+        for (int c = 0; c < 3; c++)
+        {
+            out[i].normalMatrix[c] = glm::vec4(cofactors[c] * invDet, 0.0f);
+        }
+    }
+}
+
+
+// singleton
+// holds the model + normal matrix of every object in an ssbo the vertex shaders index with gl_BaseInstance,
+// so draws dont need any per object uniforms and the normal matrix is only computed when a transform changes
+class TransformBuffer
+{
+public:
+    static TransformBuffer& Get()
+    {
+        static TransformBuffer instance;
+        return instance;
+    }
+
+    // returns the object index to draw with
+    unsigned int Add(const glm::mat4& model)
+    {
+        ObjectTransform record;
+        record.model = model;
+        records.push_back(record);
+
+        unsigned int index = records.size() - 1;
+        dirty.push_back(index);
+        return index;
+    }
+
+    void Set(unsigned int index, const glm::mat4& model)
+    {
+        records[index].model = model;
+        dirty.push_back(index);
+    }
+
+    const glm::mat4& GetModel(unsigned int index) const
+    {
+        return records[index].model;
+    }
+
+    unsigned int GetCount() const
+    {
+        return records.size();
+    }
+
+    // recompute normal matrices of changed objects and upload them, call once per frame before drawing
+    void Upload()
+    {
+        if (ssbo == 0)
+        {
+            glGenBuffers(1, &ssbo);
+        }
+        GLState::Get().BindBufferBase(GL_SHADER_STORAGE_BUFFER, TRANSFORM_SSBO_BINDING, ssbo);
+
+        if (dirty.empty())
+            return;
+        version++;
+
+        std::sort(dirty.begin(), dirty.end());
+        dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+        // gather the changed matrices so they can be batched through simd
+        scratchModels.resize(dirty.size());
+        scratchRecords.resize(dirty.size());
+        for (int i = 0; i < dirty.size(); i++)
+        {
+            scratchModels[i] = records[dirty[i]].model;
+        }
+        ComputeNormalMatrices(scratchModels.data(), scratchRecords.data(), dirty.size());
+        for (int i = 0; i < dirty.size(); i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                records[dirty[i]].normalMatrix[c] = scratchRecords[i].normalMatrix[c];
+            }
+        }
+
+        GLState::Get().BindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+        if (records.size() > capacity)
+        {
+            capacity = std::max<size_t>(records.size(), capacity * 2);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(ObjectTransform), NULL, GL_DYNAMIC_DRAW);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, records.size() * sizeof(ObjectTransform), records.data());
+        }
+        else
+        {
+            // one upload covering every changed record
+            unsigned int first = dirty.front();
+            unsigned int count = dirty.back() - first + 1;
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(ObjectTransform), count * sizeof(ObjectTransform), &records[first]);
+        }
+
+        dirty.clear();
+    }
+
+    GLuint GetBufferID() const
+    {
+        return ssbo;
+    }
+
+    // changes every time an Upload actually changed something, for caches built from the transforms
+    unsigned int GetVersion() const
+    {
+        return version;
+    }
+
+private:
+    // private constructor so other instances cant be made
+    TransformBuffer() : ssbo(0), capacity(0), version(0) {}
+
+    GLuint ssbo;
+    size_t capacity; // in records
+    unsigned int version;
+
+    std::vector<ObjectTransform> records;
+    std::vector<unsigned int> dirty;
+
+    std::vector<glm::mat4> scratchModels;
+    std::vector<ObjectTransform> scratchRecords;
+};
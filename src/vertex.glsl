@@ -3,22 +3,50 @@
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec2 inTexCoord;
+#ifdef LIGHTMAP
+layout (location = 3) in vec3 inLightmapCoord; // uv and page, see Lightmaps in lightmaps.hpp
+out vec3 lightmapCoord;
+#endif
+#ifdef BAKED
+layout (location = 4) in vec4 inColor; // imported vertex color, see Model in models.hpp
+out vec3 vertexColor;
+#endif
 
 out vec2 texCoord;
 
+// has to match depth_vertex.glsl exactly for the depth pre-pass
+invariant gl_Position;
+
 out vec3 fragPos;
 out vec3 normal;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "transforms.glsl"
+#include "frame.glsl"
+#include "materials.glsl"
+
+#ifdef MULTI_DRAW
+uniform int drawOffset; // first command of the current multi draw
+flat out uint materialIndex;
+#endif
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(inPos, 1.0);
+    ObjectTransform object = getObjectTransform();
+
+    gl_Position = projection * view * object.model * vec4(inPos, 1.0);
 
     texCoord = inTexCoord;
+#ifdef LIGHTMAP
+    lightmapCoord = inLightmapCoord;
+#endif
+#ifdef BAKED
+    vertexColor = inColor.rgb;
+#endif
+
+    normal = object.normalMatrix * inNormal;
+    fragPos = vec3(object.model * vec4(inPos, 1.0));
 
-    normal = mat3(transpose(inverse(model))) * inNormal;
-    fragPos = vec3(model * vec4(inPos, 1.0));
+#ifdef MULTI_DRAW
+    materialIndex = drawMaterials[drawOffset + gl_DrawID];
+#endif
 }
\ No newline at end of file